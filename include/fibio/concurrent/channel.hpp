@@ -0,0 +1,354 @@
+//
+//  channel.hpp
+//  fibio
+//
+
+#ifndef fibio_concurrent_channel_hpp
+#define fibio_concurrent_channel_hpp
+
+#include <limits>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <fibio/fibers/detail/fiber_base.hpp>
+#include <fibio/fibers/detail/spinlock.hpp>
+#include <fibio/concurrent/concurrent_queue.hpp>
+
+namespace fibio {
+namespace concurrent {
+
+/**
+ * A multi-producer/multi-consumer channel to transfer data between schedulers
+ *
+ * Unlike `concurrent_queue`, the channel doesn't use fiber mutex and condition variable,
+ * blocked fibers are parked in the channel and resumed in their own strands, neither side
+ * yields on push/pop, so producers and consumers can run in different schedulers without
+ * delaying each other.
+ * Non-blocking operations (`try_push`, `try_pop`, `close`, and `push` on an unbounded channel)
+ * can also be called from foreign threads.
+ */
+template <typename T, typename Container = std::deque<T>>
+class channel
+{
+public:
+    typedef channel<T, Container> this_type;
+    typedef typename Container::value_type value_type;
+    typedef typename Container::size_type size_type;
+
+    /**
+     * Constructor construct a channel
+     * @param capacity capacity of the channel, default to be unlimited
+     */
+    inline explicit channel(size_type capacity = std::numeric_limits<size_type>::max())
+    : opened_(true), capacity_(capacity)
+    {
+    }
+
+    /**
+     * Close the channel, closed channel cannot have new elements pushed in, all blocked fibers
+     * are resumed
+     */
+    inline void close()
+    {
+        waiter_list to_wake;
+        {
+            std::lock_guard<fibers::detail::spinlock> lock(mtx_);
+            opened_ = false;
+            to_wake.splice(not_full_);
+            to_wake.splice(not_empty_);
+        }
+        to_wake.wake_all();
+    }
+
+    /**
+     * Returns true if the channel is open
+     */
+    inline bool is_open() const
+    {
+        std::lock_guard<fibers::detail::spinlock> lock(mtx_);
+        return opened_;
+    }
+
+    /**
+     * Push an element into the channel, blocks if the channel is full
+     */
+    inline queue_op_status push(const T& data)
+    {
+        T t(data);
+        return push(std::move(t));
+    }
+
+    /**
+     * Push an element into the channel, blocks if the channel is full
+     */
+    inline queue_op_status push(T&& data)
+    {
+        std::unique_lock<fibers::detail::spinlock> lock(mtx_);
+        // Wait until channel is closed or not full
+        while (opened_ && (the_queue_.size() >= capacity_)) {
+            wait(not_full_, lock);
+        }
+        if (!opened_) {
+            // Cannot push into a closed channel
+            return queue_op_status::closed;
+        }
+        the_queue_.push_back(std::move(data));
+        wake_one(not_empty_, lock);
+        return queue_op_status::success;
+    }
+
+    /**
+     * Push an element into the channel, blocks if the channel is full
+     * std::back_inserter support
+     */
+    inline void push_back(const T& data) { push(data); }
+
+    /**
+     * Push an element into the channel, blocks if the channel is full
+     * std::back_inserter support
+     */
+    inline void push_back(T&& data) { push(std::move(data)); }
+
+    /**
+     * Try push an element into the channel without blocking
+     * @return return queue_op_status::success if element is pushed, other values indicate failure
+     */
+    inline queue_op_status try_push(T&& data)
+    {
+        std::unique_lock<fibers::detail::spinlock> lock(mtx_);
+        if (!opened_) {
+            return queue_op_status::closed;
+        }
+        if (the_queue_.size() >= capacity_) {
+            return queue_op_status::full;
+        }
+        the_queue_.push_back(std::move(data));
+        wake_one(not_empty_, lock);
+        return queue_op_status::success;
+    }
+
+    /**
+     * Try push an element into the channel without blocking
+     * @return return queue_op_status::success if element is pushed, other values indicate failure
+     */
+    inline queue_op_status try_push(const T& data)
+    {
+        T t(data);
+        return try_push(std::move(t));
+    }
+
+    /**
+     * Blocks until an element is popped from the channel
+     * @return return queue_op_status::success if element is popped, other values indicate failure
+     */
+    inline queue_op_status pop(T& popped_value)
+    {
+        std::unique_lock<fibers::detail::spinlock> lock(mtx_);
+        // Wait only if the channel is open and empty
+        while (opened_ && the_queue_.empty()) {
+            wait(not_empty_, lock);
+        }
+        if (the_queue_.empty()) {
+            // Empty and closed
+            return queue_op_status::closed;
+        }
+        popped_value = std::move(the_queue_.front());
+        the_queue_.pop_front();
+        wake_one(not_full_, lock);
+        return queue_op_status::success;
+    }
+
+    /**
+     * Try to pop an element from the channel without blocking
+     * @return return queue_op_status::success if element is popped, other values indicate failure
+     */
+    inline queue_op_status try_pop(T& popped_value)
+    {
+        std::unique_lock<fibers::detail::spinlock> lock(mtx_);
+        if (the_queue_.empty()) {
+            return opened_ ? queue_op_status::empty : queue_op_status::closed;
+        }
+        popped_value = std::move(the_queue_.front());
+        the_queue_.pop_front();
+        wake_one(not_full_, lock);
+        return queue_op_status::success;
+    }
+
+    /**
+     * Returns true indicates the channel is empty
+     * NOTE: The return value is just a snapshot
+     */
+    inline bool empty() const
+    {
+        std::lock_guard<fibers::detail::spinlock> lock(mtx_);
+        return the_queue_.empty();
+    }
+
+    /**
+     * Returns the number of elements holding in the channel
+     * NOTE: The return value is just a snapshot
+     */
+    inline size_type size() const
+    {
+        std::lock_guard<fibers::detail::spinlock> lock(mtx_);
+        return the_queue_.size();
+    }
+
+    /**
+     * Returns the max number of elements the channel can hold
+     */
+    inline size_type capacity() const { return capacity_; }
+
+    /**
+     * Minimal range-based for loop support
+     * It's not a fully functional iterator and should not be used directly
+     */
+    struct iterator : std::iterator<std::input_iterator_tag, T>
+    {
+        iterator(iterator&& other) = default;
+
+        bool operator!=(const iterator& other) const
+        {
+            // Only ended iterators are equal
+            return !(ended() && other.ended());
+        }
+
+        iterator& operator++()
+        {
+            if (channel_->pop(value_) != queue_op_status::success) channel_ = 0;
+            return *this;
+        }
+
+        value_type& operator*() { return value_; }
+
+        value_type* operator->() { return &value_; }
+
+    private:
+        bool ended() const { return !channel_; }
+
+        iterator() : channel_(0) {}
+
+        iterator(this_type* ch) : channel_(ch) { operator++(); }
+
+        iterator(const iterator& other) = delete;
+
+        iterator& operator=(const iterator& other) = delete;
+
+        this_type* channel_;
+        value_type value_;
+        friend class channel;
+    };
+
+    /**
+     * Minimal range-based for loop support
+     */
+    iterator begin() { return iterator(this); }
+
+    /**
+     * Minimal range-based for loop support
+     * Returns an iterator indicates the channel is empty and closed.
+     */
+    iterator end() const { return iterator(); }
+
+private:
+    // Non-copyable, non-movable
+    channel(const channel&) = delete;
+
+    channel(channel&&) = delete;
+
+    void operator=(const channel&) = delete;
+
+    // A fiber parked in the channel, lives on the stack of the fiber
+    struct waiter
+    {
+        fibers::detail::fiber_base::ptr_t f_;
+        waiter* next_ = nullptr;
+    };
+
+    struct waiter_list
+    {
+        waiter* head_ = nullptr;
+        waiter* tail_ = nullptr;
+
+        void push_back(waiter* w)
+        {
+            if (tail_)
+                tail_->next_ = w;
+            else
+                head_ = w;
+            tail_ = w;
+        }
+
+        waiter* pop_front()
+        {
+            waiter* w = head_;
+            if (w) {
+                head_ = w->next_;
+                if (!head_) tail_ = nullptr;
+            }
+            return w;
+        }
+
+        void splice(waiter_list& other)
+        {
+            if (!other.head_) return;
+            if (tail_)
+                tail_->next_ = other.head_;
+            else
+                head_ = other.head_;
+            tail_ = other.tail_;
+            other.head_ = other.tail_ = nullptr;
+        }
+
+        void wake_all()
+        {
+            while (waiter* w = pop_front()) {
+                // Copy the pointer out, the waiter may be gone as soon as it's resumed
+                fibers::detail::fiber_base::ptr_t f(std::move(w->f_));
+                f->resume();
+            }
+        }
+    };
+
+    void wait(waiter_list& l, std::unique_lock<fibers::detail::spinlock>& lock)
+    {
+        // Throws if not in a fiber
+        waiter w{fibers::detail::get_current_fiber_ptr()};
+        l.push_back(&w);
+        // The waker pops the waiter before resuming the fiber, and the resumption is posted to
+        // the strand of the fiber so it can only happen after the pause
+        fibers::detail::fiber_base::ptr_t f(w.f_);
+        lock.unlock();
+        try {
+            f->pause();
+        } catch (...) {
+            // Interrupted after being popped by a waker, pass the wakeup on so the element or the
+            // room isn't left unclaimed
+            lock.lock();
+            wake_one(l, lock);
+            throw;
+        }
+        lock.lock();
+    }
+
+    void wake_one(waiter_list& l, std::unique_lock<fibers::detail::spinlock>& lock)
+    {
+        waiter* w = l.pop_front();
+        if (!w) return;
+        fibers::detail::fiber_base::ptr_t f(std::move(w->f_));
+        lock.unlock();
+        f->resume();
+    }
+
+    bool opened_;
+    const size_type capacity_;
+    mutable fibers::detail::spinlock mtx_;
+    waiter_list not_full_;
+    waiter_list not_empty_;
+    Container the_queue_;
+};
+
+} // End of namespace concurrent
+} // End of namespace fibio
+
+#endif
@@ -10,11 +10,22 @@
 #define fibio_fiber_hpp
 
 #include <fibio/fibers/fiber.hpp>
+#include <fibio/fibers/cancellation.hpp>
 #include <fibio/fibers/mutex.hpp>
 #include <fibio/fibers/condition_variable.hpp>
 #include <fibio/fibers/shared_mutex.hpp>
+#include <fibio/fibers/read_mostly_mutex.hpp>
+#include <fibio/fibers/snapshot.hpp>
+#include <fibio/fibers/combiner.hpp>
 #include <fibio/fibers/barrier.hpp>
+#include <fibio/fibers/semaphore.hpp>
+#include <fibio/fibers/latch.hpp>
+#include <fibio/fibers/event.hpp>
 #include <fibio/fibers/fss.hpp>
 #include <fibio/fibers/fiber_group.hpp>
+#include <fibio/fibers/cpu_pool.hpp>
+#include <fibio/fibers/parallel.hpp>
+#include <fibio/fibers/profiler.hpp>
+#include <fibio/fibers/logger.hpp>
 
 #endif
@@ -49,6 +49,8 @@ struct guard
     {
         old_buf_ = stream_.rdbuf(new_buf_.get());
         new_buf_->assign(h);
+        // Shared by all fibers, a cancelled one mustn't fail the stream for others
+        new_buf_->set_cancellable(false);
         // Don't sync with stdio, it doesn't work anyway
         stream_.sync_with_stdio(false);
         // Set to unbuffered if needed
@@ -0,0 +1,268 @@
+//
+//  cancellation.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_cancellation_hpp
+#define fibio_fibers_cancellation_hpp
+
+#include <functional>
+#include <memory>
+#include <boost/system/error_code.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+class cancellation_state;
+typedef std::shared_ptr<cancellation_state> cancellation_state_ptr;
+
+/**
+ * A callback registered in a cancellation state, lives in the registering object, so registering
+ * doesn't allocate
+ */
+struct cancellation_callback
+{
+    typedef void (*callback_t)(cancellation_callback*);
+
+    cancellation_callback(callback_t fn, void* data) : fn_(fn), data_(data) {}
+
+    callback_t fn_;
+    void* data_;
+    cancellation_callback* prev_ = nullptr;
+    cancellation_callback* next_ = nullptr;
+    bool linked_ = false;
+};
+
+} // End of namespace detail
+
+class cancellation_token;
+class cancellation_source;
+class cancellation_registration;
+
+namespace this_fiber {
+class cancellation_scope;
+cancellation_token get_cancellation_token();
+} // End of namespace this_fiber
+
+/**
+ * class cancellation_token
+ *
+ * Observes the cancellation requested through a cancellation_source, tokens are cheap to copy
+ * and can be passed across fibers and threads.
+ * A default constructed token is never cancelled.
+ */
+class cancellation_token
+{
+public:
+    /// constructor, the token can never be cancelled
+    cancellation_token() = default;
+
+    /// Checks if the cancellation is requested
+    bool is_cancelled() const noexcept;
+
+    /// Checks if the token is associated with a cancellation_source
+    bool can_be_cancelled() const noexcept { return bool(state_); }
+
+    /// Throws operation_cancelled if the cancellation is requested
+    void throw_if_cancelled() const;
+
+private:
+    explicit cancellation_token(detail::cancellation_state_ptr s) : state_(std::move(s)) {}
+
+    detail::cancellation_state_ptr state_;
+
+    friend class cancellation_source;
+    friend class cancellation_registration;
+    friend class this_fiber::cancellation_scope;
+    friend cancellation_token this_fiber::get_cancellation_token();
+};
+
+/**
+ * class cancellation_source
+ *
+ * Requests cancellation of the operations observing its tokens
+ */
+class cancellation_source
+{
+public:
+    /// constructor
+    cancellation_source();
+
+    /// Returns a token associated with this source
+    cancellation_token get_token() const { return cancellation_token(state_); }
+
+    /**
+     * Requests cancellation, registered callbacks are called in the calling context before this
+     * returns, returns false if the cancellation was already requested
+     */
+    bool cancel();
+
+    /// Checks if the cancellation is requested
+    bool is_cancelled() const noexcept;
+
+private:
+    detail::cancellation_state_ptr state_;
+};
+
+/**
+ * class cancellation_registration
+ *
+ * Registers a callback called once the cancellation of the token is requested, the callback is
+ * called in the constructor if it's already requested.
+ * The callback is called in the context requesting the cancellation, it must be short and must
+ * not block. The destructor deregisters the callback and waits if it's being called in another
+ * thread.
+ */
+class cancellation_registration
+{
+public:
+    /// constructor
+    cancellation_registration(const cancellation_token& token, std::function<void()> fn);
+
+    /// destructor
+    ~cancellation_registration();
+
+private:
+    cancellation_registration(const cancellation_registration&) = delete;
+
+    void operator=(const cancellation_registration&) = delete;
+
+    static void invoke(detail::cancellation_callback* cb);
+
+    std::function<void()> fn_;
+    detail::cancellation_state_ptr state_;
+    detail::cancellation_callback cb_;
+};
+
+namespace asio {
+namespace detail {
+
+/**
+ * Cancels pending operations of an I/O object once the cancellation of the token bound to the
+ * current fiber is requested
+ */
+class io_cancellation
+{
+protected:
+    typedef void (*cancel_fn_t)(void*);
+
+    io_cancellation(cancel_fn_t fn, void* io, bool enabled);
+
+    ~io_cancellation();
+
+public:
+    /// Checks if the cancellation of the bound token is requested
+    bool cancelled() const noexcept;
+
+private:
+    io_cancellation(const io_cancellation&) = delete;
+
+    void operator=(const io_cancellation&) = delete;
+
+    static void invoke(fibers::detail::cancellation_callback* cb);
+
+    struct target;
+
+    cancel_fn_t fn_;
+    void* io_;
+    fibers::detail::cancellation_state_ptr state_;
+    std::shared_ptr<target> target_;
+    fibers::detail::cancellation_callback cb_;
+};
+
+} // End of namespace detail
+
+/**
+ * class cancellation_guard
+ *
+ * Makes pending operations of a socket, timer or any I/O object with `cancel(error_code&)`
+ * cancellable by the token bound to the current fiber, operations started with `asio::yield`
+ * complete with `operation_aborted` once the cancellation is requested.
+ * The I/O object is canceled in the strand of the fiber, while the fiber is waiting, check
+ * `cancelled()` before starting each operation, an operation started after the cancellation is
+ * not canceled.
+ * Does nothing if no token is bound, or if `enabled` is false.
+ */
+class cancellation_guard : public detail::io_cancellation
+{
+public:
+    template <typename IoObject>
+    explicit cancellation_guard(IoObject& io, bool enabled = true)
+    : io_cancellation(&cancel_io<IoObject>, &io, enabled)
+    {
+    }
+
+private:
+    template <typename IoObject>
+    static void cancel_io(void* io)
+    {
+        boost::system::error_code ec;
+        static_cast<IoObject*>(io)->cancel(ec);
+    }
+};
+
+} // End of namespace asio
+
+namespace this_fiber {
+
+/**
+ * class cancellation_scope
+ *
+ * Binds a cancellation token to the current fiber until the scope ends, the previously bound
+ * token is restored after.
+ * Once the cancellation is requested, sleeps, future waits, condition variable waits and I/O of
+ * fibio streams of the fiber end with an operation_cancelled exception, or with an error for
+ * stream I/O.
+ * Fibers started within the scope inherit the token.
+ */
+class cancellation_scope
+{
+public:
+    /// constructor
+    explicit cancellation_scope(const cancellation_token& token);
+
+    /// destructor
+    ~cancellation_scope();
+
+private:
+    cancellation_scope(const cancellation_scope&) = delete;
+
+    void operator=(const cancellation_scope&) = delete;
+
+    fibers::detail::cancellation_state_ptr prev_;
+};
+
+/// Returns the token bound to the current fiber, the token can never be cancelled if none is bound
+cancellation_token get_cancellation_token();
+
+/// Checks if the cancellation of the token bound to the current fiber is requested
+bool cancellation_requested() noexcept;
+
+/// Throws operation_cancelled if the cancellation of the bound token is requested
+void cancellation_point();
+
+} // End of namespace this_fiber
+} // End of namespace fibers
+
+using fibers::cancellation_token;
+using fibers::cancellation_source;
+using fibers::cancellation_registration;
+
+namespace asio {
+
+using fibers::asio::cancellation_guard;
+
+} // End of namespace asio
+
+namespace this_fiber {
+
+using fibers::this_fiber::cancellation_scope;
+using fibers::this_fiber::get_cancellation_token;
+using fibers::this_fiber::cancellation_requested;
+using fibers::this_fiber::cancellation_point;
+
+} // End of namespace this_fiber
+} // End of namespace fibio
+
+#endif
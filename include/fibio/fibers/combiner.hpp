@@ -0,0 +1,177 @@
+//
+//  combiner.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_combiner_hpp
+#define fibio_fibers_combiner_hpp
+
+#include <atomic>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <boost/optional.hpp>
+#include <fibio/fibers/detail/fiber_base.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/**
+ * An operation published to a combiner
+ * The operation lives on the stack of the publishing fiber, which is parked until the operation
+ * is applied, so publishing doesn't allocate
+ */
+struct combining_op
+{
+    enum state_t
+    {
+        WAITING,
+        PARKED,
+        DONE,
+        // The publisher has been chosen to be the next combiner
+        COMBINE,
+    };
+
+    virtual ~combining_op() {}
+
+    /// Runs in the combining fiber
+    virtual void run() = 0;
+
+    fiber_base::ptr_t fiber_;
+    std::exception_ptr exception_;
+    std::atomic<int> state_{WAITING};
+    combining_op* next_ = nullptr;
+};
+
+template <typename Fn, typename T, typename R>
+struct combining_op_object : combining_op
+{
+    combining_op_object(Fn& fn, T& value) : fn_(fn), value_(value) {}
+
+    virtual void run() override { result_ = fn_(value_); }
+
+    R get()
+    {
+        if (exception_) std::rethrow_exception(exception_);
+        return std::forward<R>(*result_);
+    }
+
+    Fn& fn_;
+    T& value_;
+    boost::optional<R> result_;
+};
+
+template <typename Fn, typename T>
+struct combining_op_object<Fn, T, void> : combining_op
+{
+    combining_op_object(Fn& fn, T& value) : fn_(fn), value_(value) {}
+
+    virtual void run() override { fn_(value_); }
+
+    void get()
+    {
+        if (exception_) std::rethrow_exception(exception_);
+    }
+
+    Fn& fn_;
+    T& value_;
+};
+
+/**
+ * class combiner_base
+ *
+ * Publication list and combining protocol of `combiner`, independent of the protected value.
+ */
+class combiner_base
+{
+public:
+    /// constructor
+    combiner_base() = default;
+
+    /**
+     * Publishes the operation and returns after it has been applied, either by the calling
+     * fiber acting as the combiner, or by another one
+     */
+    void execute(combining_op* op);
+
+private:
+    combiner_base(const combiner_base&) = delete;
+
+    void operator=(const combiner_base&) = delete;
+
+    // Applies operations in the batch and all operations published later, until there is
+    // nothing to apply or combining is handed over to another fiber
+    void combine(combining_op* batch);
+
+    // Takes all published operations in FIFO order
+    combining_op* take();
+
+    combining_op::state_t wait(combining_op* op);
+
+    // Operations are applied in batches, a combiner hands over combining after this many
+    // batches, so it's not kept busy forever by other fibers
+    static constexpr unsigned max_batches = 4;
+
+    // Published operations in LIFO order
+    std::atomic<combining_op*> pending_{nullptr};
+    std::atomic<bool> combining_{false};
+};
+
+} // End of namespace detail
+
+/**
+ * class combiner
+ *
+ * Flat-combining wrapper of a value shared by many fibers.
+ *
+ * Instead of taking turns on a lock, fibers publish operations on the value, and the first one
+ * finding nobody combining becomes the combiner and applies all published operations in a batch,
+ * while others are parked until their operations are applied. Under contention this turns
+ * a context switch per lock handoff into one batch per combiner, and the value stays hot in the
+ * cache of the combining thread.
+ *
+ * Operations should be short, and must not call `apply` on the same combiner.
+ * Can also be used by foreign threads, which spin until their operations are applied.
+ */
+template <typename T>
+class combiner
+{
+public:
+    /// constructor, constructs the value with the arguments
+    template <typename... Args>
+    explicit combiner(Args&&... args)
+    : value_(std::forward<Args>(args)...)
+    {
+    }
+
+    /**
+     * Applies `fn` on the value exclusively, returns the result, exception thrown by `fn` is
+     * propagated to the caller
+     * `fn` may be called in another fiber, but the calling fiber is blocked until it returns
+     */
+    template <typename Fn>
+    typename std::result_of<Fn(T&)>::type apply(Fn&& fn)
+    {
+        typedef typename std::result_of<Fn(T&)>::type result_type;
+        detail::combining_op_object<Fn, T, result_type> op(fn, value_);
+        core_.execute(&op);
+        return op.get();
+    }
+
+private:
+    combiner(const combiner&) = delete;
+
+    void operator=(const combiner&) = delete;
+
+    detail::combiner_base core_;
+    T value_;
+};
+
+} // End of namespace fibers
+
+using fibers::combiner;
+
+} // End of namespace fibio
+
+#endif
@@ -14,17 +14,26 @@
 #include <condition_variable>
 #include <fibio/fibers/detail/forward.hpp>
 #include <fibio/fibers/mutex.hpp>
+#include <fibio/fibers/detail/wait_queue.hpp>
 
 namespace fibio {
 namespace fibers {
 
 using std::cv_status;
 
+/**
+ * struct condition_variable
+ *
+ * Works with `fibio::mutex`, both fibers and foreign threads can wait on and notify it.
+ */
 struct condition_variable
 {
     /// constructor
     condition_variable() = default;
 
+    /// constructor, creates a condition variable whose waits are not seen by `contention_profiler`
+    explicit condition_variable(detail::unprofiled_t) : profiled_(false) {}
+
     /**
      * notifies one waiting fiber
      */
@@ -113,23 +122,27 @@ private:
 
     cv_status wait_rel(std::unique_lock<mutex>& lock, detail::duration_t d);
 
-    void timeout_handler(detail::fiber_ptr_t this_fiber,
-                         detail::timer_t* t,
-                         cv_status& ret,
-                         boost::system::error_code ec);
+    // Waits in a fiber until notified, the deadline if it's not null, or the cancellation of the
+    // bound token
+    cv_status wait_in_fiber(std::unique_lock<mutex>& lock, const detail::time_point_t* deadline);
 
-    detail::spinlock mtx_;
+    void wait_in_thread(std::unique_lock<mutex>& lock);
 
-    struct suspended_item
-    {
-        mutex* m_;
-        detail::fiber_ptr_t f_;
-        detail::timer_t* t_;
+    cv_status wait_rel_in_thread(std::unique_lock<mutex>& lock, detail::duration_t d);
 
-        bool operator==(detail::fiber_ptr_t f) const { return f_ == f; }
-    };
+    static void timeout_handler(detail::timer_entry* e);
 
-    std::deque<suspended_item> suspended_;
+    static void cancel_handler(detail::cancellation_callback* cb);
+
+    // Removes a timed out or cancelled waiter and resumes it, unless it's already notified
+    void expire(detail::wait_node* node, bool& flag);
+
+    // Returns true if the calling fiber or foreign thread owns the mutex
+    static bool owns(mutex* m);
+
+    detail::spinlock mtx_;
+    bool profiled_ = true;
+    detail::wait_queue suspended_;
 };
 
 /**
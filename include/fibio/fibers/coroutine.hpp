@@ -0,0 +1,358 @@
+//
+//  coroutine.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_coroutine_hpp
+#define fibio_fibers_coroutine_hpp
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <boost/asio/io_service.hpp>
+#include <boost/optional.hpp>
+#include <fibio/fibers/fiber.hpp>
+#include <fibio/fibers/future/future.hpp>
+#include <fibio/fibers/future/promise.hpp>
+
+namespace fibio {
+namespace fibers {
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+struct task_promise_base
+{
+    struct final_awaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+        {
+            task_promise_base& p = h.promise();
+            if (p.continuation_) return p.continuation_;
+            // Nobody waits for a spawned task, the frame goes away on completion
+            if (p.detached_) h.destroy();
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { except_ = std::current_exception(); }
+
+    void rethrow_if_exception()
+    {
+        if (except_) std::rethrow_exception(except_);
+    }
+
+    // Where the task is resumed after waiting for something
+    boost::asio::io_service* ios_ = nullptr;
+    // The coroutine waiting for this task
+    std::coroutine_handle<> continuation_;
+    bool detached_ = false;
+    std::exception_ptr except_;
+};
+
+template <typename T>
+struct task_promise : task_promise_base
+{
+    task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& value)
+    {
+        value_ = std::forward<U>(value);
+    }
+
+    T result()
+    {
+        rethrow_if_exception();
+        return std::move(value_.get());
+    }
+
+    boost::optional<T> value_;
+};
+
+template <>
+struct task_promise<void> : task_promise_base
+{
+    task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() { rethrow_if_exception(); }
+};
+
+/// Returns the io_service resuming the coroutine owning the promise
+inline boost::asio::io_service& resuming_io_service(task_promise_base& p)
+{
+    if (!p.ios_) p.ios_ = &scheduler::get_instance().get_io_service();
+    return *p.ios_;
+}
+
+template <typename Promise,
+          typename = typename std::enable_if<
+              !std::is_base_of<task_promise_base, Promise>::value>::type>
+boost::asio::io_service& resuming_io_service(Promise&)
+{
+    // Coroutines of other types are resumed by the default scheduler
+    return scheduler::get_instance().get_io_service();
+}
+
+/**
+ * Awaits a future, the coroutine is resumed in its io_service once the future is ready
+ */
+template <typename Future>
+struct future_awaiter
+{
+    bool await_ready() const
+    {
+        return fut_.wait_for(std::chrono::seconds(0)) == future_status::ready;
+    }
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> h)
+    {
+        boost::asio::io_service& ios = resuming_io_service(h.promise());
+        // `then` takes over the state of an unique future, the continuation gives it back
+        fut_.then([this, h, &ios](Future& f) {
+            if (!fut_.valid()) fut_ = std::move(f);
+            ios.post([h]() { h.resume(); });
+        });
+    }
+
+    auto await_resume() { return fut_.get(); }
+
+    Future fut_;
+};
+
+/**
+ * Suspends the coroutine for some time, or until the next round of the io_service
+ */
+struct sleep_awaiter
+{
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> h)
+    {
+        boost::asio::io_service& ios = resuming_io_service(h.promise());
+        if (d_ <= duration_t::zero()) {
+            ios.post([h]() { h.resume(); });
+            return;
+        }
+        timer_.reset(new timer_t(ios, d_));
+        timer_->async_wait([h](boost::system::error_code) { h.resume(); });
+    }
+
+    void await_resume() noexcept {}
+
+    duration_t d_;
+    std::unique_ptr<timer_t> timer_;
+};
+
+} // End of namespace detail
+
+/**
+ * class task
+ *
+ * Stackless C++20 coroutine, takes a few hundred bytes for the frame instead of a fiber stack.
+ *
+ * A task starts when it's awaited by another coroutine or spawned with `co_spawn`, and runs in
+ * the io_service of a scheduler along with fibers. A task can `co_await` other tasks, fibio
+ * futures, including the ones returned by `async` and asio operations using `asio::use_future`,
+ * and `this_coroutine::sleep_for`/`yield`.
+ *
+ * NOTE: Blocking fiber primitives, like mutex and condition_variable, cannot be used in a task.
+ */
+template <typename T>
+class task
+{
+public:
+    typedef detail::task_promise<T> promise_type;
+
+    task() = default;
+
+    task(task&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+
+    task& operator=(task&& other) noexcept
+    {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+
+    ~task()
+    {
+        if (handle_) handle_.destroy();
+    }
+
+    /// Checks if the task refers to a coroutine
+    bool valid() const noexcept { return bool(handle_); }
+
+    struct awaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h)
+        {
+            handle_.promise().continuation_ = h;
+            handle_.promise().ios_ = &detail::resuming_io_service(h.promise());
+            // Starts the task in the same thread
+            return handle_;
+        }
+
+        T await_resume() { return handle_.promise().result(); }
+
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    awaiter operator co_await() && { return awaiter{handle_}; }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+
+    std::coroutine_handle<promise_type> release()
+    {
+        auto h = handle_;
+        handle_ = nullptr;
+        return h;
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+
+    friend struct detail::task_promise<T>;
+
+    template <typename U>
+    friend future<U> co_spawn(boost::asio::io_service& ios, task<U> t);
+};
+
+namespace detail {
+
+template <typename T>
+task<T> task_promise<T>::get_return_object()
+{
+    return task<T>(std::coroutine_handle<task_promise>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object()
+{
+    return task<void>(std::coroutine_handle<task_promise>::from_promise(*this));
+}
+
+// Runs a spawned task, and fulfills the promise with its result
+template <typename T>
+task<void> spawn_driver(task<T> t, promise<T> p)
+{
+    try {
+        p.set_value(co_await std::move(t));
+    } catch (...) {
+        p.set_exception(std::current_exception());
+    }
+}
+
+inline task<void> spawn_driver(task<void> t, promise<void> p)
+{
+    try {
+        co_await std::move(t);
+        p.set_value();
+    } catch (...) {
+        p.set_exception(std::current_exception());
+    }
+}
+
+} // End of namespace detail
+
+/**
+ * Starts the task in the io_service, returns a future of its result
+ */
+template <typename T>
+future<T> co_spawn(boost::asio::io_service& ios, task<T> t)
+{
+    promise<T> p;
+    future<T> ret = p.get_future();
+    auto h = detail::spawn_driver(std::move(t), std::move(p)).release();
+    h.promise().ios_ = &ios;
+    h.promise().detached_ = true;
+    ios.post([h]() { h.resume(); });
+    return ret;
+}
+
+/**
+ * Starts the task in the scheduler
+ */
+template <typename T>
+future<T> co_spawn(scheduler& sched, task<T> t)
+{
+    return co_spawn(sched.get_io_service(), std::move(t));
+}
+
+/**
+ * Starts the task in the scheduler of the current fiber, or in the default scheduler
+ */
+template <typename T>
+future<T> co_spawn(task<T> t)
+{
+    return co_spawn(this_fiber::is_a_fiber() ? this_fiber::detail::get_io_service()
+                                             : scheduler::get_instance().get_io_service(),
+                    std::move(t));
+}
+
+template <typename R>
+detail::future_awaiter<future<R>> operator co_await(future<R>&& f)
+{
+    return detail::future_awaiter<future<R>>{std::move(f)};
+}
+
+template <typename R>
+detail::future_awaiter<shared_future<R>> operator co_await(const shared_future<R>& f)
+{
+    return detail::future_awaiter<shared_future<R>>{f};
+}
+
+namespace this_coroutine {
+
+/**
+ * Suspends the current task for some time
+ */
+template <class Rep, class Period>
+detail::sleep_awaiter sleep_for(const std::chrono::duration<Rep, Period>& d)
+{
+    return detail::sleep_awaiter{std::chrono::duration_cast<detail::duration_t>(d), nullptr};
+}
+
+/**
+ * Reschedules the current task
+ */
+inline detail::sleep_awaiter yield()
+{
+    return detail::sleep_awaiter{detail::duration_t::zero(), nullptr};
+}
+
+} // End of namespace this_coroutine
+} // End of namespace fibers
+
+using fibers::task;
+using fibers::co_spawn;
+
+namespace this_coroutine {
+using fibers::this_coroutine::sleep_for;
+using fibers::this_coroutine::yield;
+} // End of namespace this_coroutine
+
+} // End of namespace fibio
+
+#endif // defined(__cpp_impl_coroutine)
+
+#endif
@@ -0,0 +1,168 @@
+//
+//  cpu_pool.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_cpu_pool_hpp
+#define fibio_fibers_cpu_pool_hpp
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <boost/optional.hpp>
+#include <fibio/utility.hpp>
+#include <fibio/fibers/fiber.hpp>
+#include <fibio/fibers/detail/fiber_base.hpp>
+
+namespace fibio {
+namespace fibers {
+
+struct cpu_pool_impl;
+
+namespace detail {
+
+/**
+ * A job submitted to the cpu pool
+ * The job lives on the stack of the submitting fiber, which is parked until the job is done, so
+ * submission doesn't allocate
+ */
+struct cpu_job
+{
+    virtual ~cpu_job() {}
+
+    /// Runs in a pool thread
+    virtual void run() = 0;
+
+    fiber_base::ptr_t fiber_;
+    std::exception_ptr exception_;
+    cpu_job* next_ = nullptr;
+};
+
+template <typename Fn, typename R>
+struct cpu_job_object : cpu_job
+{
+    cpu_job_object(Fn& fn) : fn_(fn) {}
+
+    virtual void run() override { result_ = fn_(); }
+
+    R get()
+    {
+        if (exception_) std::rethrow_exception(exception_);
+        return std::forward<R>(*result_);
+    }
+
+    Fn& fn_;
+    boost::optional<R> result_;
+};
+
+template <typename Fn>
+struct cpu_job_object<Fn, void> : cpu_job
+{
+    cpu_job_object(Fn& fn) : fn_(fn) {}
+
+    virtual void run() override { fn_(); }
+
+    void get()
+    {
+        if (exception_) std::rethrow_exception(exception_);
+    }
+
+    Fn& fn_;
+};
+
+} // End of namespace detail
+
+/**
+ * A thread pool for compute-heavy jobs
+ *
+ * Fibers submitting jobs are parked without blocking their worker threads, and are resumed in
+ * their own strands when the jobs are done.
+ * The number of queued jobs is bounded, fibers submitting jobs into a full queue are parked until
+ * there is room.
+ */
+class cpu_pool
+{
+public:
+    /// cpu pool attributes
+    struct attributes
+    {
+        /// Number of threads in the pool, 0 means the number of hardware threads
+        size_t threads = 0;
+
+        /// Max number of jobs waiting to be picked up by pool threads
+        size_t queue_capacity = 1024;
+
+        /// constructor
+        constexpr attributes() {}
+    };
+
+    /// constructor
+    cpu_pool();
+
+    /// constructor
+    explicit cpu_pool(attributes attrs);
+
+    /// destructor, waits until all jobs are done
+    ~cpu_pool();
+
+    /**
+     * Runs function in the pool and returns its result, exception thrown by the function is
+     * propagated to the caller
+     * The calling fiber is parked until the function completes, the function runs in the calling
+     * thread if it's not called in a fiber.
+     */
+    template <typename Fn, typename... Args>
+    typename std::result_of<Fn(Args...)>::type run(Fn&& fn, Args&&... args)
+    {
+        typedef typename std::result_of<Fn(Args...)>::type result_type;
+        auto f = [&]() -> result_type {
+            return utility::invoke(std::forward<Fn>(fn), std::forward<Args>(args)...);
+        };
+        detail::cpu_job_object<decltype(f), result_type> job(f);
+        execute(&job);
+        return job.get();
+    }
+
+    /**
+     * Returns number of threads in the pool
+     */
+    size_t size() const;
+
+    /**
+     * Returns number of jobs waiting to be picked up by pool threads
+     */
+    size_t queued() const;
+
+    /**
+     * Returns the default cpu pool
+     */
+    static cpu_pool& get_default();
+
+private:
+    cpu_pool(const cpu_pool&) = delete;
+
+    void operator=(const cpu_pool&) = delete;
+
+    void execute(detail::cpu_job* job);
+
+    std::unique_ptr<cpu_pool_impl> impl_;
+};
+
+/**
+ * Runs function in the default cpu pool and returns its result
+ */
+template <typename Fn, typename... Args>
+typename std::result_of<Fn(Args...)>::type run_on_cpu_pool(Fn&& fn, Args&&... args)
+{
+    return cpu_pool::get_default().run(std::forward<Fn>(fn), std::forward<Args>(args)...);
+}
+
+} // End of namespace fibers
+
+using fibers::cpu_pool;
+using fibers::run_on_cpu_pool;
+
+} // End of namespace fibio
+
+#endif
@@ -23,6 +23,9 @@ typedef boost::asio::basic_waitable_timer<std::chrono::steady_clock> timer_t;
 struct scheduler_object;
 struct fiber_object;
 typedef std::shared_ptr<fiber_object> fiber_ptr_t;
+struct timer_entry;
+struct cancellation_callback;
+class continuation_launcher;
 
 } // End of namespace detail
 
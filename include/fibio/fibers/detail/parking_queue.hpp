@@ -0,0 +1,113 @@
+//
+//  parking_queue.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_detail_parking_queue_hpp
+#define fibio_fibers_detail_parking_queue_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <fibio/fibers/detail/fiber_base.hpp>
+#include <fibio/fibers/detail/spinlock.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/**
+ * class parking_queue
+ *
+ * Parks fibers of a synchronization primitive whose state lives in atomics, so the fast paths
+ * don't take any lock.
+ * A fiber announces itself in `waiting_` before re-checking the state, a waker changes the state
+ * before checking `waiting_`, so either the fiber sees the new state or the waker sees the fiber.
+ * Woken fibers are not handed anything, they re-check the state and may park again.
+ * Unparking doesn't yield and can be done from foreign threads.
+ */
+class parking_queue
+{
+public:
+    /// constructor
+    parking_queue() = default;
+
+    /**
+     * Parks the calling fiber unless `ready()` returns true, returns the result of `ready()`
+     * NOTE: Must be called in a fiber
+     */
+    template <typename Predicate>
+    bool park_unless(Predicate ready)
+    {
+        // Throws if not in a fiber
+        waiter w{get_current_fiber_ptr()};
+        std::unique_lock<spinlock> lock(mtx_);
+        waiting_.fetch_add(1, std::memory_order_seq_cst);
+        if (ready()) {
+            waiting_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (tail_)
+            tail_->next_ = &w;
+        else
+            head_ = &w;
+        tail_ = &w;
+        // The waker pops the waiter before resuming the fiber, and the resumption is posted to
+        // the strand of the fiber so it can only happen after the pause
+        fiber_base::ptr_t f(w.f_);
+        lock.unlock();
+        f->pause();
+        return false;
+    }
+
+    /**
+     * Returns true if there may be parked fibers
+     */
+    bool has_waiters() const noexcept { return waiting_.load(std::memory_order_seq_cst) != 0; }
+
+    /**
+     * Resumes up to `n` parked fibers
+     */
+    void unpark(std::size_t n = 1)
+    {
+        if (!has_waiters()) return;
+        std::lock_guard<spinlock> lock(mtx_);
+        while (n-- > 0 && head_) {
+            waiter* w = head_;
+            head_ = w->next_;
+            if (!head_) tail_ = nullptr;
+            waiting_.fetch_sub(1, std::memory_order_relaxed);
+            // The waiter may be gone as soon as the fiber is resumed
+            fiber_base::ptr_t f(std::move(w->f_));
+            f->resume();
+        }
+    }
+
+    /**
+     * Resumes all parked fibers
+     */
+    void unpark_all() { unpark(static_cast<std::size_t>(-1)); }
+
+private:
+    parking_queue(const parking_queue&) = delete;
+
+    void operator=(const parking_queue&) = delete;
+
+    // A parked fiber, lives on the stack of the fiber
+    struct waiter
+    {
+        fiber_base::ptr_t f_;
+        waiter* next_ = nullptr;
+    };
+
+    spinlock mtx_;
+    std::atomic<std::size_t> waiting_{0};
+    waiter* head_ = nullptr;
+    waiter* tail_ = nullptr;
+};
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
+
+#endif
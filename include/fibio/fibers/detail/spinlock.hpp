@@ -10,20 +10,71 @@
 #define fibio_fibers_detail_spinlock_hpp
 
 #include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
 
 namespace fibio {
 namespace fibers {
 namespace detail {
 
+/**
+ * Hints the processor that the caller is in a spin-wait loop
+ */
+inline void cpu_relax() noexcept
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#endif
+}
+
+/// Size of a cache line, used to pad hot data to avoid false sharing
+constexpr std::size_t cache_line_size = 64;
+
+/**
+ * A value on cache lines of its own
+ * Padded with a whole cache line on each side instead of aligned, `new` and containers don't
+ * honour extended alignments before C++17, so the value is kept apart from its neighbours wherever
+ * the storage lands.
+ */
+template <typename T>
+struct cache_line_padded
+{
+    template <typename... Args>
+    explicit cache_line_padded(Args&&... args)
+    : value_(std::forward<Args>(args)...)
+    {
+    }
+
+    char before_[cache_line_size];
+    T value_;
+    char after_[cache_line_size];
+};
+
 /**
  * class spinlock
  *
- * A spinlock meets C++11 BasicLockable concept
+ * A spinlock meets C++11 Lockable concept
+ * - test-and-test-and-set, waiters spin on a plain load so the cache line stays shared until the
+ *   lock is released
+ * - exponential backoff with CPU relax hints, yields the thread when the backoff is saturated
+ * - as small as the state, it's embedded in every mutex and fiber object, hot instances that need
+ *   a cache line of their own are wrapped in `cache_line_padded`
  */
 class spinlock
 {
 private:
     typedef enum { Locked, Unlocked } LockState;
+
+    static constexpr unsigned max_backoff = 64;
+
     std::atomic<LockState> state_;
 
 public:
@@ -33,11 +84,30 @@ public:
     /// Blocks until a lock can be obtained for the current execution agent.
     void lock() noexcept
     {
+        unsigned backoff = 1;
         while (state_.exchange(Locked, std::memory_order_acquire) == Locked) {
-            /* busy-wait */
+            // Wait until the lock looks free before trying again
+            do {
+                if (backoff < max_backoff) {
+                    for (unsigned i = 0; i < backoff; i++) {
+                        cpu_relax();
+                    }
+                    backoff <<= 1;
+                } else {
+                    // The holder may have been preempted, let it run
+                    std::this_thread::yield();
+                }
+            } while (state_.load(std::memory_order_relaxed) == Locked);
         }
     }
 
+    /// Tries to obtain the lock without blocking
+    bool try_lock() noexcept
+    {
+        return state_.load(std::memory_order_relaxed) == Unlocked
+               && state_.exchange(Locked, std::memory_order_acquire) == Unlocked;
+    }
+
     /// Releases the lock held by the execution agent.
     void unlock() noexcept { state_.store(Unlocked, std::memory_order_release); }
 };
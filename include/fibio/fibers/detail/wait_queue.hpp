@@ -0,0 +1,157 @@
+//
+//  wait_queue.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_detail_wait_queue_hpp
+#define fibio_fibers_detail_wait_queue_hpp
+
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <fibio/fibers/detail/forward.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/**
+ * A waiting foreign thread, lives on the stack of the thread
+ */
+struct thread_waiter
+{
+    /// Blocks the thread until woken up
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        while (!woken_) cv_.wait(lock);
+    }
+
+    /// Blocks the thread until woken up or the deadline, returns true if woken up
+    bool wait_until(time_point_t deadline)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        while (!woken_) {
+            if (cv_.wait_until(lock, deadline) == std::cv_status::timeout) return woken_;
+        }
+        return true;
+    }
+
+    /// Wakes up the thread, the waiter may be gone as soon as this returns
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        woken_ = true;
+        cv_.notify_one();
+    }
+
+    std::thread::id id_ = std::this_thread::get_id();
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool woken_ = false;
+};
+
+/**
+ * A waiting fiber or foreign thread, lives on the stack of the waiter
+ */
+struct wait_node
+{
+    /// The waiting fiber
+    fiber_ptr_t f_;
+
+    /// The waiting thread if the waiter is not a fiber
+    thread_waiter* tw_ = nullptr;
+
+    /// Timer attached to the wait, if any
+    timer_t* t_ = nullptr;
+
+    wait_node* prev_ = nullptr;
+    wait_node* next_ = nullptr;
+    bool linked_ = false;
+};
+
+/**
+ * class wait_queue
+ *
+ * Intrusive FIFO of waiting fibers, all operations are O(1) and never allocate
+ * NOTE: Not thread-safe, must be protected by the owner
+ */
+class wait_queue
+{
+public:
+    /// constructor
+    wait_queue() = default;
+
+    /// Returns true if nobody is waiting
+    bool empty() const noexcept { return !head_; }
+
+    /// Returns the first waiting node
+    wait_node* front() const noexcept { return head_; }
+
+    /// Appends a node to the end of the queue
+    void push_back(wait_node* n) noexcept
+    {
+        assert(!n->linked_);
+        n->prev_ = tail_;
+        n->next_ = nullptr;
+        if (tail_)
+            tail_->next_ = n;
+        else
+            head_ = n;
+        tail_ = n;
+        n->linked_ = true;
+    }
+
+    /// Inserts a node at the beginning of the queue
+    void push_front(wait_node* n) noexcept
+    {
+        assert(!n->linked_);
+        n->prev_ = nullptr;
+        n->next_ = head_;
+        if (head_)
+            head_->prev_ = n;
+        else
+            tail_ = n;
+        head_ = n;
+        n->linked_ = true;
+    }
+
+    /// Removes and returns the first node, returns nullptr if the queue is empty
+    wait_node* pop_front() noexcept
+    {
+        wait_node* n = head_;
+        if (n) erase(n);
+        return n;
+    }
+
+    /// Removes a node from the queue, does nothing if the node is not in the queue
+    void erase(wait_node* n) noexcept
+    {
+        if (!n->linked_) return;
+        if (n->prev_)
+            n->prev_->next_ = n->next_;
+        else
+            head_ = n->next_;
+        if (n->next_)
+            n->next_->prev_ = n->prev_;
+        else
+            tail_ = n->prev_;
+        n->prev_ = n->next_ = nullptr;
+        n->linked_ = false;
+    }
+
+private:
+    wait_queue(const wait_queue&) = delete;
+
+    void operator=(const wait_queue&) = delete;
+
+    wait_node* head_ = nullptr;
+    wait_node* tail_ = nullptr;
+};
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
+
+#endif
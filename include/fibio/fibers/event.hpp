@@ -0,0 +1,102 @@
+//
+//  event.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_event_hpp
+#define fibio_fibers_event_hpp
+
+#include <atomic>
+#include <fibio/fibers/detail/parking_queue.hpp>
+
+namespace fibio {
+namespace fibers {
+
+/**
+ * class event
+ *
+ * A manual-reset or auto-reset event
+ * - manual-reset: once set, all waiting and future waiting fibers pass until it's reset
+ * - auto-reset: each `set` lets exactly one fiber pass, the event is reset by the fiber passing
+ *   it, setting an already set event has no effect
+ * Checking and setting the event take no lock if nobody is waiting, `set`, `reset` and
+ * `try_wait` can be called from foreign threads, `wait` must be called in fibers.
+ */
+class event
+{
+public:
+    /// Reset mode of the event
+    enum class reset_mode
+    {
+        manual,
+        automatic,
+    };
+
+    /**
+     * Constructs an event
+     */
+    explicit event(reset_mode mode = reset_mode::manual, bool signaled = false)
+    : auto_reset_(mode == reset_mode::automatic), signaled_(signaled)
+    {
+    }
+
+    /**
+     * Sets the event and wakes up waiting fibers
+     */
+    void set()
+    {
+        signaled_.store(true, std::memory_order_seq_cst);
+        if (auto_reset_)
+            waiters_.unpark();
+        else
+            waiters_.unpark_all();
+    }
+
+    /**
+     * Resets the event
+     */
+    void reset() noexcept { signaled_.store(false, std::memory_order_seq_cst); }
+
+    /**
+     * Returns true if the event is set, an auto-reset event is reset by a successful call
+     */
+    bool try_wait() noexcept
+    {
+        if (!auto_reset_) return signaled_.load(std::memory_order_seq_cst);
+        bool expected = true;
+        return signaled_.compare_exchange_strong(expected, false, std::memory_order_seq_cst);
+    }
+
+    /**
+     * Blocks until the event is set
+     */
+    void wait()
+    {
+        while (!try_wait()) {
+            if (waiters_.park_unless([this]() { return try_wait(); })) return;
+        }
+    }
+
+    /**
+     * Returns true if the event is set
+     * NOTE: The return value is just a snapshot
+     */
+    bool is_set() const noexcept { return signaled_.load(std::memory_order_relaxed); }
+
+private:
+    event(const event&) = delete;
+
+    void operator=(const event&) = delete;
+
+    const bool auto_reset_;
+    std::atomic<bool> signaled_;
+    detail::parking_queue waiters_;
+};
+
+} // End of namespace fibers
+
+using fibers::event;
+
+} // End of namespace fibio
+
+#endif
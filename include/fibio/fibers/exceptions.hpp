@@ -115,6 +115,16 @@ public:
     }
 };
 
+class operation_cancelled : public fiber_exception
+{
+public:
+    operation_cancelled()
+    : fiber_exception(boost::system::errc::operation_canceled,
+                      "fibio::fibers::operation_cancelled")
+    {
+    }
+};
+
 enum class future_errc
 {
     broken_promise = 1,
@@ -218,6 +228,7 @@ using fibers::lock_error;
 using fibers::fiber_resource_error;
 using fibers::invalid_argument;
 using fibers::fiber_interrupted;
+using fibers::operation_cancelled;
 using fibers::future_errc;
 using fibers::future_category;
 using fibers::future_error;
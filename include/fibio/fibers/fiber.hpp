@@ -14,6 +14,7 @@
 #include <chrono>
 #include <utility>
 #include <type_traits>
+#include <vector>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/strand.hpp>
 #include <fibio/fibers/detail/forward.hpp>
@@ -26,9 +27,58 @@ namespace fibers {
 class scheduler
 {
 public:
+    /// scheduler attributes
+    struct attributes
+    {
+        /**
+         * NUMA-aware worker placement
+         * - worker threads are grouped by NUMA node and pinned to the CPUs of their node
+         * - each node runs its own io_service, fibers are spread across nodes that have worker
+         *   threads and stay on their node once created
+         * - an idle worker that spins or busy-polls runs ready fibers of other nodes before it
+         *   parks itself, fibers of its own node always go first
+         * - fiber stacks are allocated from the memory of the node running the fiber
+         * Has no effect on machines with only one NUMA node.
+         */
+        bool numa_aware = false;
+
+        /**
+         * Explicit NUMA layout, CPUs of each node, used instead of the detected topology if
+         * `numa_aware` is set. A node with no CPUs has unpinned worker threads.
+         */
+        std::vector<std::vector<unsigned>> numa_nodes;
+
+        /**
+         * Idle spin budget of worker threads
+         * An idle worker keeps polling for ready handlers up to this long before it parks itself
+         * in the io_service, trades CPU for lower wake-up latency, 0 disables spinning.
+         */
+        std::chrono::microseconds spin_budget{0};
+
+        /**
+         * Busy-poll mode
+         * Worker threads never block, they keep polling the reactor and ready handlers, each
+         * worker occupies a CPU all the time. Overrides `spin_budget`.
+         */
+        bool busy_poll = false;
+
+        /**
+         * CPUs to pin worker threads to, worker threads are assigned to these CPUs one by one,
+         * takes precedence over NUMA placement, empty means no explicit pinning.
+         * Usually used with `busy_poll` on isolated CPUs.
+         */
+        std::vector<unsigned> cpus;
+
+        /// constructor
+        attributes() {}
+    };
+
     /// constructor
     scheduler();
 
+    /// constructor, creates a scheduler with specific attributes
+    explicit scheduler(attributes attrs);
+
     /**
      * returns the io_service associated with the scheduler
      */
@@ -65,6 +115,7 @@ private:
     std::shared_ptr<detail::scheduler_object> impl_;
 
     friend class fiber;
+    friend class detail::continuation_launcher;
 };
 
 /// struct fiber
@@ -221,6 +272,8 @@ public:
 
     /**
      * waits for a fiber to finish its execution
+     * Called outside of a fiber, blocks the calling thread, which must not be a worker thread
+     * of the scheduler running the fiber.
      */
     void join(bool propagate_exception = false);
 
@@ -0,0 +1,173 @@
+//
+//  allocator.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_future_allocator_hpp
+#define fibio_fibers_future_allocator_hpp
+
+#include <cstddef>
+#include <fibio/fibers/detail/spinlock.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/// Allocates a block from the pool of the calling thread
+void* pool_allocate(std::size_t size);
+
+/// Returns a block to the pool of the calling thread
+void pool_deallocate(void* p, std::size_t size) noexcept;
+
+/// Allocates a block from the global heap aligned beyond `alignof(std::max_align_t)`
+void* aligned_allocate(std::size_t size, std::size_t align);
+
+/// Frees a block allocated by `aligned_allocate`
+void aligned_deallocate(void* p) noexcept;
+
+} // End of namespace detail
+
+/**
+ * class pooled_allocator
+ *
+ * Stateless allocator recycling small blocks in per-thread free lists, so allocating and freeing
+ * short-lived objects of the same sizes, like shared states of futures, doesn't hit the global
+ * heap. A block can be freed in any thread, large blocks and over-aligned types are served by the
+ * global heap.
+ *
+ * The default allocator of promises, packaged tasks and continuations.
+ */
+template <typename T>
+struct pooled_allocator
+{
+    typedef T value_type;
+
+    pooled_allocator() noexcept = default;
+
+    template <typename U>
+    pooled_allocator(const pooled_allocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (over_aligned) {
+            return static_cast<T*>(detail::aligned_allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(detail::pool_allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (over_aligned) {
+            detail::aligned_deallocate(p);
+        } else {
+            detail::pool_deallocate(p, n * sizeof(T));
+        }
+    }
+
+private:
+    // Pooled blocks are only aligned for fundamental types
+    static constexpr bool over_aligned = alignof(T) > alignof(std::max_align_t);
+};
+
+template <typename T, typename U>
+bool operator==(const pooled_allocator<T>&, const pooled_allocator<U>&) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const pooled_allocator<T>&, const pooled_allocator<U>&) noexcept
+{
+    return false;
+}
+
+/**
+ * class arena
+ *
+ * Bump allocator for objects with the same lifetime, e.g. all futures created for a request.
+ * Allocation takes a spinlock and a pointer increment, deallocation does nothing, and all memory
+ * is released at once when the arena is destroyed.
+ *
+ * NOTE: The arena must outlive everything allocated from it, including shared states still
+ * referenced by futures.
+ */
+class arena
+{
+public:
+    /// constructor, memory is taken from the global heap in chunks of `chunk_size` bytes
+    explicit arena(std::size_t chunk_size = 4096);
+
+    /// destructor, releases all memory
+    ~arena();
+
+    /**
+     * Allocates `size` bytes aligned to `align`
+     */
+    void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t));
+
+private:
+    arena(const arena&) = delete;
+
+    void operator=(const arena&) = delete;
+
+    struct chunk
+    {
+        chunk* next_;
+    };
+
+    detail::spinlock mtx_;
+    std::size_t chunk_size_;
+    chunk* chunks_ = nullptr;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+};
+
+/**
+ * Allocator carving objects from an arena
+ */
+template <typename T>
+struct arena_allocator
+{
+    typedef T value_type;
+
+    arena_allocator(arena& a) noexcept : arena_(&a) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) noexcept
+    : arena_(other.arena_)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) noexcept {}
+
+    arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>& l, const arena_allocator<U>& r) noexcept
+{
+    return l.arena_ == r.arena_;
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>& l, const arena_allocator<U>& r) noexcept
+{
+    return l.arena_ != r.arena_;
+}
+
+} // End of namespace fibers
+
+using fibers::pooled_allocator;
+using fibers::arena;
+using fibers::arena_allocator;
+
+} // End of namespace fibio
+
+#endif
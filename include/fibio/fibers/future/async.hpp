@@ -10,12 +10,19 @@
 #define fibio_fibers_future_async_hpp
 
 #include <algorithm>
+#include <exception>
 #include <memory>
 #include <tuple>
+#include <type_traits>
+#include <boost/optional.hpp>
 #include <fibio/utility.hpp>
 #include <fibio/fibers/fiber_group.hpp>
+#include <fibio/fibers/detail/fiber_base.hpp>
+#include <fibio/fibers/detail/wait_queue.hpp>
+#include <fibio/fibers/future/allocator.hpp>
 #include <fibio/fibers/future/future.hpp>
 #include <fibio/fibers/future/packaged_task.hpp>
+#include <fibio/fibers/future/promise.hpp>
 #include <fibio/concurrent/concurrent_queue.hpp>
 
 namespace fibio {
@@ -57,7 +64,10 @@ struct task_data
 /**
  * Run function asynchronously, returns a future, which will be ready when function completes
  */
-template <typename Fn, typename... Args>
+template <typename Fn,
+          typename... Args,
+          typename = typename std::enable_if<
+              !std::is_same<typename std::decay<Fn>::type, scheduler>::value>::type>
 typename detail::task_data<Fn, Args...>::future_type async(Fn&& fn, Args&&... args)
 {
     typedef detail::task_data<Fn, Args...> data_type;
@@ -68,6 +78,24 @@ typename detail::task_data<Fn, Args...>::future_type async(Fn&& fn, Args&&... ar
     return std::move(ret);
 }
 
+/**
+ * Run function asynchronously in a specific scheduler, returns a future, which will be ready when
+ * function completes
+ * The future can be waited in any scheduler or in a foreign thread
+ */
+template <typename Fn, typename... Args>
+typename detail::task_data<Fn, Args...>::future_type async(scheduler& sched,
+                                                           Fn&& fn,
+                                                           Args&&... args)
+{
+    typedef detail::task_data<Fn, Args...> data_type;
+    typename data_type::task_type task(
+        data_type(std::forward<Fn>(fn), std::forward<Args>(args)...));
+    typename data_type::future_type ret(task.get_future());
+    fiber(sched, std::move(task)).detach();
+    return std::move(ret);
+}
+
 /**
  * Run function asynchronously in a fiber pool, returns a future
  */
@@ -196,61 +224,244 @@ async_function<Fn> make_async(Fn&& fn)
     return async_function<Fn>(std::forward<Fn>(fn));
 }
 
+struct foreign_thread_pool_impl;
+
+namespace detail {
+
+/**
+ * A job queued in a foreign thread pool
+ */
+struct foreign_job
+{
+    virtual ~foreign_job() {}
+
+    /// Runs in a pool thread, the job may be gone as soon as this returns
+    virtual void execute() = 0;
+
+    foreign_job* next_ = nullptr;
+};
+
 /**
- *  Foreign thread pool
+ * Job of a blocking call
+ * The job lives on the stack of the caller, which is parked until the job is done, so submission
+ * doesn't allocate
  */
-struct foreign_thread_pool
+struct foreign_call_base : foreign_job
 {
-    foreign_thread_pool(size_t pool_size = 1)
+    void finish()
     {
-        for (size_t i = 0; i < pool_size; i++) {
-            threads_.emplace_back([this]() {
-                for (auto& i : queue_) i();
-            });
+        if (thread_waiter* tw = tw_) {
+            tw->wake();
+            return;
         }
+        // The job may be gone as soon as the fiber is resumed, take the fiber out first
+        fiber_base::ptr_t f(std::move(fiber_));
+        f->resume();
     }
 
-    ~foreign_thread_pool()
+    fiber_base::ptr_t fiber_;
+    thread_waiter* tw_ = nullptr;
+    std::exception_ptr exception_;
+};
+
+template <typename Fn, typename R>
+struct foreign_call : foreign_call_base
+{
+    foreign_call(Fn& fn) : fn_(fn) {}
+
+    virtual void execute() override
     {
-        queue_.close();
-        for (auto& t : threads_) {
-            t.join();
+        try {
+            result_ = fn_();
+        } catch (...) {
+            exception_ = std::current_exception();
+        }
+        finish();
+    }
+
+    R get()
+    {
+        if (exception_) std::rethrow_exception(exception_);
+        return std::forward<R>(*result_);
+    }
+
+    Fn& fn_;
+    boost::optional<R> result_;
+};
+
+template <typename Fn>
+struct foreign_call<Fn, void> : foreign_call_base
+{
+    foreign_call(Fn& fn) : fn_(fn) {}
+
+    virtual void execute() override
+    {
+        try {
+            fn_();
+        } catch (...) {
+            exception_ = std::current_exception();
+        }
+        finish();
+    }
+
+    void get()
+    {
+        if (exception_) std::rethrow_exception(exception_);
+    }
+
+    Fn& fn_;
+};
+
+/**
+ * Job of an asynchronous call, the job and the promise are taken from the pooled allocator and
+ * the job frees itself once done
+ */
+template <typename R, typename Fn, typename... Args>
+class foreign_task : public foreign_job
+{
+    typedef pooled_allocator<foreign_task> allocator_t;
+    typedef std::tuple<typename std::decay<Fn>::type, typename std::decay<Args>::type...>
+        data_type;
+
+public:
+    static foreign_task* create(Fn&& fn, Args&&... args)
+    {
+        allocator_t a;
+        foreign_task* p = a.allocate(1);
+        try {
+            ::new (p) foreign_task(std::forward<Fn>(fn), std::forward<Args>(args)...);
+        } catch (...) {
+            a.deallocate(p, 1);
+            throw;
+        }
+        return p;
+    }
+
+    /// Frees a job which has not been executed
+    void destroy()
+    {
+        allocator_t a;
+        std::allocator_traits<allocator_t>::destroy(a, this);
+        a.deallocate(this, 1);
+    }
+
+    future<R> get_future() { return promise_.get_future(); }
+
+    virtual void execute() override
+    {
+        try {
+            run(std::is_void<R>());
+        } catch (...) {
+            promise_.set_exception(std::current_exception());
         }
+        destroy();
+    }
+
+private:
+    foreign_task(Fn&& fn, Args&&... args)
+    : data_(std::forward<Fn>(fn), std::forward<Args>(args)...)
+    {
+    }
+
+    template <std::size_t... Indices>
+    R invoke(utility::tuple_indices<Indices...>)
+    {
+        return utility::invoke(std::move(std::get<0>(data_)),
+                               std::move(std::get<Indices>(data_))...);
     }
 
+    R invoke()
+    {
+        typedef typename utility::make_tuple_indices<std::tuple_size<data_type>::value, 1>::type
+            index_type;
+        return invoke(index_type());
+    }
+
+    void run(std::true_type)
+    {
+        invoke();
+        promise_.set_value();
+    }
+
+    void run(std::false_type) { promise_.set_value(invoke()); }
+
+    data_type data_;
+    promise<R> promise_;
+};
+
+} // End of namespace detail
+
+/**
+ * Foreign thread pool, runs blocking functions out of the worker threads of schedulers
+ *
+ * Each pool thread has a queue of its own, jobs are spread across the queues and idle threads
+ * steal jobs from the others.
+ * The number of queued jobs is bounded, fibers submitting jobs into a full pool are parked until
+ * there is room, foreign threads are blocked. Jobs submitted by pool threads are not bounded, so
+ * a job can submit other jobs without a deadlock.
+ */
+class foreign_thread_pool
+{
+public:
+    /// constructor
+    explicit foreign_thread_pool(size_t pool_size = 1, size_t queue_capacity = 1024);
+
+    /// destructor, waits until all jobs are done
+    ~foreign_thread_pool();
+
+    /**
+     * Runs function in the pool, returns a future of its result
+     */
     template <typename Fn, typename... Args>
     auto async_call(Fn&& fn, Args&&... args)
         -> future<typename detail::task_data<Fn, Args...>::result_type>
     {
-        typedef detail::task_data<Fn, Args...> task_data_type;
-        typedef typename task_data_type::result_type result_type;
-        std::shared_ptr<packaged_task<result_type()>> task(new packaged_task<result_type()>(
-            task_data_type(std::forward<Fn>(fn), std::forward<Args>(args)...)));
+        typedef typename detail::task_data<Fn, Args...>::result_type result_type;
+        typedef detail::foreign_task<result_type, Fn, Args...> task_type;
+        task_type* task = task_type::create(std::forward<Fn>(fn), std::forward<Args>(args)...);
         future<result_type> ret = task->get_future();
-        struct thr_task
-        {
-            void operator()() { (*pt_)(); }
-
-            std::shared_ptr<packaged_task<result_type()>> pt_;
-        };
-        queue_.push(thr_task{task});
+        try {
+            submit(task);
+        } catch (...) {
+            task->destroy();
+            throw;
+        }
         return ret;
     }
 
+    /**
+     * Runs function in the pool and returns its result, exception thrown by the function is
+     * propagated to the caller
+     * The calling fiber is parked until the function completes, the function runs in the calling
+     * thread if it's called in a thread of the pool.
+     */
     template <typename Fn, typename... Args>
     auto operator()(Fn&& fn, Args&&... args) -> typename detail::task_data<Fn, Args...>::result_type
     {
-        return async_call(std::forward<Fn>(fn), std::forward<Args>(args)...).get();
+        typedef typename detail::task_data<Fn, Args...>::result_type result_type;
+        auto f = [&]() -> result_type {
+            return utility::invoke(std::forward<Fn>(fn), std::forward<Args>(args)...);
+        };
+        detail::foreign_call<decltype(f), result_type> job(f);
+        call(&job);
+        return job.get();
     }
 
+    /**
+     * Returns number of threads in the pool
+     */
+    size_t size() const;
+
 private:
-    typedef std::function<void()> task_type;
-    typedef concurrent::basic_concurrent_queue<task_type,
-                                               std::unique_lock<std::mutex>,
-                                               std::condition_variable> queue_type;
+    foreign_thread_pool(const foreign_thread_pool&) = delete;
+
+    void operator=(const foreign_thread_pool&) = delete;
+
+    void submit(detail::foreign_job* job);
+
+    void call(detail::foreign_call_base* job);
 
-    queue_type queue_;
-    std::vector<std::thread> threads_;
+    std::unique_ptr<foreign_thread_pool_impl> impl_;
 };
 
 } // End of namespace fibers
@@ -13,17 +13,19 @@
 #ifndef fibio_fibers_future_detail_shared_state_hpp
 #define fibio_fibers_future_detail_shared_state_hpp
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <boost/assert.hpp>
-#include <boost/atomic.hpp>
 #include <boost/config.hpp>
 #include <boost/exception_ptr.hpp>
 #include <boost/intrusive_ptr.hpp>
 #include <boost/move/move.hpp>
 #include <boost/optional.hpp>
-#include <boost/thread/lock_types.hpp>
 #include <boost/utility.hpp>
 
+#include <fibio/utility.hpp>
+#include <fibio/fibers/detail/forward.hpp>
 #include <fibio/fibers/future/future_status.hpp>
 #include <fibio/fibers/condition_variable.hpp>
 #include <fibio/fibers/exceptions.hpp>
@@ -36,610 +38,296 @@ typedef std::chrono::steady_clock clock_type;
 
 namespace detail {
 
-template <typename Lockable>
-struct relock_guard
+/**
+ * Something waiting for a shared state to become ready, linked into the state
+ */
+struct future_waiter
 {
-    inline relock_guard(Lockable& mtx) : mtx_(mtx) { mtx_.unlock(); }
+    virtual ~future_waiter() {}
 
-    inline ~relock_guard() { mtx_.lock(); }
+    /// Called once the state is ready, the waiter may be gone after this returns
+    virtual void notify() = 0;
 
-    Lockable& mtx_;
+    /// Called if the state is destroyed without becoming ready
+    virtual void discard() {}
+
+    future_waiter* next_ = nullptr;
 };
 
-template <typename R>
-class shared_state : public boost::noncopyable
+/**
+ * A callback waiting for a shared state, owned by the state until it's called
+ */
+template <typename Fn>
+struct external_waiter : future_waiter
 {
-private:
-    std::atomic<std::size_t> use_count_;
-    mutable mutex mtx_;
-    mutable condition_variable waiters_;
-    std::atomic<bool> ready_;
-    boost::optional<R> value_;
-    std::exception_ptr except_;
-    typedef std::function<void()> external_waiter;
-    std::vector<external_waiter> ext_waiters_;
-
-    void mark_ready_and_notify_()
-    {
-        ready_ = true;
-        waiters_.notify_all();
-        for (auto& w : ext_waiters_) {
-            relock_guard<mutex> g(mtx_);
-            w();
-        }
-    }
-
-    void owner_destroyed_()
-    {
-        // TODO: set broken_exception if future was not already done
-        //      notify all waiters
-        if (!ready_) set_exception_(utility::copy_exception(broken_promise()));
-    }
+    external_waiter(Fn&& fn) : fn_(std::forward<Fn>(fn)) {}
 
-    void set_value_(R const& value)
+    virtual void notify() override
     {
-        // TODO: store the value and make the future ready
-        //      notify all waiters
-        if (ready_) BOOST_THROW_EXCEPTION(promise_already_satisfied());
-        value_ = value;
-        mark_ready_and_notify_();
+        std::unique_ptr<external_waiter> guard(this);
+        fn_();
     }
 
-    void set_value_(R&& value)
-    {
-        // TODO: store the value and make the future ready
-        //      notify all waiters
-        if (ready_) BOOST_THROW_EXCEPTION(promise_already_satisfied());
-        value_ = std::move(value);
-        mark_ready_and_notify_();
-    }
-
-    void set_exception_(std::exception_ptr except)
-    {
-        // TODO: store the exception pointer p into the shared state and make the state ready
-        //      done = true, notify all waiters
-        if (ready_) BOOST_THROW_EXCEPTION(promise_already_satisfied());
-        except_ = except;
-        mark_ready_and_notify_();
-    }
+    virtual void discard() override { delete this; }
 
-    const R& get_(unique_lock<mutex>& lk)
-    {
-        // TODO: the get method waits until the future has a valid result and
-        //      (depending on which template is used) retrieves it
-        //      it effectively calls wait_() in order to wait for the result
-        //      if it satisfies the requirements of MoveAssignable, the value is moved,
-        //      otherwise it is copied
-        wait_(lk);
-        if (except_) std::rethrow_exception(except_);
-        return value_.get();
-    }
+    typename std::decay<Fn>::type fn_;
+};
 
-    void wait_(unique_lock<mutex>& lk) const
-    {
-        // TODO: blocks until the result becomes available
-        while (!ready_) waiters_.wait(lk);
-    }
+/**
+ * class shared_state_base
+ *
+ * Readiness and waiters of a shared state, without any lock.
+ *
+ * Everything lives in a single atomic word, the low bits are the READY flag and the CLAIMED flag,
+ * which is set by the producer before storing the result so a state can only be satisfied once,
+ * the rest is the head of an intrusive list of waiters.
+ * Becoming ready swaps the whole word and notifies the detached waiters, so a promise/future
+ * round-trip costs one atomic operation on each side, plus one to link the waiter if the
+ * consumer has to wait.
+ */
+class shared_state_base : public boost::noncopyable
+{
+public:
+    /// Blocks until the result becomes available
+    void wait() const;
 
+    /// Blocks until the result becomes available or timeout
     template <class Rep, class Period>
-    future_status wait_for_(unique_lock<mutex>& lk,
-                            std::chrono::duration<Rep, Period> const& timeout_duration) const
+    future_status wait_for(std::chrono::duration<Rep, Period> const& timeout_duration) const
     {
-        // TODO: blocks until the result becomes available or timeout
-        while (!ready_) {
-            cv_status st(waiters_.wait_for(lk, timeout_duration));
-            if (cv_status::timeout == st && !ready_) return future_status::timeout;
-        }
-        return future_status::ready;
+        return wait_rel(std::chrono::duration_cast<duration_t>(timeout_duration));
     }
 
-    future_status wait_until_(unique_lock<mutex>& lk,
-                              clock_type::time_point const& timeout_time) const
+    /// Blocks until the result becomes available or timeout
+    future_status wait_until(clock_type::time_point const& timeout_time) const
     {
-        // TODO: blocks until the result becomes available or timeout
-        while (!ready_) {
-            cv_status st(waiters_.wait_until(lk, timeout_time));
-            if (cv_status::timeout == st && !ready_) return future_status::timeout;
-        }
-        return future_status::ready;
+        return wait_for(timeout_time - clock_type::now());
     }
 
-protected:
-    virtual void deallocate_future() = 0;
-
-public:
-    typedef boost::intrusive_ptr<shared_state> ptr_t;
-
-    shared_state() : use_count_(0), mtx_(), ready_(false), value_(), except_() {}
-
-    virtual ~shared_state() {}
-
+    /// Calls `fn` once the state is ready, in the context making it ready, or right now if it's
+    /// already ready
     template <typename Fn>
     void add_external_waiter(Fn&& fn)
     {
-        unique_lock<mutex> lk(mtx_);
-        if (ready_) {
-            relock_guard<mutex> g(mtx_);
-            fn();
-        } else {
-            ext_waiters_.emplace_back(std::forward<Fn>(fn));
-        }
+        add_waiter(new external_waiter<Fn>(std::forward<Fn>(fn)));
     }
 
-    void owner_destroyed()
+    /// Notifies `w` once the state is ready, or right now if it's already ready
+    void add_waiter(future_waiter* w)
     {
-        // TODO: lock mutex
-        //      set broken_exception if future was not already done
-        //      done = true, notify all waiters
-        unique_lock<mutex> lk(mtx_);
-        owner_destroyed_();
+        if (!link(w)) w->notify();
     }
 
-    void set_value(R const& value)
-    {
-        // TODO: store the value into the shared state and make the state ready
-        //      the operation is atomic, i.e. it behaves as though they acquire a single mutex
-        //      associated with the promise object while updating the promise object
-        //      an exception is thrown if there is no shared state or the shared state already
-        //      stores a value or exception
-        unique_lock<mutex> lk(mtx_);
-        set_value_(value);
-    }
+    /// Returns true if the result is available
+    bool is_ready() const noexcept { return state_.load(std::memory_order_acquire) & READY; }
 
-    void set_value(R&& value)
-    {
-        // TODO: store the value into the shared state and make the state ready
-        //      rhe operation is atomic, i.e. it behaves as though they acquire a single mutex
-        //      associated with the promise object while updating the promise object
-        //      an exception is thrown if there is no shared state or the shared state already
-        //      stores a value or exception
-        unique_lock<mutex> lk(mtx_);
-        set_value_(std::move(value));
-    }
-
-    void set_exception(std::exception_ptr except)
-    {
-        // TODO: store the exception pointer p into the shared state and make the state ready
-        //      the operation is atomic, i.e. it behaves as though they acquire a single mutex
-        //      associated with the promise object while updating the promise object
-        //      an exception is thrown if there is no shared state or the shared state already
-        //      stores a value or exception
-        unique_lock<mutex> lk(mtx_);
-        set_exception_(except);
-    }
+    /// Makes the state not ready again, must not have waiters
+    void reset() { state_.store(0, std::memory_order_release); }
 
-    const R& get()
-    {
-        // TODO: the get method waits until the future has a valid result and
-        //      (depending on which template is used) retrieves it
-        //      it effectively calls wait() in order to wait for the result
-        //      the value stored in the shared state
-        //      if it satisfies the requirements of MoveAssignable, the value is moved,
-        //      otherwise it is copied
-        //      valid() == false after a call to this method.
-        //      detect the case when valid == false before the call and throw a
-        //      future_error with an error condition of future_errc::no_state
-        unique_lock<mutex> lk(mtx_);
-        return get_(lk);
-    }
-
-    void wait() const
-    {
-        // TODO: blocks until the result becomes available
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        wait_(lk);
-    }
+    friend inline void intrusive_ptr_add_ref(shared_state_base* p) noexcept { ++p->use_count_; }
 
-    template <class Rep, class Period>
-    future_status wait_for(std::chrono::duration<Rep, Period> const& timeout_duration) const
+    friend inline void intrusive_ptr_release(shared_state_base* p)
     {
-        // TODO: blocks until the result becomes available or timeout
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        return wait_for_(lk, timeout_duration);
+        if (0 == --p->use_count_) p->deallocate_future();
     }
 
-    future_status wait_until(clock_type::time_point const& timeout_time) const
-    {
-        // TODO: blocks until the result becomes available or timeout
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        return wait_until_(lk, timeout_time);
-    }
+protected:
+    shared_state_base() = default;
 
-    void reset() { ready_ = false; }
+    virtual ~shared_state_base();
 
-    friend inline void intrusive_ptr_add_ref(shared_state* p) noexcept { ++p->use_count_; }
+    virtual void deallocate_future() = 0;
 
-    friend inline void intrusive_ptr_release(shared_state* p)
+    /// Claims the state for storing the result, throws if it's already claimed
+    void claim()
     {
-        if (0 == --p->use_count_) p->deallocate_future();
+        if (!try_claim()) BOOST_THROW_EXCEPTION(promise_already_satisfied());
     }
-};
 
-template <typename R>
-class shared_state<R&> : public boost::noncopyable
-{
-private:
-    std::atomic<std::size_t> use_count_;
-    mutable mutex mtx_;
-    mutable condition_variable waiters_;
-    std::atomic<bool> ready_;
-    R* value_;
-    std::exception_ptr except_;
-    typedef std::function<void()> external_waiter;
-    std::vector<external_waiter> ext_waiters_;
-
-    void mark_ready_and_notify_()
+    /// Claims the state for storing the result, returns false if it's already claimed
+    bool try_claim() noexcept
     {
-        ready_ = true;
-        waiters_.notify_all();
-        for (auto& w : ext_waiters_) {
-            relock_guard<mutex> g(mtx_);
-            w();
-        }
+        return !(state_.fetch_or(CLAIMED, std::memory_order_acquire) & CLAIMED);
     }
 
-    void owner_destroyed_()
-    {
-        // TODO: set broken_exception if future was not already done
-        //      notify all waiters
-        if (!ready_) {
-            set_exception_(utility::copy_exception(broken_promise()));
-        }
-    }
+    /// Gives up the claim, after storing the result failed
+    void unclaim() noexcept { state_.fetch_and(~uintptr_t(CLAIMED), std::memory_order_relaxed); }
 
-    void set_value_(R& value)
-    {
-        // TODO: store the value and make the future ready
-        //      notify all waiters
-        if (ready_) BOOST_THROW_EXCEPTION(promise_already_satisfied());
-        value_ = &value;
-        mark_ready_and_notify_();
-    }
+    /// Publishes the stored result and notifies all waiters, must have claimed the state
+    void mark_ready();
 
+    /// Stores the exception and makes the state ready, must have claimed the state
     void set_exception_(std::exception_ptr except)
     {
-        // TODO: store the exception pointer p into the shared state and make the state ready
-        //      done = true, notify all waiters
-        if (ready_) BOOST_THROW_EXCEPTION(promise_already_satisfied());
         except_ = except;
-        mark_ready_and_notify_();
+        mark_ready();
     }
 
-    R& get_(unique_lock<mutex>& lk)
+    /// Rethrows the stored exception, if any
+    void rethrow_if_exception() const
     {
-        // TODO: the get method waits until the future has a valid result and
-        //      (depending on which template is used) retrieves it
-        //      it effectively calls wait_() in order to wait for the result
-        //      if it satisfies the requirements of MoveAssignable, the value is moved,
-        //      otherwise it is copied
-        wait_(lk);
         if (except_) std::rethrow_exception(except_);
-        return *value_;
     }
 
-    void wait_(unique_lock<mutex>& lk) const
+private:
+    enum : uintptr_t
     {
-        // TODO: blocks until the result becomes available
-        while (!ready_) waiters_.wait(lk);
-    }
+        READY = 1,
+        CLAIMED = 2,
+        FLAGS = READY | CLAIMED,
+    };
 
-    template <class Rep, class Period>
-    future_status wait_for_(unique_lock<mutex>& lk,
-                            std::chrono::duration<Rep, Period> const& timeout_duration) const
-    {
-        // TODO: blocks until the result becomes available or timeout
-        while (!ready_) {
-            cv_status st(waiters_.wait_for(lk, timeout_duration));
-            if (cv_status::timeout == st && !ready_) return future_status::timeout;
-        }
-        return future_status::ready;
-    }
+    // Links the waiter unless the state is ready, returns false if it's ready
+    bool link(future_waiter* w) const;
 
-    future_status wait_until_(unique_lock<mutex>& lk,
-                              clock_type::time_point const& timeout_time) const
-    {
-        // TODO: blocks until the result becomes available or timeout
-        while (!ready_) {
-            cv_status st(waiters_.wait_until(lk, timeout_time));
-            if (cv_status::timeout == st && !ready_) return future_status::timeout;
-        }
-        return future_status::ready;
-    }
+    future_status wait_rel(duration_t d) const;
 
-protected:
-    virtual void deallocate_future() = 0;
+    // Waits in a fiber until ready, the deadline if it's not max(), or the cancellation of the
+    // bound token
+    future_status wait_in_fiber(fiber_object* cf, time_point_t deadline) const;
+
+    std::atomic<std::size_t> use_count_{0};
+    mutable std::atomic<uintptr_t> state_{0};
+    std::exception_ptr except_;
+};
+
+template <typename R>
+class shared_state : public shared_state_base
+{
+private:
+    boost::optional<R> value_;
 
 public:
     typedef boost::intrusive_ptr<shared_state> ptr_t;
 
-    shared_state() : use_count_(0), mtx_(), ready_(false), value_(0), except_() {}
+    shared_state() = default;
 
     virtual ~shared_state() {}
 
-    template <typename Fn>
-    void add_external_waiter(Fn&& fn)
+    void owner_destroyed()
     {
-        unique_lock<mutex> lk(mtx_);
-        if (ready_) {
-            relock_guard<mutex> g(mtx_);
-            fn();
-        } else {
-            ext_waiters_.emplace_back(std::forward<Fn>(fn));
-        }
+        // Set broken_promise if the result has not been stored
+        if (try_claim()) set_exception_(utility::copy_exception(broken_promise()));
     }
 
-    void owner_destroyed()
+    void set_value(R const& value)
     {
-        // TODO: lock mutex
-        //      set broken_exception if future was not already done
-        //      done = true, notify all waiters
-        unique_lock<mutex> lk(mtx_);
-        owner_destroyed_();
+        claim();
+        try {
+            value_ = value;
+        } catch (...) {
+            unclaim();
+            throw;
+        }
+        mark_ready();
     }
 
-    void set_value(R& value)
+    void set_value(R&& value)
     {
-        // TODO: store the value into the shared state and make the state ready
-        //      the operation is atomic, i.e. it behaves as though they acquire a single mutex
-        //      associated with the promise object while updating the promise object
-        //      an exception is thrown if there is no shared state or the shared state already
-        //      stores a value or exception
-        unique_lock<mutex> lk(mtx_);
-        set_value_(value);
+        claim();
+        try {
+            value_ = std::move(value);
+        } catch (...) {
+            unclaim();
+            throw;
+        }
+        mark_ready();
     }
 
     void set_exception(std::exception_ptr except)
     {
-        // TODO: store the exception pointer p into the shared state and make the state ready
-        //      the operation is atomic, i.e. it behaves as though they acquire a single mutex
-        //      associated with the promise object while updating the promise object
-        //      an exception is thrown if there is no shared state or the shared state already
-        //      stores a value or exception
-        unique_lock<mutex> lk(mtx_);
+        claim();
         set_exception_(except);
     }
 
-    R& get()
-    {
-        // TODO: the get method waits until the future has a valid result and
-        //      (depending on which template is used) retrieves it
-        //      it effectively calls wait() in order to wait for the result
-        //      the value stored in the shared state
-        //      if it satisfies the requirements of MoveAssignable, the value is moved,
-        //      otherwise it is copied
-        //      valid() == false after a call to this method.
-        //      detect the case when valid == false before the call and throw a
-        //      future_error with an error condition of future_errc::no_state
-        unique_lock<mutex> lk(mtx_);
-        return get_(lk);
-    }
-
-    void wait() const
-    {
-        // TODO: blocks until the result becomes available
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        wait_(lk);
-    }
-
-    template <class Rep, class Period>
-    future_status wait_for(std::chrono::duration<Rep, Period> const& timeout_duration) const
-    {
-        // TODO: blocks until the result becomes available or timeout
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        return wait_for_(lk, timeout_duration);
-    }
-
-    future_status wait_until(clock_type::time_point const& timeout_time) const
+    const R& get()
     {
-        // TODO: blocks until the result becomes available or timeout
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        return wait_until_(lk, timeout_time);
+        wait();
+        rethrow_if_exception();
+        return value_.get();
     }
 
-    void reset() { ready_ = false; }
-
-    friend inline void intrusive_ptr_add_ref(shared_state* p) noexcept { ++p->use_count_; }
-
-    friend inline void intrusive_ptr_release(shared_state* p)
+    /// Moves the result out, for the only consumer of the state
+    R take()
     {
-        if (0 == --p->use_count_) p->deallocate_future();
+        wait();
+        rethrow_if_exception();
+        return std::move(value_.get());
     }
 };
 
-template <>
-class shared_state<void> : public boost::noncopyable
+template <typename R>
+class shared_state<R&> : public shared_state_base
 {
 private:
-    std::atomic<std::size_t> use_count_;
-    mutable mutex mtx_;
-    mutable condition_variable waiters_;
-    std::atomic<bool> ready_;
-    std::exception_ptr except_;
-    typedef std::function<void()> external_waiter;
-    std::vector<external_waiter> ext_waiters_;
+    R* value_ = nullptr;
 
-    void mark_ready_and_notify_()
-    {
-        ready_ = true;
-        waiters_.notify_all();
-        for (auto& w : ext_waiters_) {
-            relock_guard<mutex> g(mtx_);
-            w();
-        }
-    }
+public:
+    typedef boost::intrusive_ptr<shared_state> ptr_t;
 
-    void owner_destroyed_()
-    {
-        // TODO: set broken_exception if future was not already done
-        //      notify all waiters
-        if (!ready_) {
-            set_exception_(utility::copy_exception(broken_promise()));
-        }
-    }
+    shared_state() = default;
 
-    void set_value_()
-    {
-        // TODO: store the value and make the future ready
-        //      notify all waiters
-        if (ready_) BOOST_THROW_EXCEPTION(promise_already_satisfied());
-        mark_ready_and_notify_();
-    }
-
-    void set_exception_(std::exception_ptr except)
-    {
-        // TODO: store the exception pointer p into the shared state and make the state ready
-        //      done = true, notify all waiters
-        if (ready_) BOOST_THROW_EXCEPTION(promise_already_satisfied());
-        except_ = except;
-        mark_ready_and_notify_();
-    }
+    virtual ~shared_state() {}
 
-    void get_(unique_lock<mutex>& lk)
+    void owner_destroyed()
     {
-        // TODO: the get method waits until the future has a valid result and
-        //      (depending on which template is used) retrieves it
-        //      it effectively calls wait_() in order to wait for the result
-        //      if it satisfies the requirements of MoveAssignable, the value is moved,
-        //      otherwise it is copied
-        wait_(lk);
-        if (except_) std::rethrow_exception(except_);
+        // Set broken_promise if the result has not been stored
+        if (try_claim()) set_exception_(utility::copy_exception(broken_promise()));
     }
 
-    void wait_(unique_lock<mutex>& lk) const
+    void set_value(R& value)
     {
-        // TODO: blocks until the result becomes available
-        while (!ready_) waiters_.wait(lk);
+        claim();
+        value_ = &value;
+        mark_ready();
     }
 
-    template <class Rep, class Period>
-    future_status wait_for_(unique_lock<mutex>& lk,
-                            std::chrono::duration<Rep, Period> const& timeout_duration) const
+    void set_exception(std::exception_ptr except)
     {
-        // TODO: blocks until the result becomes available or timeout
-        while (!ready_) {
-            cv_status st(waiters_.wait_for(lk, timeout_duration));
-            if (cv_status::timeout == st && !ready_) return future_status::timeout;
-        }
-        return future_status::ready;
+        claim();
+        set_exception_(except);
     }
 
-    future_status wait_until_(unique_lock<mutex>& lk,
-                              clock_type::time_point const& timeout_time) const
+    R& get()
     {
-        // TODO: blocks until the result becomes available or timeout
-        while (!ready_) {
-            cv_status st(waiters_.wait_until(lk, timeout_time));
-            if (cv_status::timeout == st && !ready_) return future_status::timeout;
-        }
-        return future_status::ready;
+        wait();
+        rethrow_if_exception();
+        return *value_;
     }
+};
 
-protected:
-    virtual void deallocate_future() = 0;
-
+template <>
+class shared_state<void> : public shared_state_base
+{
 public:
     typedef boost::intrusive_ptr<shared_state> ptr_t;
 
-    shared_state() : use_count_(0), mtx_(), ready_(false), except_() {}
+    shared_state() = default;
 
     virtual ~shared_state() {}
 
-    template <typename Fn>
-    void add_external_waiter(Fn&& fn)
-    {
-        unique_lock<mutex> lk(mtx_);
-        if (ready_) {
-            relock_guard<mutex> g(mtx_);
-            fn();
-        } else {
-            ext_waiters_.emplace_back(std::forward<Fn>(fn));
-        }
-    }
-
     void owner_destroyed()
     {
-        // TODO: lock mutex
-        //      set broken_exception if future was not already done
-        //      done = true, notify all waiters
-        unique_lock<mutex> lk(mtx_);
-        owner_destroyed_();
+        // Set broken_promise if the result has not been stored
+        if (try_claim()) set_exception_(utility::copy_exception(broken_promise()));
     }
 
     void set_value()
     {
-        // TODO: store the value into the shared state and make the state ready
-        //      the operation is atomic, i.e. it behaves as though they acquire a single mutex
-        //      associated with the promise object while updating the promise object
-        //      an exception is thrown if there is no shared state or the shared state already
-        //      stores a value or exception
-        unique_lock<mutex> lk(mtx_);
-        set_value_();
+        claim();
+        mark_ready();
     }
 
     void set_exception(std::exception_ptr except)
     {
-        // TODO: store the exception pointer p into the shared state and make the state ready
-        //      the operation is atomic, i.e. it behaves as though they acquire a single mutex
-        //      associated with the promise object while updating the promise object
-        //      an exception is thrown if there is no shared state or the shared state already
-        //      stores a value or exception
-        unique_lock<mutex> lk(mtx_);
+        claim();
         set_exception_(except);
     }
 
     void get()
     {
-        // TODO: the get method waits until the future has a valid result and
-        //      (depending on which template is used) retrieves it
-        //      it effectively calls wait() in order to wait for the result
-        //      the value stored in the shared state
-        //      if it satisfies the requirements of MoveAssignable, the value is moved,
-        //      otherwise it is copied
-        //      valid() == false after a call to this method.
-        //      detect the case when valid == false before the call and throw a
-        //      future_error with an error condition of future_errc::no_state
-        unique_lock<mutex> lk(mtx_);
-        get_(lk);
-    }
-
-    void wait() const
-    {
-        // TODO: blocks until the result becomes available
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        wait_(lk);
-    }
-
-    template <class Rep, class Period>
-    future_status wait_for(std::chrono::duration<Rep, Period> const& timeout_duration) const
-    {
-        // TODO: blocks until the result becomes available or timeout
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        return wait_for_(lk, timeout_duration);
-    }
-
-    future_status wait_until(clock_type::time_point const& timeout_time) const
-    {
-        // TODO: blocks until the result becomes available or timeout
-        //      valid() == true after the call
-        unique_lock<mutex> lk(mtx_);
-        return wait_until_(lk, timeout_time);
-    }
-
-    void reset() { ready_ = false; }
-
-    friend inline void intrusive_ptr_add_ref(shared_state* p) noexcept { ++p->use_count_; }
-
-    friend inline void intrusive_ptr_release(shared_state* p)
-    {
-        if (0 == --p->use_count_) p->deallocate_future();
+        wait();
+        rethrow_if_exception();
     }
 };
 
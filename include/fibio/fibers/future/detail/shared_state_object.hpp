@@ -13,6 +13,7 @@
 #ifndef fibio_fibers_future_detail_shared_state_object_hpp
 #define fibio_fibers_future_detail_shared_state_object_hpp
 
+#include <memory>
 #include <boost/config.hpp>
 #include <fibio/fibers/future/detail/shared_state.hpp>
 
@@ -24,8 +25,8 @@ template <typename R, typename Allocator>
 class shared_state_object : public shared_state<R>
 {
 public:
-    typedef
-        typename Allocator::template rebind<shared_state_object<R, Allocator>>::other allocator_t;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<shared_state_object>
+        allocator_t;
 
     shared_state_object(allocator_t const& alloc) : shared_state<R>(), alloc_(alloc) {}
 
@@ -37,8 +38,10 @@ private:
 
     static void destroy_(allocator_t& alloc, shared_state_object* p)
     {
-        alloc.destroy(p);
-        alloc.deallocate(p, 1);
+        // The allocator lives in the object, keep a copy to free the memory
+        allocator_t a(alloc);
+        std::allocator_traits<allocator_t>::destroy(a, p);
+        std::allocator_traits<allocator_t>::deallocate(a, p, 1);
     }
 };
 
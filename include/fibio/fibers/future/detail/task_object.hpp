@@ -13,6 +13,7 @@
 #ifndef fibio_fibio_fibers_future_detail_task_object_hpp
 #define fibio_fibio_fibers_future_detail_task_object_hpp
 
+#include <memory>
 #include <boost/config.hpp>
 #include <boost/throw_exception.hpp>
 
@@ -28,7 +29,7 @@ class task_object : public task_base<R, Args...>
     typedef task_object<Fn, Allocator, R, Args...> this_type;
 
 public:
-    typedef typename Allocator::template rebind<this_type>::other allocator_t;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<this_type> allocator_t;
 
     task_object(Fn&& fn, const allocator_t& alloc)
     : task_base<R, Args...>(), fn_(std::forward<Fn>(fn)), alloc_(alloc)
@@ -53,8 +54,10 @@ private:
 
     static void destroy_(allocator_t& alloc, task_object* p)
     {
-        alloc.destroy(p);
-        alloc.deallocate(p, 1);
+        // The allocator lives in the object, keep a copy to free the memory
+        allocator_t a(alloc);
+        std::allocator_traits<allocator_t>::destroy(a, p);
+        std::allocator_traits<allocator_t>::deallocate(a, p, 1);
     }
 };
 
@@ -64,7 +67,7 @@ class task_object<Fn, Allocator, void, Args...> : public task_base<void, Args...
     typedef task_object<Fn, Allocator, void, Args...> this_type;
 
 public:
-    typedef typename Allocator::template rebind<this_type>::other allocator_t;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<this_type> allocator_t;
 
     task_object(Fn&& fn, const allocator_t& alloc)
     : task_base<void>(), fn_(std::forward<Fn>(fn)), alloc_(alloc)
@@ -90,8 +93,10 @@ private:
 
     static void destroy_(allocator_t& alloc, task_object* p)
     {
-        alloc.destroy(p);
-        alloc.deallocate(p, 1);
+        // The allocator lives in the object, keep a copy to free the memory
+        allocator_t a(alloc);
+        std::allocator_traits<allocator_t>::destroy(a, p);
+        std::allocator_traits<allocator_t>::deallocate(a, p, 1);
     }
 };
 
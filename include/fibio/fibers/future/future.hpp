@@ -66,6 +66,9 @@ struct async_any_waiter;
 template <typename... Futures>
 struct async_all_waiter;
 
+template <typename Future, typename Fn, typename R, typename Launcher>
+class continuation;
+
 } // End of namespace detail
 
 template <typename Iterator>
@@ -114,6 +117,8 @@ private:
     friend struct detail::async_any_waiter;
     template <typename... Futures>
     friend struct detail::async_all_waiter;
+    template <typename Future, typename Fn, typename Ret, typename Launcher>
+    friend class detail::continuation;
 
     template <typename Iterator>
     friend auto async_wait_for_any(Iterator begin, Iterator end) ->
@@ -191,7 +196,7 @@ public:
         }
         ptr_t tmp;
         tmp.swap(state_);
-        return tmp->get();
+        return tmp->take();
     }
 
     /// Blocks until the result becomes available
@@ -225,8 +230,15 @@ public:
         return state_->wait_until(timeout_time);
     }
 
+    /// Attaches a continuation called with this future once it's ready, returns the future of
+    /// its result, the future is no longer valid after the call
     template <typename F>
     future<typename std::result_of<F(future&)>::type> then(F&& func);
+
+    /// Attaches a continuation running as said by `policy`, either a `launch` policy or a
+    /// scheduler running it in a new fiber
+    template <typename Policy, typename F>
+    future<typename std::result_of<F(future&)>::type> then(Policy&& policy, F&& func);
 };
 
 template <typename R>
@@ -259,6 +271,8 @@ private:
     friend struct detail::async_any_waiter;
     template <typename... Futures>
     friend struct detail::async_all_waiter;
+    template <typename Future, typename Fn, typename Ret, typename Launcher>
+    friend class detail::continuation;
 
     template <typename Iterator>
     friend auto async_wait_for_any(Iterator begin, Iterator end) ->
@@ -370,8 +384,15 @@ public:
         return state_->wait_until(timeout_time);
     }
 
+    /// Attaches a continuation called with this future once it's ready, returns the future of
+    /// its result, the future is no longer valid after the call
     template <typename F>
     future<typename std::result_of<F(future&)>::type> then(F&& func);
+
+    /// Attaches a continuation running as said by `policy`, either a `launch` policy or a
+    /// scheduler running it in a new fiber
+    template <typename Policy, typename F>
+    future<typename std::result_of<F(future&)>::type> then(Policy&& policy, F&& func);
 };
 
 template <>
@@ -404,6 +425,8 @@ private:
     friend struct detail::async_any_waiter;
     template <typename... Futures>
     friend struct detail::async_all_waiter;
+    template <typename Future, typename Fn, typename Ret, typename Launcher>
+    friend class detail::continuation;
 
     template <typename Iterator>
     friend auto async_wait_for_any(Iterator begin, Iterator end) ->
@@ -515,8 +538,15 @@ public:
         return state_->wait_until(timeout_time);
     }
 
+    /// Attaches a continuation called with this future once it's ready, returns the future of
+    /// its result, the future is no longer valid after the call
     template <typename F>
     future<typename std::result_of<F(future&)>::type> then(F&& func);
+
+    /// Attaches a continuation running as said by `policy`, either a `launch` policy or a
+    /// scheduler running it in a new fiber
+    template <typename Policy, typename F>
+    future<typename std::result_of<F(future&)>::type> then(Policy&& policy, F&& func);
 };
 
 template <typename R>
@@ -550,6 +580,8 @@ private:
     friend struct detail::async_any_waiter;
     template <typename... Futures>
     friend struct detail::async_all_waiter;
+    template <typename Future, typename Fn, typename Ret, typename Launcher>
+    friend class detail::continuation;
 
     template <typename Iterator>
     friend auto async_wait_for_any(Iterator begin, Iterator end) ->
@@ -676,8 +708,15 @@ public:
         return state_->wait_until(timeout_time);
     }
 
+    /// Attaches a continuation called with this future once it's ready, returns the future of
+    /// its result
     template <typename F>
     future<typename std::result_of<F(shared_future&)>::type> then(F&& func);
+
+    /// Attaches a continuation running as said by `policy`, either a `launch` policy or a
+    /// scheduler running it in a new fiber
+    template <typename Policy, typename F>
+    future<typename std::result_of<F(shared_future&)>::type> then(Policy&& policy, F&& func);
 };
 
 template <typename R>
@@ -705,6 +744,8 @@ private:
     friend struct detail::async_any_waiter;
     template <typename... Futures>
     friend struct detail::async_all_waiter;
+    template <typename Future, typename Fn, typename Ret, typename Launcher>
+    friend class detail::continuation;
 
     template <typename Iterator>
     friend auto async_wait_for_any(Iterator begin, Iterator end) ->
@@ -831,8 +872,15 @@ public:
         return state_->wait_until(timeout_time);
     }
 
+    /// Attaches a continuation called with this future once it's ready, returns the future of
+    /// its result
     template <typename F>
     future<typename std::result_of<F(shared_future&)>::type> then(F&& func);
+
+    /// Attaches a continuation running as said by `policy`, either a `launch` policy or a
+    /// scheduler running it in a new fiber
+    template <typename Policy, typename F>
+    future<typename std::result_of<F(shared_future&)>::type> then(Policy&& policy, F&& func);
 };
 
 template <>
@@ -860,6 +908,8 @@ private:
     friend struct detail::async_any_waiter;
     template <typename... Futures>
     friend struct detail::async_all_waiter;
+    template <typename Future, typename Fn, typename Ret, typename Launcher>
+    friend class detail::continuation;
 
     template <typename Iterator>
     friend auto async_wait_for_any(Iterator begin, Iterator end) ->
@@ -989,8 +1039,15 @@ public:
         return state_->wait_until(timeout_time);
     }
 
+    /// Attaches a continuation called with this future once it's ready, returns the future of
+    /// its result
     template <typename F>
     future<typename std::result_of<F(shared_future&)>::type> then(F&& func);
+
+    /// Attaches a continuation running as said by `policy`, either a `launch` policy or a
+    /// scheduler running it in a new fiber
+    template <typename Policy, typename F>
+    future<typename std::result_of<F(shared_future&)>::type> then(Policy&& policy, F&& func);
 };
 
 template <typename R>
@@ -1094,25 +1151,21 @@ struct any_waiter<N, F, Futures...>
 template <typename... Futures>
 struct all_waiter;
 
+// Waiting for the futures one by one, nothing to clean up if the waiter leaves as soon as the
+// last one becomes ready
 template <typename F>
 struct all_waiter<F>
 {
-    static void setup(condition_variable& cv, std::atomic<size_t>& acquired, size_t count, F& f)
-    {
-        f.state_->add_external_waiter([&cv, &acquired, count]() {
-            if (++acquired == count) cv.notify_all();
-        });
-    }
+    static void wait(F& f) { f.wait(); }
 };
 
 template <typename F, typename... Futures>
 struct all_waiter<F, Futures...>
 {
-    static void
-    setup(condition_variable& cv, std::atomic<size_t>& acquired, size_t count, F& f, Futures&... fs)
+    static void wait(F& f, Futures&... fs)
     {
-        all_waiter<F>::setup(cv, acquired, count, f);
-        all_waiter<Futures...>::setup(cv, acquired, count, fs...);
+        f.wait();
+        all_waiter<Futures...>::wait(fs...);
     }
 };
 
@@ -1135,25 +1188,13 @@ std::size_t wait_for_any2(std::tuple<Futures&...>& futures, utility::tuple_indic
 template <typename... Futures, std::size_t... Indices>
 void wait_for_all2(std::tuple<Futures&...>& futures, utility::tuple_indices<Indices...>)
 {
-    mutex mtx;
-    condition_variable cv;
-    constexpr size_t count = sizeof...(Futures);
-    std::atomic<size_t> acquired(0);
-    detail::all_waiter<Futures...>::setup(cv, acquired, count, std::get<Indices>(futures)...);
-    unique_lock<mutex> lk(mtx);
-    cv.wait(lk, [&]() -> bool { return acquired == count; });
+    detail::all_waiter<Futures...>::wait(std::get<Indices>(futures)...);
 }
 
 template <typename... Futures, std::size_t... Indices>
 void wait_for_all2(std::tuple<Futures&...>&& futures, utility::tuple_indices<Indices...>)
 {
-    mutex mtx;
-    condition_variable cv;
-    constexpr size_t count = sizeof...(Futures);
-    std::atomic<size_t> acquired(0);
-    detail::all_waiter<Futures...>::setup(cv, acquired, count, std::get<Indices>(futures)...);
-    unique_lock<mutex> lk(mtx);
-    cv.wait(lk, [&]() -> bool { return acquired == count; });
+    detail::all_waiter<Futures...>::wait(std::get<Indices>(futures)...);
 }
 } // End of namespace detail
 
@@ -1203,13 +1244,7 @@ void wait_for_all(Futures&... futures)
 {
     static_assert(utility::and_<detail::is_future<Futures>::value...>::value,
                   "Only futures can be waited");
-    mutex mtx;
-    condition_variable cv;
-    constexpr size_t count = sizeof...(Futures);
-    std::atomic<size_t> acquired(0);
-    detail::all_waiter<Futures...>::setup(cv, acquired, count, futures...);
-    unique_lock<mutex> lk(mtx);
-    cv.wait(lk, [&]() -> bool { return acquired == count; });
+    detail::all_waiter<Futures...>::wait(futures...);
 }
 
 template <typename... Futures>
@@ -1236,19 +1271,9 @@ auto wait_for_all(Iterator begin, Iterator end) ->
 {
     static_assert(detail::is_future<typename std::iterator_traits<Iterator>::value_type>::value,
                   "Iterator must refer to future type");
-    mutex mtx;
-    condition_variable cv;
-    size_t count = 0;
-    std::atomic<size_t> acquired(0);
     for (Iterator i = begin; i != end; ++i) {
-        i->state_->add_external_waiter([&]() {
-            acquired++;
-            cv.notify_all();
-        });
-        count++;
+        i->wait();
     }
-    unique_lock<mutex> lk(mtx);
-    cv.wait(lk, [&]() -> bool { return acquired == count; });
 }
 
 } // End of namespace fibers
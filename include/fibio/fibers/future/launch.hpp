@@ -0,0 +1,85 @@
+//
+//  launch.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_future_launch_hpp
+#define fibio_fibers_future_launch_hpp
+
+#include <memory>
+#include <fibio/utility.hpp>
+#include <fibio/fibers/fiber.hpp>
+
+namespace fibio {
+namespace fibers {
+
+/**
+ * Where a continuation attached with `then` runs
+ */
+enum class launch
+{
+    /**
+     * runs in the context making the source ready, the default
+     */
+    sync,
+
+    /**
+     * runs in a new fiber sharing the strand of the fiber attaching it, so it never runs
+     * concurrently with that fiber
+     */
+    post,
+};
+
+namespace detail {
+
+/**
+ * Runs continuations right away
+ */
+struct inline_launcher
+{
+    template <typename Fn>
+    void operator()(Fn&& fn) const
+    {
+        fn();
+    }
+};
+
+/**
+ * Runs continuations as said by a launch policy, or in new fibers of a scheduler
+ */
+class continuation_launcher
+{
+public:
+    /// constructor, `launch::post` captures the strand of the current fiber, out of fibers the
+    /// continuation runs in a new fiber of the default scheduler
+    continuation_launcher(launch policy);
+
+    /// constructor, runs continuations in new fibers of the scheduler
+    continuation_launcher(scheduler& sched);
+
+    template <typename Fn>
+    void operator()(Fn&& fn) const
+    {
+        if (!sched_) {
+            fn();
+            return;
+        }
+        spawn(make_fiber_data(utility::decay_copy(std::forward<Fn>(fn))));
+    }
+
+private:
+    // Starts a detached fiber, on the captured strand if any
+    void spawn(fiber_data_base* entry) const;
+
+    std::shared_ptr<scheduler_object> sched_;
+    std::shared_ptr<boost::asio::strand> strand_;
+};
+
+} // End of namespace detail
+} // End of namespace fibers
+
+using fibers::launch;
+
+} // End of namespace fibio
+
+#endif
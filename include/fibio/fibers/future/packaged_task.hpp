@@ -24,6 +24,7 @@
 #include <boost/utility.hpp>
 
 #include <fibio/fibers/exceptions.hpp>
+#include <fibio/fibers/future/allocator.hpp>
 #include <fibio/fibers/future/detail/task_base.hpp>
 #include <fibio/fibers/future/detail/task_object.hpp>
 #include <fibio/fibers/future/future.hpp>
@@ -62,9 +63,8 @@ public:
                                                             packaged_task>::value>::type>
     explicit packaged_task(Fn&& fn)
     {
-        typedef detail::task_object<Fn, std::allocator<this_type>, R, Args...> object_t;
-        std::allocator<packaged_task<R(Args...)>> alloc;
-        typename object_t::allocator_t a(alloc);
+        typedef detail::task_object<Fn, pooled_allocator<this_type>, R, Args...> object_t;
+        typename object_t::allocator_t a;
         // placement new
         task_ = ptr_t(::new (a.allocate(1)) object_t(std::forward<Fn>(fn), a));
     }
@@ -72,7 +72,7 @@ public:
     template <typename Fn, typename Allocator>
     explicit packaged_task(std::allocator_arg_t, const Allocator& alloc, Fn&& fn)
     {
-        typedef detail::task_object<Fn, std::allocator<this_type>, R, Args...> object_t;
+        typedef detail::task_object<Fn, Allocator, R, Args...> object_t;
         typename object_t::allocator_t a(alloc);
         // placement new
         task_ = ptr_t(::new (a.allocate(1)) object_t(std::forward<Fn>(fn), a));
@@ -12,7 +12,10 @@
 #ifndef fibio_fibers_future_promise_hpp
 #define fibio_fibers_future_promise_hpp
 
+#include <iterator>
 #include <memory>
+#include <tuple>
+#include <vector>
 
 #include <boost/config.hpp>
 #include <boost/move/move.hpp>
@@ -22,9 +25,11 @@
 
 #include <fibio/fibers/exceptions.hpp>
 #include <fibio/fibers/fiber.hpp>
+#include <fibio/fibers/future/allocator.hpp>
 #include <fibio/fibers/future/detail/shared_state.hpp>
 #include <fibio/fibers/future/detail/shared_state_object.hpp>
 #include <fibio/fibers/future/future.hpp>
+#include <fibio/fibers/future/launch.hpp>
 
 namespace fibio {
 namespace fibers {
@@ -53,9 +58,8 @@ public:
         // TODO: constructs the promise with an empty shared state
         //       the shared state is allocated using alloc
         //       alloc must meet the requirements of Allocator
-        typedef detail::shared_state_object<R, std::allocator<promise<R>>> object_t;
-        std::allocator<promise<R>> alloc;
-        typename object_t::allocator_t a(alloc);
+        typedef detail::shared_state_object<R, pooled_allocator<promise>> object_t;
+        typename object_t::allocator_t a;
         future_ = ptr_t(
             // placement new
             ::new (a.allocate(1)) object_t(a));
@@ -206,9 +210,8 @@ public:
         // TODO: constructs the promise with an empty shared state
         //       the shared state is allocated using alloc
         //       alloc must meet the requirements of Allocator
-        typedef detail::shared_state_object<R&, std::allocator<promise<R&>>> object_t;
-        std::allocator<promise<R>> alloc;
-        typename object_t::allocator_t a(alloc);
+        typedef detail::shared_state_object<R&, pooled_allocator<promise>> object_t;
+        typename object_t::allocator_t a;
         future_ = ptr_t(
             // placement new
             ::new (a.allocate(1)) object_t(a));
@@ -333,9 +336,8 @@ public:
         // TODO: constructs the promise with an empty shared state
         //       the shared state is allocated using alloc
         //       alloc must meet the requirements of Allocator
-        typedef detail::shared_state_object<void, std::allocator<promise<void>>> object_t;
-        std::allocator<promise<void>> alloc;
-        object_t::allocator_t a(alloc);
+        typedef detail::shared_state_object<void, pooled_allocator<promise>> object_t;
+        object_t::allocator_t a;
         future_ = ptr_t(
             // placement new
             ::new (a.allocate(1)) object_t(a));
@@ -464,48 +466,104 @@ inline future<void> make_ready_future()
 
 namespace detail {
 
-// HACK: C++ forbids variable with `void` type as it is always incomplete
-template <typename R, typename F>
-auto set_promise_value(promise<typename std::result_of<F(future<R>&)>::type>& p,
-                       F&& fn,
-                       future<R>& f) ->
-    typename std::enable_if<std::is_same<typename std::result_of<F(future<R>&)>::type,
-                                         void>::value>::type
+/**
+ * Shared state of the future returned by `then`, waiting for the source state
+ *
+ * The continuation is the waiter linked into the source as well as the result state, so
+ * attaching it takes a single allocation from the pool, the link holds a reference which is
+ * dropped once the callable has run. The launcher decides where the callable runs.
+ */
+template <typename Future, typename Fn, typename R, typename Launcher>
+class continuation : public shared_state<R>, public future_waiter
 {
-    std::forward<F>(fn)(f);
-    p.set_value();
-}
+    typedef pooled_allocator<continuation> allocator_t;
+    typedef typename Future::ptr_t source_ptr_t;
+    typedef boost::intrusive_ptr<continuation> ptr_t;
 
-template <typename R, typename F>
-auto set_promise_value(promise<typename std::result_of<F(future<R>&)>::type>& p,
-                       F&& fn,
-                       future<R>& f) ->
-    typename std::enable_if<!std::is_same<typename std::result_of<F(future<R>&)>::type,
-                                          void>::value>::type
-{
-    p.set_value(std::forward<F>(fn)(f));
-}
+public:
+    static future<R> attach(source_ptr_t const& src, Fn&& fn, Launcher&& launcher)
+    {
+        allocator_t a;
+        continuation* p = a.allocate(1);
+        try {
+            ::new (p) continuation(src, std::forward<Fn>(fn), std::forward<Launcher>(launcher));
+        } catch (...) {
+            a.deallocate(p, 1);
+            throw;
+        }
+        typename shared_state<R>::ptr_t ret(p);
+        // Reference held by the link
+        intrusive_ptr_add_ref(p);
+        src->add_waiter(p);
+        return future<R>(ret);
+    }
+
+    virtual void notify() override
+    {
+        ptr_t self(this, false);
+        try {
+            launcher_(invoker{self});
+        } catch (...) {
+            // Failed to launch
+            src_.reset();
+            this->set_exception(std::current_exception());
+        }
+    }
 
-template <typename R, typename F>
-auto set_promise_value(promise<typename std::result_of<F(shared_future<R>&)>::type>& p,
-                       F&& fn,
-                       shared_future<R>& f) ->
-    typename std::enable_if<std::is_same<typename std::result_of<F(shared_future<R>&)>::type,
-                                         void>::value>::type
-{
-    std::forward<F>(fn)(f);
-    p.set_value();
-}
+    virtual void discard() override
+    {
+        ptr_t self(this, false);
+        this->owner_destroyed();
+    }
 
-template <typename R, typename F>
-auto set_promise_value(promise<typename std::result_of<F(shared_future<R>&)>::type>& p,
-                       F&& fn,
-                       shared_future<R>& f) ->
-    typename std::enable_if<!std::is_same<typename std::result_of<F(shared_future<R>&)>::type,
-                                          void>::value>::type
-{
-    p.set_value(std::forward<F>(fn)(f));
-}
+protected:
+    virtual void deallocate_future() override
+    {
+        allocator_t a;
+        std::allocator_traits<allocator_t>::destroy(a, this);
+        a.deallocate(this, 1);
+    }
+
+private:
+    continuation(source_ptr_t const& src, Fn&& fn, Launcher&& launcher)
+    : src_(src), fn_(std::forward<Fn>(fn)), launcher_(std::forward<Launcher>(launcher))
+    {
+    }
+
+    struct invoker
+    {
+        void operator()() { self_->run(); }
+
+        ptr_t self_;
+    };
+
+    void run()
+    {
+        Future f(src_);
+        src_.reset();
+        try {
+            invoke(f, std::is_void<R>());
+        } catch (...) {
+            this->set_exception(std::current_exception());
+        }
+    }
+
+    void invoke(Future& f, std::false_type) { this->set_value(fn_(f)); }
+
+    void invoke(Future& f, std::true_type)
+    {
+        fn_(f);
+        this->set_value();
+    }
+
+    source_ptr_t src_;
+    typename std::decay<Fn>::type fn_;
+    typename std::decay<Launcher>::type launcher_;
+};
+
+template <typename Future, typename Fn, typename Launcher>
+using continuation_t
+    = continuation<Future, Fn, typename std::result_of<Fn(Future&)>::type, Launcher>;
 
 template <typename Ret>
 struct async_any_state : std::enable_shared_from_this<async_any_state<Ret>>
@@ -516,8 +574,7 @@ struct async_any_state : std::enable_shared_from_this<async_any_state<Ret>>
 
     void set_value(Ret v)
     {
-        if (is_set_) return;
-        is_set_ = true;
+        if (is_set_.exchange(true)) return;
         p.set_value(v);
     }
 
@@ -627,97 +684,78 @@ template <typename R>
 template <typename F>
 inline future<typename std::result_of<F(future<R>&)>::type> future<R>::then(F&& func)
 {
-    typedef typename std::result_of<F(future<R>&)>::type result_type;
-    struct waiter
-    {
-        ptr_t src_;
-        F f_;
-        promise<result_type> p_;
-
-        waiter(ptr_t src, F&& f) : src_(src), f_(std::forward<F>(f)) {}
+    ptr_t src;
+    src.swap(state_);
+    return detail::continuation_t<future<R>, F, detail::inline_launcher>::attach(
+        src, std::forward<F>(func), detail::inline_launcher());
+}
 
-        void invoke()
-        {
-            future<R> f(src_);
-            detail::set_promise_value(p_, std::forward<F>(f_), f);
-        }
-    };
-    std::shared_ptr<waiter> w = std::make_shared<waiter>(state_, std::forward<F>(func));
-    state_->add_external_waiter(std::bind(&waiter::invoke, w));
-    return w->p_.get_future();
+template <typename R>
+template <typename Policy, typename F>
+inline future<typename std::result_of<F(future<R>&)>::type>
+future<R>::then(Policy&& policy, F&& func)
+{
+    ptr_t src;
+    src.swap(state_);
+    return detail::continuation_t<future<R>, F, detail::continuation_launcher>::attach(
+        src, std::forward<F>(func), detail::continuation_launcher(policy));
 }
 
 template <typename R>
 template <typename F>
 inline future<typename std::result_of<F(future<R&>&)>::type> future<R&>::then(F&& func)
 {
-    typedef typename std::result_of<F(future<R&>&)>::type result_type;
-
-    struct waiter
-    {
-        ptr_t src_;
-        F f_;
-        promise<result_type> p_;
-
-        waiter(ptr_t src, F&& f) : src_(src), f_(std::forward<F>(f)) {}
-
-        void invoke()
-        {
-            future<R&> f(src_);
-            detail::set_promise_value(p_, std::forward<F>(f_), f);
-        }
-    };
+    ptr_t src;
+    src.swap(state_);
+    return detail::continuation_t<future<R&>, F, detail::inline_launcher>::attach(
+        src, std::forward<F>(func), detail::inline_launcher());
+}
 
-    std::shared_ptr<waiter> w = std::make_shared<waiter>(state_, std::forward<F>(func));
-    state_->add_external_waiter(std::bind(&waiter::invoke, w));
-    return w->p_.get_future();
+template <typename R>
+template <typename Policy, typename F>
+inline future<typename std::result_of<F(future<R&>&)>::type>
+future<R&>::then(Policy&& policy, F&& func)
+{
+    ptr_t src;
+    src.swap(state_);
+    return detail::continuation_t<future<R&>, F, detail::continuation_launcher>::attach(
+        src, std::forward<F>(func), detail::continuation_launcher(policy));
 }
 
 template <typename F>
 inline future<typename std::result_of<F(future<void>&)>::type> future<void>::then(F&& func)
 {
-    typedef typename std::result_of<F(future<void>&)>::type result_type;
-    struct waiter
-    {
-        ptr_t src_;
-        F f_;
-        promise<result_type> p_;
-
-        waiter(ptr_t src, F&& f) : src_(src), f_(std::forward<F>(f)) {}
+    ptr_t src;
+    src.swap(state_);
+    return detail::continuation_t<future<void>, F, detail::inline_launcher>::attach(
+        src, std::forward<F>(func), detail::inline_launcher());
+}
 
-        void invoke()
-        {
-            future<void> f(src_);
-            detail::set_promise_value(p_, std::forward<F>(f_), f);
-        }
-    };
-    std::shared_ptr<waiter> w = std::make_shared<waiter>(state_, std::forward<F>(func));
-    state_->add_external_waiter(std::bind(&waiter::invoke, w));
-    return w->p_.get_future();
+template <typename Policy, typename F>
+inline future<typename std::result_of<F(future<void>&)>::type>
+future<void>::then(Policy&& policy, F&& func)
+{
+    ptr_t src;
+    src.swap(state_);
+    return detail::continuation_t<future<void>, F, detail::continuation_launcher>::attach(
+        src, std::forward<F>(func), detail::continuation_launcher(policy));
 }
 
 template <typename R>
 template <typename F>
 inline future<typename std::result_of<F(shared_future<R>&)>::type> shared_future<R>::then(F&& func)
 {
-    typedef typename std::result_of<F(shared_future<R>&)>::type result_type;
-    struct waiter
-    {
-        ptr_t src_;
-        F f_;
-        promise<result_type> p_;
-
-        waiter(ptr_t src, F&& f) : src_(src), f_(std::forward<F>(f)) {}
+    return detail::continuation_t<shared_future<R>, F, detail::inline_launcher>::attach(
+        state_, std::forward<F>(func), detail::inline_launcher());
+}
 
-        void invoke()
-        {
-            shared_future<R> f(src_);
-            detail::set_promise_value(p_, std::forward<F>(f_), f);
-        }
-    };
-    std::shared_ptr<waiter> w = std::make_shared<waiter>(state_, std::forward<F>(func));
-    state_->add_external_waiter(std::bind(&waiter::invoke, w));
-    return w->p_.get_future();
+template <typename R>
+template <typename Policy, typename F>
+inline future<typename std::result_of<F(shared_future<R>&)>::type>
+shared_future<R>::then(Policy&& policy, F&& func)
+{
+    return detail::continuation_t<shared_future<R>, F, detail::continuation_launcher>::attach(
+        state_, std::forward<F>(func), detail::continuation_launcher(policy));
 }
 
 template <typename R>
@@ -725,50 +763,33 @@ template <typename F>
 inline future<typename std::result_of<F(shared_future<R&>&)>::type>
 shared_future<R&>::then(F&& func)
 {
-    typedef typename std::result_of<F(shared_future<R&>&)>::type result_type;
-
-    struct waiter
-    {
-        ptr_t src_;
-        F f_;
-        promise<result_type> p_;
-
-        waiter(ptr_t src, F&& f) : src_(src), f_(std::forward<F>(f)) {}
-
-        void invoke()
-        {
-            shared_future<R&> f(src_);
-            detail::set_promise_value(p_, std::forward<F>(f_), f);
-        }
-    };
+    return detail::continuation_t<shared_future<R&>, F, detail::inline_launcher>::attach(
+        state_, std::forward<F>(func), detail::inline_launcher());
+}
 
-    std::shared_ptr<waiter> w = std::make_shared<waiter>(state_, std::forward<F>(func));
-    state_->add_external_waiter(std::bind(&waiter::invoke, w));
-    return w->p_.get_future();
+template <typename R>
+template <typename Policy, typename F>
+inline future<typename std::result_of<F(shared_future<R&>&)>::type>
+shared_future<R&>::then(Policy&& policy, F&& func)
+{
+    return detail::continuation_t<shared_future<R&>, F, detail::continuation_launcher>::attach(
+        state_, std::forward<F>(func), detail::continuation_launcher(policy));
 }
 
 template <typename F>
 inline future<typename std::result_of<F(shared_future<void>&)>::type>
 shared_future<void>::then(F&& func)
 {
-    typedef typename std::result_of<F(shared_future<void>&)>::type result_type;
-    struct waiter
-    {
-        ptr_t src_;
-        F f_;
-        promise<result_type> p_;
-
-        waiter(ptr_t src, F&& f) : src_(src), f_(std::forward<F>(f)) {}
+    return detail::continuation_t<shared_future<void>, F, detail::inline_launcher>::attach(
+        state_, std::forward<F>(func), detail::inline_launcher());
+}
 
-        void invoke()
-        {
-            shared_future<void> f(src_);
-            detail::set_promise_value(p_, std::forward<F>(f_), f);
-        }
-    };
-    std::shared_ptr<waiter> w = std::make_shared<waiter>(state_, std::forward<F>(func));
-    state_->add_external_waiter(std::bind(&waiter::invoke, w));
-    return w->p_.get_future();
+template <typename Policy, typename F>
+inline future<typename std::result_of<F(shared_future<void>&)>::type>
+shared_future<void>::then(Policy&& policy, F&& func)
+{
+    return detail::continuation_t<shared_future<void>, F, detail::continuation_launcher>::attach(
+        state_, std::forward<F>(func), detail::continuation_launcher(policy));
 }
 
 template <typename... Futures>
@@ -856,10 +877,99 @@ auto async_wait_for_all(Iterator begin, Iterator end) ->
     return state->get_future();
 }
 
+/**
+ * Result of `when_any`, the index of the first ready future and all the futures
+ */
+template <typename Sequence>
+struct when_any_result
+{
+    std::size_t index;
+    Sequence futures;
+};
+
+/**
+ * Returns a future of all the futures, ready once all of them are ready
+ */
+inline future<std::tuple<>> when_all()
+{
+    return make_ready_future(std::tuple<>());
+}
+
+template <typename... Futures,
+          typename = typename std::enable_if<utility::and_<
+              detail::is_future<typename std::decay<Futures>::type>::value...>::value>::type>
+future<std::tuple<typename std::decay<Futures>::type...>> when_all(Futures&&... futures)
+{
+    typedef std::tuple<typename std::decay<Futures>::type...> sequence_type;
+    future<void> all = async_wait_for_all(futures...);
+    return all.then([fs = sequence_type(std::forward<Futures>(futures)...)](
+        future<void>&) mutable { return std::move(fs); });
+}
+
+template <typename Iterator>
+auto when_all(Iterator begin, Iterator end) -> typename std::enable_if<
+    !detail::is_future<Iterator>::value,
+    future<std::vector<typename std::iterator_traits<Iterator>::value_type>>>::type
+{
+    typedef std::vector<typename std::iterator_traits<Iterator>::value_type> sequence_type;
+    sequence_type fs;
+    for (Iterator i = begin; i != end; ++i) {
+        fs.push_back(std::move(*i));
+    }
+    if (fs.empty()) return make_ready_future(std::move(fs));
+    future<void> all = async_wait_for_all(fs.begin(), fs.end());
+    return all.then([fs = std::move(fs)](future<void>&) mutable { return std::move(fs); });
+}
+
+/**
+ * Returns a future of all the futures, ready once any of them is ready
+ */
+inline future<when_any_result<std::tuple<>>> when_any()
+{
+    return make_ready_future(when_any_result<std::tuple<>>{std::size_t(-1), std::tuple<>()});
+}
+
+template <typename... Futures,
+          typename = typename std::enable_if<utility::and_<
+              detail::is_future<typename std::decay<Futures>::type>::value...>::value>::type>
+future<when_any_result<std::tuple<typename std::decay<Futures>::type...>>>
+when_any(Futures&&... futures)
+{
+    typedef std::tuple<typename std::decay<Futures>::type...> sequence_type;
+    future<std::size_t> any = async_wait_for_any(futures...);
+    return any.then([fs = sequence_type(std::forward<Futures>(futures)...)](
+        future<std::size_t>& f) mutable {
+        return when_any_result<sequence_type>{f.get(), std::move(fs)};
+    });
+}
+
+template <typename Iterator>
+auto when_any(Iterator begin, Iterator end) -> typename std::enable_if<
+    !detail::is_future<Iterator>::value,
+    future<when_any_result<std::vector<typename std::iterator_traits<Iterator>::value_type>>>>::type
+{
+    typedef std::vector<typename std::iterator_traits<Iterator>::value_type> sequence_type;
+    typedef when_any_result<sequence_type> result_type;
+    sequence_type fs;
+    for (Iterator i = begin; i != end; ++i) {
+        fs.push_back(std::move(*i));
+    }
+    if (fs.empty()) return make_ready_future(result_type{std::size_t(-1), std::move(fs)});
+    future<typename sequence_type::iterator> any = async_wait_for_any(fs.begin(), fs.end());
+    // Moving the vector keeps iterators valid
+    return any.then([fs = std::move(fs)](future<typename sequence_type::iterator>& f) mutable {
+        std::size_t index = f.get() - fs.begin();
+        return result_type{index, std::move(fs)};
+    });
+}
+
 } // End of namespace fibers
 
 using fibers::promise;
 using fibers::make_ready_future;
+using fibers::when_any_result;
+using fibers::when_all;
+using fibers::when_any;
 
 } // End of namespace fibio
 
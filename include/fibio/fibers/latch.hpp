@@ -0,0 +1,82 @@
+//
+//  latch.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_latch_hpp
+#define fibio_fibers_latch_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <fibio/fibers/detail/parking_queue.hpp>
+
+namespace fibio {
+namespace fibers {
+
+/**
+ * class latch
+ *
+ * A single-use downward counter, fibers waiting on the latch are released when the counter
+ * reaches zero.
+ * Counting down is a single atomic operation, `count_down` and `try_wait` can be called from
+ * foreign threads, `wait` and `arrive_and_wait` must be called in fibers.
+ */
+class latch
+{
+public:
+    /**
+     * Constructs a latch with the counter initialized to `count`
+     */
+    explicit latch(std::ptrdiff_t count) : count_(count) {}
+
+    /**
+     * Decrements the counter by `n`, releases all waiting fibers if it reaches zero
+     */
+    void count_down(std::ptrdiff_t n = 1)
+    {
+        std::ptrdiff_t c = count_.fetch_sub(n, std::memory_order_seq_cst);
+        if (c > 0 && c <= n) {
+            waiters_.unpark_all();
+        }
+    }
+
+    /**
+     * Returns true if the counter has reached zero
+     */
+    bool try_wait() const noexcept { return count_.load(std::memory_order_seq_cst) <= 0; }
+
+    /**
+     * Blocks until the counter reaches zero
+     */
+    void wait()
+    {
+        while (!try_wait()) {
+            if (waiters_.park_unless([this]() { return try_wait(); })) return;
+        }
+    }
+
+    /**
+     * Decrements the counter by `n` and blocks until it reaches zero
+     */
+    void arrive_and_wait(std::ptrdiff_t n = 1)
+    {
+        count_down(n);
+        wait();
+    }
+
+private:
+    latch(const latch&) = delete;
+
+    void operator=(const latch&) = delete;
+
+    std::atomic<std::ptrdiff_t> count_;
+    detail::parking_queue waiters_;
+};
+
+} // End of namespace fibers
+
+using fibers::latch;
+
+} // End of namespace fibio
+
+#endif
@@ -0,0 +1,168 @@
+//
+//  logger.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_logger_hpp
+#define fibio_fibers_logger_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+namespace fibio {
+namespace fibers {
+
+/// Severity of log records
+enum class log_level
+{
+    trace,
+    debug,
+    info,
+    warning,
+    error,
+    fatal,
+};
+
+/**
+ * A structured field of a log record, written as `key=value`
+ */
+struct log_field
+{
+    log_field(const char* k, const std::string& v) : key(k), value(v) {}
+
+    log_field(const char* k, const char* v) : key(k), value(v) {}
+
+    template <typename T,
+              typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    log_field(const char* k, T v)
+    : key(k), value(std::to_string(v))
+    {
+    }
+
+    const char* key;
+    std::string value;
+};
+
+struct logger_impl;
+
+/**
+ * class logger
+ *
+ * Asynchronous logger, records are formatted by the caller and put into a lock-free ring buffer
+ * of the calling thread, a background thread collects records from all rings and writes them to
+ * the sink in batches.
+ *
+ * Each record carries the time, the level, the id and name of the calling fiber, or the id of the
+ * calling thread if it's not a fiber, the message and optional fields.
+ *
+ * Records are written in the order they're logged, so records of a fiber stay in order even if
+ * the fiber moves between threads. Records below `sync_level` are dropped if the ring of the
+ * thread is full. Records at or above `sync_level` are never dropped, the caller waits until the
+ * record and everything logged before it are written and the sink is flushed, a fiber is parked
+ * without blocking its worker thread.
+ */
+class logger
+{
+public:
+    /// logger attributes
+    struct attributes
+    {
+        /// Records below this level are discarded
+        log_level level = log_level::info;
+
+        /// Records at or above this level are written synchronously
+        log_level sync_level = log_level::error;
+
+        /// Max number of records queued by a thread, rounded up to a power of 2
+        size_t ring_capacity = 4096;
+
+        /// Max time records stay queued
+        std::chrono::milliseconds flush_interval{100};
+
+        /// constructor
+        attributes() {}
+    };
+
+    /**
+     * constructor, appends records to the file, which is written with fibio file streams
+     */
+    explicit logger(const std::string& path, attributes attrs = attributes());
+
+    /**
+     * constructor, writes records to the stream, which must outlive the logger
+     */
+    explicit logger(std::ostream& os, attributes attrs = attributes());
+
+    /// destructor, writes all queued records
+    ~logger();
+
+    /// Checks if records of the level are logged
+    bool enabled(log_level level) const;
+
+    /// Sets the minimal level of logged records
+    void set_level(log_level level);
+
+    /// Logs a record
+    void log(log_level level, const std::string& message, std::initializer_list<log_field> fields);
+
+    void log(log_level level, const std::string& message) { log(level, message, {}); }
+
+    void trace(const std::string& message, std::initializer_list<log_field> fields = {})
+    {
+        log(log_level::trace, message, fields);
+    }
+
+    void debug(const std::string& message, std::initializer_list<log_field> fields = {})
+    {
+        log(log_level::debug, message, fields);
+    }
+
+    void info(const std::string& message, std::initializer_list<log_field> fields = {})
+    {
+        log(log_level::info, message, fields);
+    }
+
+    void warning(const std::string& message, std::initializer_list<log_field> fields = {})
+    {
+        log(log_level::warning, message, fields);
+    }
+
+    void error(const std::string& message, std::initializer_list<log_field> fields = {})
+    {
+        log(log_level::error, message, fields);
+    }
+
+    void fatal(const std::string& message, std::initializer_list<log_field> fields = {})
+    {
+        log(log_level::fatal, message, fields);
+    }
+
+    /// Waits until all records logged so far are written and the sink is flushed
+    void flush();
+
+    /// Number of records dropped as rings were full
+    uint64_t dropped() const;
+
+private:
+    logger(const logger&) = delete;
+
+    void operator=(const logger&) = delete;
+
+    std::unique_ptr<logger_impl> impl_;
+};
+
+} // End of namespace fibers
+
+using fibers::log_level;
+using fibers::log_field;
+using fibers::logger;
+
+} // End of namespace fibio
+
+#endif
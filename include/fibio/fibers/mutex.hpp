@@ -9,22 +9,95 @@
 #ifndef fibio_mutex_hpp
 #define fibio_mutex_hpp
 
-#include <deque>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <chrono>
 #include <mutex>
+#include <thread>
 #include <fibio/fibers/detail/forward.hpp>
 #include <fibio/fibers/detail/spinlock.hpp>
+#include <fibio/fibers/detail/wait_queue.hpp>
 
 namespace fibio {
 namespace fibers {
 
+namespace detail {
+/// Tag of locks internal to other primitives, their waits are recorded by the owning primitive
+struct unprofiled_t
+{
+};
+
+constexpr unprofiled_t unprofiled{};
+} // End of namespace detail
+
+/**
+ * class mutex
+ *
+ * Can also be used by foreign threads, a thread waiting for the mutex blocks itself, not any
+ * worker thread of the scheduler.
+ */
 class mutex
 {
 public:
+    /// Ownership transfer policy on unlock
+    enum class policy
+    {
+        /**
+         * The mutex is handed over to the first waiting fiber on unlock, waiters acquire the
+         * mutex in FIFO order, at the cost of a context switch per unlock under contention
+         */
+        fair,
+        /**
+         * The mutex is released on unlock and the first waiting fiber is woken up to retry,
+         * running fibers may take the mutex before it, which avoids lock convoys but waiters
+         * can be overtaken
+         */
+        barging,
+    };
+
+    /// mutex attributes
+    struct attributes
+    {
+        /// Ownership transfer policy
+        policy lock_policy = policy::fair;
+
+        /**
+         * Adaptive locking
+         * When the mutex is held by a fiber running in another worker thread, a fiber trying to
+         * lock it spins up to `spin_count` times before parking itself, 0 disables spinning.
+         */
+        unsigned spin_count = 0;
+
+        /// constructor
+        constexpr attributes() {}
+    };
+
+    /// Contention statistics
+    struct statistics
+    {
+        /// Number of times the mutex has been acquired
+        uint64_t acquisitions = 0;
+
+        /// Number of acquisitions that had to spin or wait
+        uint64_t contended_acquisitions = 0;
+
+        /// Total time fibers spent spinning or waiting for the mutex
+        std::chrono::nanoseconds total_wait_time{0};
+    };
+
     /// constructor
     mutex() = default;
 
+    /// constructor, creates a mutex with specific attributes
+    explicit mutex(attributes attrs)
+    : spin_count_(attrs.spin_count), barging_(attrs.lock_policy == policy::barging)
+    {
+    }
+
+    /// constructor, creates a mutex whose waits are not seen by `contention_profiler`
+    explicit mutex(detail::unprofiled_t) : profiled_(false) {}
+
     /**
      * locks the mutex, blocks if the mutex is not available
      */
@@ -40,18 +113,52 @@ public:
      */
     void unlock();
 
+    /**
+     * returns a snapshot of the contention statistics
+     */
+    statistics get_statistics() const;
+
 private:
     /// non-copyable
     mutex(const mutex&) = delete;
 
     void operator=(const mutex&) = delete;
 
-    detail::spinlock mtx_;
+    bool spin_lock(const detail::fiber_ptr_t& tf, std::unique_lock<detail::spinlock>& lock);
+
+    void acquire(const detail::fiber_ptr_t& tf);
+
+    void lock_in_thread(const void* call_site);
+
+    bool try_lock_in_thread();
+
+    void unlock_in_thread();
+
+    void release();
+
+    bool is_locked() const { return owner_ || thread_owner_ != std::thread::id(); }
+
+    mutable detail::spinlock mtx_;
+    // Mirrors `owner_`, can be read without holding `mtx_`
+    std::atomic<bool> locked_{false};
+    unsigned spin_count_ = 0;
+    bool barging_ = false;
+    bool profiled_ = true;
+    // A waiter has been woken up to retry and hasn't run yet, barging mode only
+    bool waking_ = false;
+    statistics stats_;
     detail::fiber_ptr_t owner_;
-    std::deque<detail::fiber_ptr_t> suspended_;
+    // The owner if the mutex is locked by a foreign thread
+    std::thread::id thread_owner_;
+    detail::wait_queue suspended_;
     friend struct condition_variable;
 };
 
+/**
+ * class timed_mutex
+ *
+ * Must be used in fibers, throws `fiber_exception` if called by a foreign thread.
+ */
 class timed_mutex
 {
 public:
@@ -101,22 +208,21 @@ private:
 
     bool try_lock_rel(detail::duration_t d);
 
-    void timeout_handler(detail::fiber_ptr_t this_fiber, boost::system::error_code ec);
+    void timeout_handler(detail::fiber_ptr_t this_fiber,
+                         detail::wait_node* node,
+                         boost::system::error_code ec);
 
     detail::spinlock mtx_;
     detail::fiber_ptr_t owner_;
 
-    struct suspended_item
-    {
-        detail::fiber_ptr_t f_;
-        detail::timer_t* t_;
-
-        bool operator==(detail::fiber_ptr_t f) const { return f_ == f; }
-    };
-
-    std::deque<suspended_item> suspended_;
+    detail::wait_queue suspended_;
 };
 
+/**
+ * class recursive_mutex
+ *
+ * Must be used in fibers, throws `fiber_exception` if called by a foreign thread.
+ */
 class recursive_mutex
 {
 public:
@@ -147,9 +253,14 @@ private:
     detail::spinlock mtx_;
     size_t level_ = 0;
     detail::fiber_ptr_t owner_;
-    std::deque<detail::fiber_ptr_t> suspended_;
+    detail::wait_queue suspended_;
 };
 
+/**
+ * class recursive_timed_mutex
+ *
+ * Must be used in fibers, throws `fiber_exception` if called by a foreign thread.
+ */
 class recursive_timed_mutex
 {
 public:
@@ -199,21 +310,15 @@ private:
 
     bool try_lock_rel(detail::duration_t d);
 
-    void timeout_handler(detail::fiber_ptr_t this_fiber, boost::system::error_code ec);
+    void timeout_handler(detail::fiber_ptr_t this_fiber,
+                         detail::wait_node* node,
+                         boost::system::error_code ec);
 
     detail::spinlock mtx_;
     size_t level_;
     detail::fiber_ptr_t owner_;
 
-    struct suspended_item
-    {
-        detail::fiber_ptr_t f_;
-        detail::timer_t* t_;
-
-        bool operator==(detail::fiber_ptr_t f) const { return f_ == f; }
-    };
-
-    std::deque<suspended_item> suspended_;
+    detail::wait_queue suspended_;
 };
 
 } // End of namespace fibers
@@ -0,0 +1,239 @@
+//
+//  parallel.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_parallel_hpp
+#define fibio_fibers_parallel_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+#include <boost/optional.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/**
+ * Work split into chunks, lives on the stack of the calling fiber
+ */
+struct chunk_body
+{
+    virtual ~chunk_body() {}
+
+    /// Runs the chunk, may run in any worker thread
+    virtual void run(std::size_t chunk) = 0;
+};
+
+template <typename Fn>
+struct chunk_body_object : chunk_body
+{
+    chunk_body_object(Fn& fn) : fn_(fn) {}
+
+    virtual void run(std::size_t chunk) override { fn_(chunk); }
+
+    Fn& fn_;
+};
+
+/**
+ * Runs all chunks and returns once they're done, the first exception thrown by a chunk is
+ * rethrown after skipping chunks not yet started
+ * Chunks are picked one by one by the calling fiber and by helper fibers spread across the worker
+ * threads of its scheduler, so threads finishing early take over the remaining work. The calling
+ * fiber is parked without blocking its thread while waiting for the helpers. Chunks run in the
+ * calling thread if it's not a fiber.
+ */
+void run_chunks(std::size_t chunks, chunk_body& body);
+
+/// Number of threads chunks can be spread across
+std::size_t parallel_concurrency();
+
+/**
+ * Calls fn(chunk) for each chunk in [0, chunks)
+ */
+template <typename Fn>
+void for_each_chunk(std::size_t chunks, Fn&& fn)
+{
+    if (chunks == 0) return;
+    chunk_body_object<typename std::remove_reference<Fn>::type> body(fn);
+    run_chunks(chunks, body);
+}
+
+/// Chunk size for `n` elements, `grain` is used if not 0
+inline std::size_t grain_size(std::size_t n, std::size_t grain)
+{
+    // A few chunks per thread balance the load when chunks take different time
+    if (grain == 0) grain = n / (parallel_concurrency() * 8);
+    return std::max<std::size_t>(grain, 1);
+}
+
+/**
+ * Splits [0, n) into ranges of `grain` elements and calls fn(begin, end) for each of them
+ */
+template <typename Fn>
+void for_ranges(std::size_t n, std::size_t grain, Fn&& fn)
+{
+    if (n == 0) return;
+    grain = grain_size(n, grain);
+    for_each_chunk((n + grain - 1) / grain, [&](std::size_t c) {
+        std::size_t begin = c * grain;
+        fn(begin, std::min(n, begin + grain));
+    });
+}
+
+} // End of namespace detail
+
+/**
+ * Calls fn(i) for each i in [first, last)
+ */
+template <typename Index, typename Fn>
+void parallel_for(Index first, Index last, Fn&& fn, std::size_t grain = 0)
+{
+    static_assert(std::is_integral<Index>::value, "Index must be an integral type");
+    if (!(first < last)) return;
+    detail::for_ranges(std::size_t(last - first), grain, [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; i++) {
+            fn(Index(first + i));
+        }
+    });
+}
+
+/**
+ * Calls fn(*i) for each i in [first, last)
+ */
+template <typename RandomIt, typename Fn>
+void parallel_for_each(RandomIt first, RandomIt last, Fn&& fn, std::size_t grain = 0)
+{
+    detail::for_ranges(last - first, grain, [&](std::size_t b, std::size_t e) {
+        std::for_each(first + b, first + e, fn);
+    });
+}
+
+/**
+ * Stores op(*i) for each i in [first, last) into the range starting at d_first, returns the end
+ * of the destination range
+ */
+template <typename RandomIt, typename OutputIt, typename UnaryOp>
+OutputIt parallel_transform(
+    RandomIt first, RandomIt last, OutputIt d_first, UnaryOp&& op, std::size_t grain = 0)
+{
+    detail::for_ranges(last - first, grain, [&](std::size_t b, std::size_t e) {
+        std::transform(first + b, first + e, d_first + b, op);
+    });
+    return d_first + (last - first);
+}
+
+/**
+ * Reduces [first, last) with an associative `op`, partial results are combined in order so `op`
+ * doesn't need to be commutative
+ */
+template <typename RandomIt, typename T, typename BinaryOp>
+T parallel_reduce(RandomIt first, RandomIt last, T init, BinaryOp&& op, std::size_t grain = 0)
+{
+    std::size_t n = last - first;
+    if (n == 0) return init;
+    grain = detail::grain_size(n, grain);
+    std::vector<boost::optional<T>> partials((n + grain - 1) / grain);
+    detail::for_ranges(n, grain, [&](std::size_t b, std::size_t e) {
+        partials[b / grain] = std::accumulate(first + b + 1, first + e, T(first[b]), op);
+    });
+    for (auto& p : partials) {
+        init = op(std::move(init), std::move(*p));
+    }
+    return init;
+}
+
+template <typename RandomIt, typename T>
+T parallel_reduce(RandomIt first, RandomIt last, T init)
+{
+    return parallel_reduce(first, last, std::move(init), std::plus<T>());
+}
+
+/**
+ * Stores inclusive prefix sums of [first, last) by `op` into the range starting at d_first,
+ * returns the end of the destination range
+ */
+template <typename RandomIt, typename OutputIt, typename BinaryOp>
+OutputIt parallel_inclusive_scan(
+    RandomIt first, RandomIt last, OutputIt d_first, BinaryOp&& op, std::size_t grain = 0)
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+    std::size_t n = last - first;
+    if (n == 0) return d_first;
+    grain = detail::grain_size(n, grain);
+    // Scans chunks independently, then adds the sum of preceding chunks to each of them
+    detail::for_ranges(n, grain, [&](std::size_t b, std::size_t e) {
+        std::partial_sum(first + b, first + e, d_first + b, op);
+    });
+    std::size_t chunks = (n + grain - 1) / grain;
+    std::vector<boost::optional<value_type>> offsets(chunks);
+    for (std::size_t c = 1; c < chunks; c++) {
+        // The last element of the previous chunk is already complete
+        offsets[c] = d_first[c * grain - 1];
+        std::size_t last_of_chunk = std::min(n, (c + 1) * grain) - 1;
+        d_first[last_of_chunk] = op(*offsets[c], d_first[last_of_chunk]);
+    }
+    detail::for_ranges(n, grain, [&](std::size_t b, std::size_t e) {
+        auto& offset = offsets[b / grain];
+        if (!offset) return;
+        for (std::size_t i = b; i < e - 1; i++) {
+            d_first[i] = op(*offset, d_first[i]);
+        }
+    });
+    return d_first + n;
+}
+
+template <typename RandomIt, typename OutputIt>
+OutputIt parallel_inclusive_scan(RandomIt first, RandomIt last, OutputIt d_first)
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+    return parallel_inclusive_scan(first, last, d_first, std::plus<value_type>());
+}
+
+/**
+ * Sorts [first, last), chunks are sorted in parallel, then merged pairwise in parallel rounds
+ */
+template <typename RandomIt, typename Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp, std::size_t grain = 0)
+{
+    std::size_t n = last - first;
+    if (n < 2) return;
+    grain = detail::grain_size(n, grain);
+    detail::for_ranges(n, grain, [&](std::size_t b, std::size_t e) {
+        std::sort(first + b, first + e, comp);
+    });
+    for (std::size_t width = grain; width < n; width *= 2) {
+        std::size_t pairs = (n + 2 * width - 1) / (2 * width);
+        detail::for_each_chunk(pairs, [&](std::size_t p) {
+            std::size_t b = p * 2 * width;
+            std::size_t m = std::min(n, b + width);
+            std::size_t e = std::min(n, b + 2 * width);
+            if (m < e) std::inplace_merge(first + b, first + m, first + e, comp);
+        });
+    }
+}
+
+template <typename RandomIt>
+void parallel_sort(RandomIt first, RandomIt last)
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+    parallel_sort(first, last, std::less<value_type>());
+}
+
+} // End of namespace fibers
+
+using fibers::parallel_for;
+using fibers::parallel_for_each;
+using fibers::parallel_transform;
+using fibers::parallel_reduce;
+using fibers::parallel_inclusive_scan;
+using fibers::parallel_sort;
+
+} // End of namespace fibio
+
+#endif
@@ -0,0 +1,166 @@
+//
+//  profiler.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_profiler_hpp
+#define fibio_fibers_profiler_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FIBIO_RETURN_ADDRESS() __builtin_return_address(0)
+#define FIBIO_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define FIBIO_RETURN_ADDRESS() _ReturnAddress()
+#define FIBIO_NOINLINE __declspec(noinline)
+#else
+#define FIBIO_RETURN_ADDRESS() nullptr
+#define FIBIO_NOINLINE
+#endif
+
+namespace fibio {
+namespace fibers {
+
+/// Type of the lock a fiber was blocked on
+enum class lock_kind
+{
+    mutex,
+    recursive_mutex,
+    timed_mutex,
+    recursive_timed_mutex,
+    shared_timed_mutex,
+    condition_variable,
+};
+
+/**
+ * Aggregated waits on a lock from a call site
+ */
+struct contention_record
+{
+    /// Address of the lock
+    const void* lock;
+
+    /// Type of the lock
+    lock_kind kind;
+
+    /// Return address of the blocking call, resolve it with addr2line or atos
+    const void* call_site;
+
+    /// Number of sampled waits
+    uint64_t count;
+
+    /// Total time of sampled waits
+    std::chrono::nanoseconds total_wait;
+
+    /// Longest sampled wait
+    std::chrono::nanoseconds max_wait;
+};
+
+/**
+ * class contention_profiler
+ *
+ * Samples waits of fibers and foreign threads blocked on mutexes and condition variables, and
+ * aggregates them by lock address and call site.
+ * The profiler is off by default and can be switched on and off at runtime, uncontended
+ * operations are never profiled, a contended one only checks an atomic flag while it's off.
+ */
+class contention_profiler
+{
+public:
+    /**
+     * Starts profiling, one out of every `sample_rate` waits is recorded
+     */
+    static void enable(unsigned sample_rate = 1);
+
+    /**
+     * Stops profiling, collected records are kept
+     */
+    static void disable();
+
+    /**
+     * Returns true if profiling is on
+     */
+    static bool enabled();
+
+    /**
+     * Discards collected records
+     */
+    static void reset();
+
+    /**
+     * Returns collected records, sorted by total wait time in descending order
+     */
+    static std::vector<contention_record> records();
+
+    /**
+     * Writes the `top` hottest locks and call sites to the stream
+     */
+    static void dump(std::ostream& os, std::size_t top = 10);
+};
+
+namespace detail {
+
+/**
+ * Returns true if the current wait should be recorded
+ */
+bool should_sample_contention();
+
+/**
+ * Records a sampled wait
+ */
+void record_contention(const void* lock,
+                       lock_kind kind,
+                       const void* call_site,
+                       std::chrono::nanoseconds wait);
+
+/**
+ * Measures a wait if it's sampled
+ * Starts right away unless `start_now` is false, then it starts on the first call of `start` and
+ * records nothing if never started.
+ */
+struct contention_sample
+{
+    explicit contention_sample(bool start_now = true)
+    {
+        if (start_now) start();
+    }
+
+    void start()
+    {
+        if (started_) return;
+        started_ = true;
+        sampled_ = should_sample_contention();
+        if (sampled_) start_ = std::chrono::steady_clock::now();
+    }
+
+    void record(const void* lock, lock_kind kind, const void* call_site)
+    {
+        if (!sampled_) return;
+        record_contention(lock,
+                          kind,
+                          call_site,
+                          std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start_));
+    }
+
+    bool started_ = false;
+    bool sampled_ = false;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // End of namespace detail
+} // End of namespace fibers
+
+using fibers::lock_kind;
+using fibers::contention_record;
+using fibers::contention_profiler;
+
+} // End of namespace fibio
+
+#endif
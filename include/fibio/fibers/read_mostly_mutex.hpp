@@ -0,0 +1,103 @@
+//
+//  read_mostly_mutex.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_read_mostly_mutex_hpp
+#define fibio_fibers_read_mostly_mutex_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <fibio/fibers/mutex.hpp>
+#include <fibio/fibers/condition_variable.hpp>
+#include <fibio/fibers/shared_mutex.hpp>
+
+namespace fibio {
+namespace fibers {
+
+/**
+ * class read_mostly_mutex
+ *
+ * A reader-writer mutex for data that is read far more often than it is written.
+ *
+ * Readers are counted in per-slot counters, each slot sits in its own cache line and a fiber
+ * always uses the same slot, so readers don't take any lock and don't contend with each other
+ * while no writer is around.
+ * Writers are serialized, a writer announces itself and waits for all readers to leave, readers
+ * arriving after that are parked until the writer is done, so writers are never starved. Locking
+ * exclusively is much more expensive than `shared_timed_mutex`.
+ *
+ * Can be used with `std::unique_lock` and `shared_lock`.
+ * NOTE: Must be used in fibers.
+ */
+class read_mostly_mutex
+{
+public:
+    /// constructor
+    read_mostly_mutex() = default;
+
+    /**
+     * locks the mutex for shared ownership, blocks if a writer is holding or waiting for the mutex
+     */
+    void lock_shared();
+
+    /**
+     * tries to lock the mutex for shared ownership, returns if a writer is holding or waiting for
+     * the mutex
+     */
+    bool try_lock_shared();
+
+    /**
+     * unlocks the mutex (shared ownership)
+     */
+    void unlock_shared();
+
+    /**
+     * locks the mutex, blocks until all readers and other writers have left
+     */
+    void lock();
+
+    /**
+     * tries to lock the mutex, returns if the mutex is not available
+     */
+    bool try_lock();
+
+    /**
+     * unlocks the mutex
+     */
+    void unlock();
+
+private:
+    /// non-copyable
+    read_mostly_mutex(const read_mostly_mutex&) = delete;
+
+    void operator=(const read_mostly_mutex&) = delete;
+
+    static constexpr std::size_t slot_count = 64;
+
+    struct slot
+    {
+        std::atomic<long> readers_{0};
+    };
+
+    slot& current_slot();
+
+    bool no_readers() const;
+
+    detail::cache_line_padded<slot> slots_[slot_count];
+    detail::cache_line_padded<std::atomic<bool>> writer_;
+    // Serializes writers
+    mutex writer_mtx_;
+    // Protects the waiting of readers and the writer
+    mutex state_mtx_;
+    condition_variable readers_cond_;
+    condition_variable writer_cond_;
+};
+
+} // End of namespace fibers
+
+using fibers::read_mostly_mutex;
+
+} // End of namespace fibio
+
+#endif
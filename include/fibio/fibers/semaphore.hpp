@@ -0,0 +1,88 @@
+//
+//  semaphore.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_semaphore_hpp
+#define fibio_fibers_semaphore_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <fibio/fibers/detail/parking_queue.hpp>
+
+namespace fibio {
+namespace fibers {
+
+/**
+ * class semaphore
+ *
+ * A counting semaphore
+ * Acquiring an available unit is a single CAS and releasing is a single atomic add if nobody is
+ * waiting, fibers are parked only when there is no unit available.
+ * `release` and `try_acquire` can be called from foreign threads, `acquire` must be called in
+ * fibers.
+ */
+class semaphore
+{
+public:
+    /**
+     * Constructs a semaphore with `count` units available
+     */
+    explicit semaphore(std::ptrdiff_t count = 0) : count_(count) {}
+
+    /**
+     * Takes a unit, blocks until there is one available
+     */
+    void acquire()
+    {
+        while (!try_acquire()) {
+            if (waiters_.park_unless([this]() { return try_acquire(); })) return;
+        }
+    }
+
+    /**
+     * Takes a unit if there is one available, returns immediately
+     */
+    bool try_acquire() noexcept
+    {
+        std::ptrdiff_t c = count_.load(std::memory_order_relaxed);
+        while (c > 0) {
+            if (count_.compare_exchange_weak(
+                    c, c - 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Returns `n` units, wakes up waiting fibers
+     */
+    void release(std::ptrdiff_t n = 1)
+    {
+        count_.fetch_add(n, std::memory_order_seq_cst);
+        waiters_.unpark(static_cast<std::size_t>(n));
+    }
+
+    /**
+     * Returns the number of available units
+     * NOTE: The return value is just a snapshot
+     */
+    std::ptrdiff_t available() const noexcept { return count_.load(std::memory_order_relaxed); }
+
+private:
+    semaphore(const semaphore&) = delete;
+
+    void operator=(const semaphore&) = delete;
+
+    std::atomic<std::ptrdiff_t> count_;
+    detail::parking_queue waiters_;
+};
+
+} // End of namespace fibers
+
+using fibers::semaphore;
+
+} // End of namespace fibio
+
+#endif
@@ -17,6 +17,7 @@
 #include <fibio/fibers/exceptions.hpp>
 #include <fibio/fibers/mutex.hpp>
 #include <fibio/fibers/condition_variable.hpp>
+#include <fibio/fibers/profiler.hpp>
 
 namespace fibio {
 namespace fibers {
@@ -126,16 +127,23 @@ public:
     /// constructor
     shared_timed_mutex() {}
 
+    // Blocking functions are not inlined, so the contention profiler sees their callers
+    // A blocked acquisition is recorded once as a wait on this mutex, the internal lock and
+    // condition variables are not profiled on their own
+
     /**
      * locks the mutex for shared ownership, blocks if the mutex is not available
      */
-    void lock_shared()
+    FIBIO_NOINLINE void lock_shared()
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
         while (!state.can_lock_shared()) {
+            sample.start();
             shared_cond.wait(lk);
         }
         state.lock_shared();
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
     }
 
     /**
@@ -166,16 +174,22 @@ public:
      * unavailable until specified time point has been reached
      */
     template <class Clock, class Duration>
-    bool try_lock_shared_until(const std::chrono::time_point<Clock, Duration>& abs_time)
+    FIBIO_NOINLINE bool
+    try_lock_shared_until(const std::chrono::time_point<Clock, Duration>& abs_time)
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
+        bool locked = true;
         while (!state.can_lock_shared()) {
+            sample.start();
             if (cv_status::timeout == shared_cond.wait_until(lk, abs_time)) {
-                return false;
+                locked = false;
+                break;
             }
         }
-        state.lock_shared();
-        return true;
+        if (locked) state.lock_shared();
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
+        return locked;
     }
 
     /**
@@ -207,14 +221,17 @@ public:
     /**
      * locks the mutex, blocks if the mutex is not available
      */
-    void lock()
+    FIBIO_NOINLINE void lock()
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
         while (state.shared_count || state.exclusive) {
+            sample.start();
             state.exclusive_waiting_blocked = true;
             exclusive_cond.wait(lk);
         }
         state.exclusive = true;
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
     }
 
     /**
@@ -246,22 +263,26 @@ public:
      * unavailable until specified time point has been reached
      */
     template <class Clock, class Duration>
-    bool try_lock_until(const std::chrono::time_point<Clock, Duration>& abs_time)
+    FIBIO_NOINLINE bool try_lock_until(const std::chrono::time_point<Clock, Duration>& abs_time)
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
+        bool locked = true;
         while (state.shared_count || state.exclusive) {
+            sample.start();
             state.exclusive_waiting_blocked = true;
             if (cv_status::timeout == exclusive_cond.wait_until(lk, abs_time)) {
                 if (state.shared_count || state.exclusive) {
                     state.exclusive_waiting_blocked = false;
                     release_waiters();
-                    return false;
+                    locked = false;
                 }
                 break;
             }
         }
-        state.exclusive = true;
-        return true;
+        if (locked) state.exclusive = true;
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
+        return locked;
     }
 
     /**
@@ -277,14 +298,17 @@ public:
         release_waiters();
     }
 
-    void lock_upgrade()
+    FIBIO_NOINLINE void lock_upgrade()
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
         while (state.exclusive || state.exclusive_waiting_blocked || state.upgrade) {
+            sample.start();
             shared_cond.wait(lk);
         }
         state.lock_shared();
         state.upgrade = true;
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
     }
 
     template <class Rep, class Period>
@@ -294,20 +318,27 @@ public:
     }
 
     template <class Clock, class Duration>
-    bool try_lock_upgrade_until(const std::chrono::time_point<Clock, Duration>& abs_time)
+    FIBIO_NOINLINE bool
+    try_lock_upgrade_until(const std::chrono::time_point<Clock, Duration>& abs_time)
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
+        bool locked = true;
         while (state.exclusive || state.exclusive_waiting_blocked || state.upgrade) {
+            sample.start();
             if (cv_status::timeout == shared_cond.wait_until(lk, abs_time)) {
                 if (state.exclusive || state.exclusive_waiting_blocked || state.upgrade) {
-                    return false;
+                    locked = false;
                 }
                 break;
             }
         }
-        state.lock_shared();
-        state.upgrade = true;
-        return true;
+        if (locked) {
+            state.lock_shared();
+            state.upgrade = true;
+        }
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
+        return locked;
     }
 
     bool try_lock_upgrade()
@@ -337,17 +368,20 @@ public:
     }
 
     // Upgrade <-> Exclusive
-    void unlock_upgrade_and_lock()
+    FIBIO_NOINLINE void unlock_upgrade_and_lock()
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
         state.assert_lock_upgraded();
         state.unlock_shared();
         while (state.more_shared()) {
+            sample.start();
             upgrade_cond.wait(lk);
         }
         state.upgrade = false;
         state.exclusive = true;
         state.assert_locked();
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
     }
 
     void unlock_and_lock_upgrade()
@@ -384,22 +418,32 @@ public:
     }
 
     template <class Clock, class Duration>
-    bool try_unlock_upgrade_and_lock_until(const std::chrono::time_point<Clock, Duration>& abs_time)
+    FIBIO_NOINLINE bool
+    try_unlock_upgrade_and_lock_until(const std::chrono::time_point<Clock, Duration>& abs_time)
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
         state.assert_lock_upgraded();
+        bool locked = true;
         if (state.shared_count != 1) {
+            sample.start();
             for (;;) {
                 cv_status status = shared_cond.wait_until(lk, abs_time);
                 if (state.shared_count == 1) break;
-                if (status == cv_status::timeout) return false;
+                if (status == cv_status::timeout) {
+                    locked = false;
+                    break;
+                }
             }
         }
-        state.upgrade = false;
-        state.exclusive = true;
-        state.exclusive_waiting_blocked = false;
-        state.shared_count = 0;
-        return true;
+        if (locked) {
+            state.upgrade = false;
+            state.exclusive = true;
+            state.exclusive_waiting_blocked = false;
+            state.shared_count = 0;
+        }
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
+        return locked;
     }
 
     // Shared <-> Exclusive
@@ -433,22 +477,32 @@ public:
     }
 
     template <class Clock, class Duration>
-    bool try_unlock_shared_and_lock_until(const std::chrono::time_point<Clock, Duration>& abs_time)
+    FIBIO_NOINLINE bool
+    try_unlock_shared_and_lock_until(const std::chrono::time_point<Clock, Duration>& abs_time)
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
         state.assert_lock_shared();
+        bool locked = true;
         if (state.shared_count != 1) {
+            sample.start();
             for (;;) {
                 cv_status status = shared_cond.wait_until(lk, abs_time);
                 if (state.shared_count == 1) break;
-                if (status == cv_status::timeout) return false;
+                if (status == cv_status::timeout) {
+                    locked = false;
+                    break;
+                }
             }
         }
-        state.upgrade = false;
-        state.exclusive = true;
-        state.exclusive_waiting_blocked = false;
-        state.shared_count = 0;
-        return true;
+        if (locked) {
+            state.upgrade = false;
+            state.exclusive = true;
+            state.exclusive_waiting_blocked = false;
+            state.shared_count = 0;
+        }
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
+        return locked;
     }
 
     // Shared <-> Upgrade
@@ -480,20 +534,27 @@ public:
     }
 
     template <class Clock, class Duration>
-    bool try_unlock_shared_and_lock_upgrade_until(
+    FIBIO_NOINLINE bool try_unlock_shared_and_lock_upgrade_until(
         const std::chrono::time_point<Clock, Duration>& abs_time)
     {
-        unique_lock<mutex> lk(state_change);
+        detail::contention_sample sample(false);
+        unique_lock<mutex> lk(lock_state(sample));
         state.assert_lock_shared();
+        bool locked = true;
         if (state.exclusive || state.exclusive_waiting_blocked || state.upgrade) {
+            sample.start();
             for (;;) {
                 cv_status status = exclusive_cond.wait_until(lk, abs_time);
                 if (!state.exclusive && !state.exclusive_waiting_blocked && !state.upgrade) break;
-                if (status == cv_status::timeout) return false;
+                if (status == cv_status::timeout) {
+                    locked = false;
+                    break;
+                }
             }
         }
-        state.upgrade = true;
-        return true;
+        if (locked) state.upgrade = true;
+        sample.record(this, lock_kind::shared_timed_mutex, FIBIO_RETURN_ADDRESS());
+        return locked;
     }
 
 private:
@@ -502,10 +563,21 @@ private:
     void operator=(const shared_timed_mutex&) = delete;
 
     state_data state;
-    mutex state_change;
-    condition_variable shared_cond;
-    condition_variable exclusive_cond;
-    condition_variable upgrade_cond;
+    mutex state_change{detail::unprofiled};
+    condition_variable shared_cond{detail::unprofiled};
+    condition_variable exclusive_cond{detail::unprofiled};
+    condition_variable upgrade_cond{detail::unprofiled};
+
+    // Locks the internal state, a wait for it is part of the wait for the mutex
+    unique_lock<mutex> lock_state(detail::contention_sample& sample)
+    {
+        unique_lock<mutex> lk(state_change, std::try_to_lock);
+        if (!lk.owns_lock()) {
+            sample.start();
+            lk.lock();
+        }
+        return lk;
+    }
 
     void release_waiters()
     {
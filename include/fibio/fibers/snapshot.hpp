@@ -0,0 +1,141 @@
+//
+//  snapshot.hpp
+//  fibio
+//
+
+#ifndef fibio_fibers_snapshot_hpp
+#define fibio_fibers_snapshot_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <fibio/fibers/detail/spinlock.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/**
+ * A retired object waiting to be reclaimed
+ */
+struct rcu_node
+{
+    virtual ~rcu_node() {}
+
+    /// The object can be reclaimed after all worker threads have seen this epoch
+    uint64_t epoch_ = 0;
+    rcu_node* next_ = nullptr;
+};
+
+template <typename T>
+struct rcu_object : rcu_node
+{
+    rcu_object(T* p) : p_(p) {}
+
+    std::unique_ptr<T> p_;
+};
+
+/**
+ * Retires an object, it will be deleted after all worker threads have passed a quiescent point
+ */
+void rcu_retire(rcu_node* n);
+
+} // End of namespace detail
+
+/**
+ * class snapshot
+ *
+ * Read-copy-update container for data that is read on hot paths and rarely written.
+ *
+ * Readers get a pointer to the current version with a single atomic load, no lock and no atomic
+ * read-modify-write. Writers publish a new version, the old one is deleted after every worker
+ * thread has passed a quiescent point, i.e. has switched out of the fiber it was running.
+ *
+ * NOTE: Must be read in fibers, and the pointer/reference returned by `get()` is only valid
+ * until the reading fiber yields, blocks, or otherwise gets switched out, readers must not keep
+ * it across these points.
+ * NOTE: Writers are serialized with a spinlock, `modify()` must not block.
+ */
+template <typename T>
+class snapshot
+{
+public:
+    typedef T value_type;
+
+    /// constructor, holds a default constructed value
+    snapshot() : ptr_(new T()) {}
+
+    /// constructor, holds a copy of the value
+    explicit snapshot(T value) : ptr_(new T(std::move(value))) {}
+
+    /// constructor, takes the ownership of the value
+    explicit snapshot(std::unique_ptr<T> p) : ptr_(p.release()) {}
+
+    /// destructor, there must be no reader
+    ~snapshot() { delete ptr_.load(std::memory_order_relaxed); }
+
+    /**
+     * Returns the current version
+     */
+    const T* get() const noexcept { return ptr_.load(std::memory_order_acquire); }
+
+    /**
+     * Returns the current version
+     */
+    const T& operator*() const noexcept { return *get(); }
+
+    /**
+     * Returns the current version
+     */
+    const T* operator->() const noexcept { return get(); }
+
+    /**
+     * Publishes a new version
+     */
+    void update(std::unique_ptr<T> p)
+    {
+        std::lock_guard<detail::spinlock> lock(mtx_);
+        publish(p.release());
+    }
+
+    /**
+     * Publishes a new version
+     */
+    void update(T value) { update(std::unique_ptr<T>(new T(std::move(value)))); }
+
+    /**
+     * Copies the current version, applies `fn` to the copy and publishes it
+     */
+    template <typename Fn>
+    void modify(Fn&& fn)
+    {
+        std::lock_guard<detail::spinlock> lock(mtx_);
+        std::unique_ptr<T> p(new T(*ptr_.load(std::memory_order_relaxed)));
+        fn(*p);
+        publish(p.release());
+    }
+
+private:
+    /// non-copyable
+    snapshot(const snapshot&) = delete;
+
+    void operator=(const snapshot&) = delete;
+
+    void publish(T* p)
+    {
+        T* old = ptr_.exchange(p, std::memory_order_seq_cst);
+        detail::rcu_retire(new detail::rcu_object<T>(old));
+    }
+
+    std::atomic<T*> ptr_;
+    detail::spinlock mtx_;
+};
+
+} // End of namespace fibers
+
+using fibers::snapshot;
+
+} // End of namespace fibio
+
+#endif
@@ -10,9 +10,12 @@
 #define fibio_future_hpp
 
 #include <fibio/fibers/future/future_status.hpp>
+#include <fibio/fibers/future/allocator.hpp>
+#include <fibio/fibers/future/launch.hpp>
 #include <fibio/fibers/future/future.hpp>
 #include <fibio/fibers/future/packaged_task.hpp>
 #include <fibio/fibers/future/promise.hpp>
 #include <fibio/fibers/future/async.hpp>
+#include <fibio/fibers/coroutine.hpp>
 
 #endif
@@ -11,5 +11,8 @@
 
 #include <fibio/stream/iostream.hpp>
 #include <fibio/stream/fstream.hpp>
+#if !defined(_WIN32)
+#include <fibio/stream/mmap_stream.hpp>
+#endif
 
 #endif
@@ -0,0 +1,149 @@
+//
+//  mmap_stream.hpp
+//  fibio
+//
+
+#ifndef fibio_stream_mmap_stream_hpp
+#define fibio_stream_mmap_stream_hpp
+
+#if defined(_WIN32)
+#error "Memory-mapped streams are not supported on Windows"
+#endif
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <fibio/stream/fstream.hpp>
+
+namespace fibio {
+namespace stream {
+
+/**
+ * class mmap_streambuf
+ *
+ * Read-only stream buffer over a memory-mapped file, the whole mapping is the get area so reading
+ * doesn't copy the file into stream buffers, and `data()` gives direct access to the content.
+ *
+ * Opening the file and mapping it are run by the executor, page faults on first access are taken
+ * by the reading thread, use `prefetch` to have the kernel read the pages ahead.
+ * NOTE: The file must not be truncated while mapped.
+ */
+class mmap_streambuf : public std::streambuf
+{
+public:
+    /// constructor
+    mmap_streambuf();
+
+    /// destructor, unmaps the file
+    virtual ~mmap_streambuf();
+
+    /// Checks if a file is mapped
+    bool is_open() const { return data_ != nullptr || mapped_empty_; }
+
+    /// Maps the file, returns nullptr on failure or if a file is already mapped
+    mmap_streambuf* open(const char* s);
+
+    mmap_streambuf* open(const std::string& s) { return open(s.c_str()); }
+
+    /// Unmaps the file, returns nullptr if no file is mapped
+    mmap_streambuf* close();
+
+    /// Content of the file, nullptr if the file is empty or not mapped
+    const char* data() const { return data_; }
+
+    /// Size of the file
+    size_t size() const { return size_; }
+
+    /**
+     * Asks the kernel to read ahead `length` bytes from `offset` into the page cache, the advice
+     * is given by the executor, the returned future is ready once it's given
+     * NOTE: The file must stay mapped until the future is ready
+     */
+    fibers::future<bool> prefetch(size_t offset = 0, size_t length = size_t(-1));
+
+    /// Sets the executor running blocking operations
+    void set_executor(std::shared_ptr<fibers::foreign_thread_pool> e) { executor_ = e; }
+
+protected:
+    virtual std::streamsize showmanyc() override;
+    virtual pos_type seekoff(off_type off,
+                             std::ios_base::seekdir way,
+                             std::ios_base::openmode which = std::ios_base::in) override;
+    virtual pos_type seekpos(pos_type sp,
+                             std::ios_base::openmode which = std::ios_base::in) override;
+
+private:
+    mmap_streambuf(const mmap_streambuf&) = delete;
+
+    void operator=(const mmap_streambuf&) = delete;
+
+    char* data_;
+    size_t size_;
+    // Empty files cannot be mapped
+    bool mapped_empty_;
+    std::shared_ptr<fibers::foreign_thread_pool> executor_;
+};
+
+/**
+ * class mmap_istream
+ *
+ * Input stream over a memory-mapped file
+ */
+class mmap_istream : public std::istream
+{
+public:
+    /// constructor
+    mmap_istream() : std::istream(&sb_) {}
+
+    /// constructor, maps the file
+    explicit mmap_istream(const char* s) : std::istream(&sb_) { open(s); }
+
+    explicit mmap_istream(const std::string& s) : mmap_istream(s.c_str()) {}
+
+    mmap_streambuf* rdbuf() const { return const_cast<mmap_streambuf*>(&sb_); }
+
+    bool is_open() const { return sb_.is_open(); }
+
+    void open(const char* s)
+    {
+        if (sb_.open(s))
+            clear();
+        else
+            setstate(std::ios_base::failbit);
+    }
+
+    void open(const std::string& s) { open(s.c_str()); }
+
+    void close()
+    {
+        if (sb_.close() == nullptr) setstate(std::ios_base::failbit);
+    }
+
+    /// Content of the file
+    const char* data() const { return sb_.data(); }
+
+    /// Size of the file
+    size_t size() const { return sb_.size(); }
+
+    /// Asks the kernel to read ahead part of the file
+    fibers::future<bool> prefetch(size_t offset = 0, size_t length = size_t(-1))
+    {
+        return sb_.prefetch(offset, length);
+    }
+
+    void set_executor(std::shared_ptr<fibers::foreign_thread_pool> e) { sb_.set_executor(e); }
+
+private:
+    mmap_streambuf sb_;
+};
+
+} // End of namespace stream
+
+using stream::mmap_streambuf;
+using stream::mmap_istream;
+
+} // End of namespace fibio
+
+#endif
@@ -17,6 +17,7 @@
 #include <boost/asio/basic_stream_socket.hpp>
 #include <boost/asio/ssl/stream_base.hpp>
 #include <fibio/fibers/fiber.hpp>
+#include <fibio/fibers/cancellation.hpp>
 #include <fibio/fibers/asio/yield.hpp>
 
 namespace boost {
@@ -80,7 +81,8 @@ public:
           //, put_buffer_(std::move(other.put_buffer_))
           ,
           unbuffered_(other.unbuffered_),
-          duplex_mode_(other.duplex_mode_)
+          duplex_mode_(other.duplex_mode_),
+          cancellable_(other.cancellable_)
     {
         init_buffers();
     }
@@ -95,6 +97,14 @@ public:
 
     duplex_mode get_duplex_mode() const { return duplex_mode_; }
 
+    /**
+     * Sets if reading and writing fail once the cancellation token bound to the calling fiber is
+     * cancelled, true by default, turn it off for streams shared by fibers of different tokens
+     */
+    void set_cancellable(bool c) { cancellable_ = c; }
+
+    bool is_cancellable() const { return cancellable_; }
+
 protected:
     pos_type
     seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
@@ -124,6 +134,9 @@ protected:
     {
         if (duplex_mode_ == half_duplex) sync();
         if (gptr() == egptr()) {
+            // Reading fails once the token bound to the fiber is cancelled
+            fibers::asio::cancellation_guard guard(base_type::lowest_layer(), cancellable_);
+            if (guard.cancelled()) return traits_type::eof();
             boost::system::error_code ec;
             // size_t bytes_transferred=base_type::read_some(boost::asio::buffer(&get_buffer_[0]+
             // putback_max, buffer_size-putback_max),
@@ -145,12 +158,15 @@ protected:
 
     int_type overflow(int_type c) override
     {
+        // Writing fails once the token bound to the fiber is cancelled
+        fibers::asio::cancellation_guard guard(base_type::lowest_layer(), cancellable_);
         boost::system::error_code ec;
         if (unbuffered_) {
             if (traits_type::eq_int_type(c, traits_type::eof())) {
                 // Nothing to do.
                 return traits_type::not_eof(c);
             } else {
+                if (guard.cancelled()) return traits_type::eof();
                 char c_ = c;
                 // base_type::write_some(boost::asio::buffer(&c_, 1),
                 //                      ec);
@@ -162,6 +178,7 @@ protected:
             char* ptr = pbase();
             size_t size = pptr() - pbase();
             while (size > 0) {
+                if (guard.cancelled()) return traits_type::eof();
                 // size_t bytes_transferred=base_type::write_some(boost::asio::buffer(ptr, size),
                 //                                               ec);
                 size_t bytes_transferred = base_type::async_write_some(
@@ -221,6 +238,7 @@ private:
     std::vector<char> put_buffer_;
     bool unbuffered_ = false;
     duplex_mode duplex_mode_ = half_duplex;
+    bool cancellable_ = true;
 };
 
 template <typename Stream>
@@ -244,6 +262,9 @@ public:
     template <typename Arg>
     boost::system::error_code connect(const Arg& arg)
     {
+        fibers::asio::cancellation_guard guard(base_type::lowest_layer(),
+                                               base_type::is_cancellable());
+        if (guard.cancelled()) return boost::asio::error::operation_aborted;
         boost::system::error_code ec;
         base_type::async_connect(arg, fibers::asio::yield[ec]);
         return ec;
@@ -268,9 +289,13 @@ public:
     template <typename Arg>
     boost::system::error_code connect(const Arg& arg)
     {
+        fibers::asio::cancellation_guard guard(base_type::lowest_layer(),
+                                               base_type::is_cancellable());
+        if (guard.cancelled()) return boost::asio::error::operation_aborted;
         boost::system::error_code ec;
         base_type::next_layer().async_connect(arg, fibers::asio::yield[ec]);
         if (ec) return ec;
+        if (guard.cancelled()) return boost::asio::error::operation_aborted;
         base_type::async_handshake(boost::asio::ssl::stream_base::client, fibers::asio::yield[ec]);
         return ec;
     }
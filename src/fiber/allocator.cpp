@@ -0,0 +1,144 @@
+//
+//  allocator.cpp
+//  fibio
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <fibio/fibers/future/allocator.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+namespace {
+// Blocks are rounded up to multiples of the granularity, which keeps them aligned for any type
+constexpr std::size_t pool_granularity = alignof(std::max_align_t);
+constexpr std::size_t pool_classes = 32;
+constexpr std::size_t pool_max_size = pool_granularity * pool_classes;
+// Blocks beyond this go back to the global heap
+constexpr std::size_t pool_max_cached = 256;
+
+struct free_block
+{
+    free_block* next_;
+};
+
+// Set once the cache of the thread is gone, later blocks go to the global heap
+thread_local bool pool_destroyed = false;
+
+struct pool_cache
+{
+    ~pool_cache()
+    {
+        pool_destroyed = true;
+        for (std::size_t i = 0; i < pool_classes; i++) {
+            while (free_block* b = heads_[i]) {
+                heads_[i] = b->next_;
+                ::operator delete(b);
+            }
+        }
+    }
+
+    free_block* heads_[pool_classes] = {};
+    std::size_t counts_[pool_classes] = {};
+};
+
+pool_cache* local_pool()
+{
+    if (pool_destroyed) return nullptr;
+    static thread_local pool_cache cache;
+    return &cache;
+}
+
+inline std::size_t size_class(std::size_t size)
+{
+    return (std::max<std::size_t>(size, 1) - 1) / pool_granularity;
+}
+} // End of anonymous namespace
+
+void* pool_allocate(std::size_t size)
+{
+    if (size > pool_max_size) return ::operator new(size);
+    std::size_t c = size_class(size);
+    pool_cache* cache = local_pool();
+    if (cache && cache->heads_[c]) {
+        free_block* b = cache->heads_[c];
+        cache->heads_[c] = b->next_;
+        cache->counts_[c]--;
+        return b;
+    }
+    return ::operator new((c + 1) * pool_granularity);
+}
+
+void pool_deallocate(void* p, std::size_t size) noexcept
+{
+    if (!p) return;
+    if (size > pool_max_size) {
+        ::operator delete(p);
+        return;
+    }
+    std::size_t c = size_class(size);
+    pool_cache* cache = local_pool();
+    if (!cache || cache->counts_[c] >= pool_max_cached) {
+        ::operator delete(p);
+        return;
+    }
+    free_block* b = static_cast<free_block*>(p);
+    b->next_ = cache->heads_[c];
+    cache->heads_[c] = b;
+    cache->counts_[c]++;
+}
+
+void* aligned_allocate(std::size_t size, std::size_t align)
+{
+    // Over-allocate and keep the pointer to free right before the aligned block
+    void* raw = ::operator new(size + align + sizeof(void*));
+    uintptr_t p = reinterpret_cast<uintptr_t>(raw) + sizeof(void*);
+    p = (p + align - 1) & ~uintptr_t(align - 1);
+    reinterpret_cast<void**>(p)[-1] = raw;
+    return reinterpret_cast<void*>(p);
+}
+
+void aligned_deallocate(void* p) noexcept
+{
+    if (p) ::operator delete(static_cast<void**>(p)[-1]);
+}
+
+} // End of namespace detail
+
+arena::arena(std::size_t chunk_size) : chunk_size_(std::max<std::size_t>(chunk_size, 256))
+{
+}
+
+arena::~arena()
+{
+    while (chunks_) {
+        chunk* c = chunks_;
+        chunks_ = c->next_;
+        ::operator delete(c);
+    }
+}
+
+void* arena::allocate(std::size_t size, std::size_t align)
+{
+    std::lock_guard<detail::spinlock> lock(mtx_);
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~uintptr_t(align - 1);
+    if (!cur_ || p + size > reinterpret_cast<uintptr_t>(end_)) {
+        // Oversized requests get a chunk of their own
+        std::size_t n = std::max(chunk_size_, sizeof(chunk) + size + align);
+        chunk* c = static_cast<chunk*>(::operator new(n));
+        c->next_ = chunks_;
+        chunks_ = c;
+        cur_ = reinterpret_cast<char*>(c + 1);
+        end_ = reinterpret_cast<char*>(c) + n;
+        p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~uintptr_t(align - 1);
+    }
+    cur_ = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+}
+
+} // End of namespace fibers
+} // End of namespace fibio
@@ -0,0 +1,226 @@
+//
+//  cancellation.cpp
+//  fibio
+//
+
+#include <mutex>
+#include <fibio/fibers/cancellation.hpp>
+#include <fibio/fibers/exceptions.hpp>
+#include "cancellation_state.hpp"
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+
+static const auto NOT_A_FIBER = fibio::fiber_exception(boost::system::errc::no_such_process);
+
+namespace detail {
+
+bool cancellation_state::cancel()
+{
+    std::unique_lock<spinlock> lock(mtx_);
+    if (cancelled_.load(std::memory_order_relaxed)) return false;
+    cancelled_.store(true, std::memory_order_release);
+    runner_ = std::this_thread::get_id();
+    while (cancellation_callback* cb = head_) {
+        unlink(cb);
+        running_.store(cb, std::memory_order_relaxed);
+        // Callbacks may register or deregister others
+        lock.unlock();
+        cb->fn_(cb);
+        lock.lock();
+        running_.store(nullptr, std::memory_order_release);
+    }
+    return true;
+}
+
+bool cancellation_state::add(cancellation_callback* cb)
+{
+    std::lock_guard<spinlock> lock(mtx_);
+    if (cancelled_.load(std::memory_order_relaxed)) return false;
+    cb->prev_ = nullptr;
+    cb->next_ = head_;
+    if (head_) head_->prev_ = cb;
+    head_ = cb;
+    cb->linked_ = true;
+    return true;
+}
+
+void cancellation_state::remove(cancellation_callback* cb)
+{
+    {
+        std::lock_guard<spinlock> lock(mtx_);
+        if (cb->linked_) {
+            unlink(cb);
+            return;
+        }
+        if (running_.load(std::memory_order_relaxed) != cb
+            || runner_ == std::this_thread::get_id()) {
+            // Never registered, already called, or deregistered by itself
+            return;
+        }
+    }
+    // The callback is running in another thread, it's short
+    while (running_.load(std::memory_order_acquire) == cb) {
+        std::this_thread::yield();
+    }
+}
+
+void cancellation_state::unlink(cancellation_callback* cb)
+{
+    if (cb->prev_)
+        cb->prev_->next_ = cb->next_;
+    else
+        head_ = cb->next_;
+    if (cb->next_) cb->next_->prev_ = cb->prev_;
+    cb->prev_ = cb->next_ = nullptr;
+    cb->linked_ = false;
+}
+
+} // End of namespace detail
+
+bool cancellation_token::is_cancelled() const noexcept
+{
+    return state_ && state_->cancelled();
+}
+
+void cancellation_token::throw_if_cancelled() const
+{
+    if (is_cancelled()) {
+        BOOST_THROW_EXCEPTION(operation_cancelled());
+    }
+}
+
+cancellation_source::cancellation_source() : state_(std::make_shared<detail::cancellation_state>())
+{
+}
+
+bool cancellation_source::cancel()
+{
+    return state_->cancel();
+}
+
+bool cancellation_source::is_cancelled() const noexcept
+{
+    return state_->cancelled();
+}
+
+cancellation_registration::cancellation_registration(const cancellation_token& token,
+                                                     std::function<void()> fn)
+: fn_(std::move(fn)), cb_(&cancellation_registration::invoke, this)
+{
+    if (!token.state_) return;
+    if (token.state_->add(&cb_)) {
+        state_ = token.state_;
+    } else {
+        fn_();
+    }
+}
+
+cancellation_registration::~cancellation_registration()
+{
+    if (state_) state_->remove(&cb_);
+}
+
+void cancellation_registration::invoke(detail::cancellation_callback* cb)
+{
+    static_cast<cancellation_registration*>(cb->data_)->fn_();
+}
+
+namespace asio {
+namespace detail {
+
+// Shared with canceling handlers posted to the fiber strand, which may run after the I/O object
+// is gone
+struct io_cancellation::target
+{
+    fibers::detail::fiber_object::strand_ptr_t strand_;
+    bool alive_ = true;
+};
+
+io_cancellation::io_cancellation(cancel_fn_t fn, void* io, bool enabled)
+: fn_(fn), io_(io), cb_(&io_cancellation::invoke, this)
+{
+    fibers::detail::fiber_object* cf = current_fiber();
+    if (!enabled || !cf || !cf->cancellation_) return;
+    state_ = cf->cancellation_;
+    if (state_->cancelled()) return;
+    target_ = std::make_shared<target>();
+    target_->strand_ = cf->fiber_strand_;
+    // Fails if cancelled in between, `cancelled()` tells the caller
+    state_->add(&cb_);
+}
+
+io_cancellation::~io_cancellation()
+{
+    if (!target_) return;
+    state_->remove(&cb_);
+    // Handlers are serialized with the fiber by the strand, so the flag needs no lock
+    target_->alive_ = false;
+}
+
+bool io_cancellation::cancelled() const noexcept
+{
+    return state_ && state_->cancelled();
+}
+
+void io_cancellation::invoke(fibers::detail::cancellation_callback* cb)
+{
+    io_cancellation* self = static_cast<io_cancellation*>(cb->data_);
+    // I/O objects are not thread-safe, they're canceled in the strand while the fiber is waiting
+    std::shared_ptr<target> t = self->target_;
+    cancel_fn_t fn = self->fn_;
+    void* io = self->io_;
+    t->strand_->post([t, fn, io]() {
+        if (t->alive_) fn(io);
+    });
+}
+
+} // End of namespace detail
+} // End of namespace asio
+
+namespace this_fiber {
+
+cancellation_scope::cancellation_scope(const cancellation_token& token)
+{
+    if (auto cf = current_fiber()) {
+        prev_ = std::move(cf->cancellation_);
+        cf->cancellation_ = token.state_;
+    } else {
+        BOOST_THROW_EXCEPTION(NOT_A_FIBER);
+    }
+}
+
+cancellation_scope::~cancellation_scope()
+{
+    if (auto cf = current_fiber()) {
+        cf->cancellation_ = std::move(prev_);
+    }
+}
+
+cancellation_token get_cancellation_token()
+{
+    if (auto cf = current_fiber()) {
+        return cancellation_token(cf->cancellation_);
+    }
+    BOOST_THROW_EXCEPTION(NOT_A_FIBER);
+}
+
+bool cancellation_requested() noexcept
+{
+    if (auto cf = current_fiber()) {
+        return cf->cancellation_ && cf->cancellation_->cancelled();
+    }
+    return false;
+}
+
+void cancellation_point()
+{
+    if (cancellation_requested()) {
+        BOOST_THROW_EXCEPTION(operation_cancelled());
+    }
+}
+
+} // End of namespace this_fiber
+} // End of namespace fibers
+} // End of namespace fibio
@@ -0,0 +1,77 @@
+//
+//  cancellation_state.hpp
+//  fibio
+//
+
+#ifndef fibio_cancellation_state_hpp
+#define fibio_cancellation_state_hpp
+
+#include <atomic>
+#include <thread>
+#include <fibio/fibers/cancellation.hpp>
+#include <fibio/fibers/detail/spinlock.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/**
+ * class cancellation_state
+ *
+ * Shared by a cancellation_source and its tokens, keeps callbacks registered by waiting fibers
+ * in an intrusive list, registering and deregistering are O(1) and never allocate.
+ */
+class cancellation_state
+{
+public:
+    /// Checks if the cancellation is requested
+    bool cancelled() const noexcept { return cancelled_.load(std::memory_order_acquire); }
+
+    /**
+     * Requests cancellation and calls all registered callbacks, returns false if the cancellation
+     * was already requested
+     */
+    bool cancel();
+
+    /**
+     * Registers the callback, returns false without registering if the cancellation is already
+     * requested
+     */
+    bool add(cancellation_callback* cb);
+
+    /**
+     * Deregisters the callback, if the callback is running in another thread, waits until it's
+     * done, so it can be destroyed after this returns
+     */
+    void remove(cancellation_callback* cb);
+
+private:
+    void unlink(cancellation_callback* cb);
+
+    spinlock mtx_;
+    std::atomic<bool> cancelled_{false};
+    cancellation_callback* head_ = nullptr;
+    // The callback being called by the thread requesting the cancellation
+    std::atomic<cancellation_callback*> running_{nullptr};
+    std::thread::id runner_;
+};
+
+/**
+ * Deregisters a callback when the waiter leaves, the callback may not be registered
+ */
+struct cancellation_callback_guard
+{
+    cancellation_state* state_;
+    cancellation_callback& cb_;
+
+    ~cancellation_callback_guard()
+    {
+        if (state_) state_->remove(&cb_);
+    }
+};
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
+
+#endif
@@ -0,0 +1,120 @@
+//
+//  combiner.cpp
+//  fibio
+//
+
+#include <thread>
+#include <fibio/fibers/fiber.hpp>
+#include <fibio/fibers/combiner.hpp>
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+constexpr unsigned combiner_base::max_batches;
+
+namespace {
+void finish(combining_op* op, combining_op::state_t state)
+{
+    int old = op->state_.exchange(state, std::memory_order_acq_rel);
+    if (old == combining_op::PARKED) {
+        // The publisher cannot go away before it's resumed
+        fiber_base::ptr_t f(std::move(op->fiber_));
+        f->resume();
+    }
+}
+} // End of anonymous namespace
+
+void combiner_base::execute(combining_op* op)
+{
+    op->next_ = pending_.load(std::memory_order_relaxed);
+    while (!pending_.compare_exchange_weak(op->next_, op, std::memory_order_seq_cst)) {
+    }
+    if (!combining_.exchange(true, std::memory_order_seq_cst)) {
+        // This operation is in the published list, it's applied in the first batch
+        combine(nullptr);
+        return;
+    }
+    if (wait(op) == combining_op::COMBINE) {
+        // Combining has been handed over with the rest of a batch, led by this operation
+        combine(op);
+    }
+}
+
+combining_op::state_t combiner_base::wait(combining_op* op)
+{
+    if (!current_fiber()) {
+        // Foreign thread, operations are short
+        int s;
+        while ((s = op->state_.load(std::memory_order_acquire)) == combining_op::WAITING) {
+            std::this_thread::yield();
+        }
+        return combining_op::state_t(s);
+    }
+    // The operation will be applied anyway, and a fiber chosen to be the next combiner must not
+    // leave, so the wait cannot be interrupted
+    this_fiber::disable_interruption di;
+    auto tf = current_fiber_ptr();
+    op->fiber_ = tf;
+    int expected = combining_op::WAITING;
+    if (op->state_.compare_exchange_strong(expected,
+                                           combining_op::PARKED,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+        tf->pause();
+    } else {
+        op->fiber_.reset();
+    }
+    return combining_op::state_t(op->state_.load(std::memory_order_acquire));
+}
+
+combining_op* combiner_base::take()
+{
+    combining_op* op = pending_.exchange(nullptr, std::memory_order_acquire);
+    combining_op* batch = nullptr;
+    while (op) {
+        combining_op* next = op->next_;
+        op->next_ = batch;
+        batch = op;
+        op = next;
+    }
+    return batch;
+}
+
+void combiner_base::combine(combining_op* batch)
+{
+    for (unsigned n = 0;; n++) {
+        if (!batch) batch = take();
+        if (!batch) {
+            combining_.store(false, std::memory_order_seq_cst);
+            // A fiber may have published an operation and seen the combiner busy before the
+            // release, either apply it or leave it to the fiber which just became the combiner
+            if (!pending_.load(std::memory_order_seq_cst)
+                || combining_.exchange(true, std::memory_order_seq_cst)) {
+                return;
+            }
+            continue;
+        }
+        if (n >= max_batches) {
+            // Operation of this fiber has been applied in the first batch, hand over the rest
+            finish(batch, combining_op::COMBINE);
+            return;
+        }
+        while (batch) {
+            // The operation may go away as soon as it's finished
+            combining_op* next = batch->next_;
+            try {
+                batch->run();
+            } catch (...) {
+                batch->exception_ = std::current_exception();
+            }
+            finish(batch, combining_op::DONE);
+            batch = next;
+        }
+    }
+}
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
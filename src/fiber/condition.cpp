@@ -8,98 +8,204 @@
 
 #include <boost/system/error_code.hpp>
 #include <fibio/fibers/condition_variable.hpp>
+#include <fibio/fibers/profiler.hpp>
+#include "cancellation_state.hpp"
 #include "fiber_object.hpp"
+#include "scheduler_object.hpp"
+#include "timer_service.hpp"
 
 namespace fibio {
 namespace fibers {
 
 static const auto NOPERM = condition_error(boost::system::errc::operation_not_permitted);
 
+bool condition_variable::owns(mutex* m)
+{
+    if (auto cf = current_fiber()) return m->owner_.get() == cf;
+    return m->thread_owner_ == std::this_thread::get_id();
+}
+
 void condition_variable::wait(std::unique_lock<mutex>& lock)
 {
-    auto tf = current_fiber_ptr();
     mutex* m = lock.mutex();
-    if (tf != m->owner_) {
+    if (!owns(m)) {
         // This fiber doesn't own the mutex
         BOOST_THROW_EXCEPTION(NOPERM);
     }
+    detail::contention_sample sample(profiled_);
+    if (!current_fiber()) {
+        wait_in_thread(lock);
+        sample.record(this, lock_kind::condition_variable, FIBIO_RETURN_ADDRESS());
+        return;
+    }
+    auto tf = current_fiber_ptr();
+    if (tf->cancellation_) {
+        // The wait may end before notified
+        wait_in_fiber(lock, nullptr);
+        sample.record(this, lock_kind::condition_variable, FIBIO_RETURN_ADDRESS());
+        return;
+    }
+    detail::wait_node node;
+    node.f_ = tf;
     {
         std::lock_guard<detail::spinlock> lock(mtx_);
         // The "suspension of this fiber" is actually happened here, not the pause()
         // as other will see there is a fiber in the waiting queue.
-        suspended_.push_back(suspended_item({m, tf, 0}));
+        suspended_.push_back(&node);
     }
     {
         detail::relock_guard<mutex> relock(*m);
         tf->pause();
     }
+    sample.record(this, lock_kind::condition_variable, FIBIO_RETURN_ADDRESS());
 }
 
-void condition_variable::timeout_handler(detail::fiber_ptr_t this_fiber,
-                                         detail::timer_t* t,
-                                         cv_status& ret,
-                                         boost::system::error_code ec)
+void condition_variable::wait_in_thread(std::unique_lock<mutex>& lock)
 {
-    if (!ec) {
-        // Timeout
-        // Timeout handler, find and remove this fiber from waiting queue
+    mutex* m = lock.mutex();
+    detail::thread_waiter tw;
+    detail::wait_node node;
+    node.tw_ = &tw;
+    {
         std::lock_guard<detail::spinlock> lock(mtx_);
-        ret = cv_status::timeout;
-        // Find and remove this fiber from waiting queue
-        auto i = std::find(suspended_.begin(), suspended_.end(), this_fiber);
-        if (i != suspended_.end()) {
-            suspended_.erase(i);
-        }
+        suspended_.push_back(&node);
+    }
+    {
+        detail::relock_guard<mutex> relock(*m);
+        tw.wait();
     }
-    this_fiber->resume();
+}
+
+namespace {
+// A timed or cancellable waiter, lives on the stack of the waiting fiber
+struct timed_wait_node : detail::wait_node
+{
+    timed_wait_node(condition_variable* cv,
+                    detail::timer_entry::callback_t fn,
+                    detail::cancellation_callback::callback_t cancel_fn)
+    : cv_(cv), entry_(fn, this), cancel_(cancel_fn, this)
+    {
+    }
+
+    condition_variable* cv_;
+    detail::timer_entry entry_;
+    detail::cancellation_callback cancel_;
+    bool timed_out_ = false;
+    bool cancelled_ = false;
+};
+} // End of anonymous namespace
+
+void condition_variable::timeout_handler(detail::timer_entry* e)
+{
+    timed_wait_node* node = static_cast<timed_wait_node*>(e->data_);
+    node->cv_->expire(node, node->timed_out_);
+}
+
+void condition_variable::cancel_handler(detail::cancellation_callback* cb)
+{
+    timed_wait_node* node = static_cast<timed_wait_node*>(cb->data_);
+    node->cv_->expire(node, node->cancelled_);
+}
+
+void condition_variable::expire(detail::wait_node* node, bool& flag)
+{
+    std::lock_guard<detail::spinlock> lock(mtx_);
+    if (!node->linked_) {
+        // Already notified or expired, the notifier resumes the fiber
+        return;
+    }
+    // O(1) removal from the waiting queue
+    suspended_.erase(node);
+    flag = true;
+    detail::fiber_ptr_t f(std::move(node->f_));
+    f->resume();
 }
 
 cv_status condition_variable::wait_rel(std::unique_lock<mutex>& lock, detail::duration_t d)
 {
-    auto tf = current_fiber_ptr();
     mutex* m = lock.mutex();
-    cv_status ret = cv_status::no_timeout;
-    if (tf != m->owner_) {
+    if (!owns(m)) {
         // This fiber doesn't own the mutex
         BOOST_THROW_EXCEPTION(NOPERM);
     }
-    detail::timer_t t(tf->get_io_service());
+    detail::contention_sample sample(profiled_);
+    cv_status ret;
+    if (!current_fiber()) {
+        ret = wait_rel_in_thread(lock, d);
+    } else {
+        detail::time_point_t deadline = std::chrono::steady_clock::now() + d;
+        ret = wait_in_fiber(lock, &deadline);
+    }
+    sample.record(this, lock_kind::condition_variable, FIBIO_RETURN_ADDRESS());
+    return ret;
+}
+
+cv_status condition_variable::wait_in_fiber(std::unique_lock<mutex>& lock,
+                                            const detail::time_point_t* deadline)
+{
+    mutex* m = lock.mutex();
+    auto tf = current_fiber_ptr();
+    detail::cancellation_state* cs = tf->cancellation_.get();
+    if (cs && cs->cancelled()) BOOST_THROW_EXCEPTION(operation_cancelled());
+    timed_wait_node node(
+        this, &condition_variable::timeout_handler, &condition_variable::cancel_handler);
+    node.f_ = tf;
+    detail::timer_service& timers = tf->sched_->timers_;
     {
         std::lock_guard<detail::spinlock> lock(mtx_);
-        suspended_.push_back(suspended_item({m, tf, &t}));
-        t.expires_from_now(d);
-        t.async_wait(tf->get_fiber_strand().wrap(std::bind(&condition_variable::timeout_handler,
-                                                           this,
-                                                           tf,
-                                                           &t,
-                                                           std::ref(ret),
-                                                           std::placeholders::_1)));
+        suspended_.push_back(&node);
+        if (deadline) timers.schedule(&node.entry_, *deadline);
+    }
+    if (cs && !cs->add(&node.cancel_)) {
+        // Cancelled in between
+        cancel_handler(&node.cancel_);
+        cs = nullptr;
     }
     {
+        detail::timer_entry_guard guard{timers, node.entry_};
+        detail::cancellation_callback_guard cancel_guard{cs, node.cancel_};
         detail::relock_guard<mutex> relock(*m);
         tf->pause();
     }
-    return ret;
+    if (node.cancelled_) BOOST_THROW_EXCEPTION(operation_cancelled());
+    return node.timed_out_ ? cv_status::timeout : cv_status::no_timeout;
+}
+
+cv_status condition_variable::wait_rel_in_thread(std::unique_lock<mutex>& lock,
+                                                 detail::duration_t d)
+{
+    mutex* m = lock.mutex();
+    detail::thread_waiter tw;
+    detail::wait_node node;
+    node.tw_ = &tw;
+    {
+        std::lock_guard<detail::spinlock> lock(mtx_);
+        suspended_.push_back(&node);
+    }
+    detail::relock_guard<mutex> relock(*m);
+    if (tw.wait_until(std::chrono::steady_clock::now() + d)) return cv_status::no_timeout;
+    {
+        std::lock_guard<detail::spinlock> lock(mtx_);
+        if (node.linked_) {
+            suspended_.erase(&node);
+            return cv_status::timeout;
+        }
+    }
+    // Notified right after timed out, wait until the notifier is done with the node
+    tw.wait();
+    return cv_status::no_timeout;
 }
 
 void condition_variable::notify_one()
 {
     {
         std::lock_guard<detail::spinlock> lock(mtx_);
-        if (suspended_.empty()) {
+        detail::wait_node* node = suspended_.pop_front();
+        if (!node) {
             return;
         }
-        suspended_item p(suspended_.front());
-        suspended_.pop_front();
-        if (p.t_) {
-            // Cancel attached timer if it's set
-            // Timer handler will reschedule the waiting fiber
-            p.t_->cancel();
-            p.t_ = 0;
-        } else {
-            // No timer attached to the waiting fiber, directly schedule it
-            p.f_->resume();
-        }
+        // The waiter cancels its own timer, if any
+        detail::wake_waiter(node);
     }
     // Only yield if currently in a fiber
     // CV can be used to notify a fiber from not-a-fiber, i.e. foreign thread
@@ -112,17 +218,8 @@ void condition_variable::notify_all()
 {
     {
         std::lock_guard<detail::spinlock> lock(mtx_);
-        while (!suspended_.empty()) {
-            suspended_item p(suspended_.front());
-            suspended_.pop_front();
-            if (p.t_) {
-                // Cancel attached timer if it's set
-                // Timer handler will reschedule the waiting fiber
-                p.t_->cancel();
-            } else {
-                // No timer attached to the waiting fiber, directly schedule it
-                p.f_->resume();
-            }
+        while (detail::wait_node* node = suspended_.pop_front()) {
+            detail::wake_waiter(node);
         }
     }
     // Only yield if currently in a fiber
@@ -0,0 +1,182 @@
+//
+//  cpu_pool.cpp
+//  fibio
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fibio/fibers/cpu_pool.hpp>
+#include <fibio/fibers/detail/parking_queue.hpp>
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+
+namespace detail {
+// Intrusive FIFO of jobs, jobs are owned by the submitting fibers
+struct cpu_job_list
+{
+    cpu_job* head_ = nullptr;
+    cpu_job* tail_ = nullptr;
+
+    bool empty() const { return !head_; }
+
+    void push_back(cpu_job* j)
+    {
+        j->next_ = nullptr;
+        if (tail_)
+            tail_->next_ = j;
+        else
+            head_ = j;
+        tail_ = j;
+    }
+
+    cpu_job* pop_front()
+    {
+        cpu_job* j = head_;
+        if (j) {
+            head_ = j->next_;
+            if (!head_) tail_ = nullptr;
+        }
+        return j;
+    }
+};
+} // End of namespace detail
+
+struct cpu_pool_impl
+{
+    cpu_pool_impl(cpu_pool::attributes attrs)
+    : capacity_(attrs.queue_capacity ? attrs.queue_capacity : 1)
+    {
+        size_t n = attrs.threads;
+        if (n == 0) n = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < n; i++) {
+            threads_.emplace_back([this]() { run_in_this_thread(); });
+        }
+    }
+
+    ~cpu_pool_impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stopped_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    // Takes a slot for a job, returns false if the queue is full
+    bool try_reserve()
+    {
+        size_t n = reserved_.load(std::memory_order_seq_cst);
+        while (n < capacity_) {
+            if (reserved_.compare_exchange_weak(n, n + 1, std::memory_order_seq_cst)) return true;
+        }
+        return false;
+    }
+
+    void submit(detail::cpu_job* job)
+    {
+        // Park the submitting fiber until there is room in the queue
+        while (!room_.park_unless([this]() { return try_reserve(); })) {
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            queue_.push_back(job);
+        }
+        cv_.notify_one();
+    }
+
+    void run_in_this_thread()
+    {
+        for (;;) {
+            detail::cpu_job* job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                while (!stopped_ && queue_.empty()) {
+                    cv_.wait(lock);
+                }
+                if (queue_.empty()) {
+                    // Stopped and all jobs are done
+                    return;
+                }
+                job = queue_.pop_front();
+            }
+            // Give back the slot and admit a parked submitter
+            reserved_.fetch_sub(1, std::memory_order_seq_cst);
+            room_.unpark();
+            try {
+                job->run();
+            } catch (...) {
+                job->exception_ = std::current_exception();
+            }
+            // The job may be gone as soon as the fiber is resumed, take the fiber out first
+            detail::fiber_base::ptr_t f(std::move(job->fiber_));
+            f->resume();
+        }
+    }
+
+    const size_t capacity_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    detail::cpu_job_list queue_;
+    // Jobs submitted and not yet picked up
+    std::atomic<size_t> reserved_{0};
+    detail::parking_queue room_;
+    bool stopped_ = false;
+    std::vector<std::thread> threads_;
+};
+
+cpu_pool::cpu_pool() : impl_(new cpu_pool_impl(attributes()))
+{
+}
+
+cpu_pool::cpu_pool(attributes attrs) : impl_(new cpu_pool_impl(attrs))
+{
+}
+
+cpu_pool::~cpu_pool()
+{
+}
+
+size_t cpu_pool::size() const
+{
+    return impl_->threads_.size();
+}
+
+size_t cpu_pool::queued() const
+{
+    return impl_->reserved_.load(std::memory_order_relaxed);
+}
+
+void cpu_pool::execute(detail::cpu_job* job)
+{
+    detail::fiber_object* cf = detail::fiber_object::get_current_fiber_object();
+    if (!cf) {
+        // Not a fiber, just run the job in the calling thread
+        try {
+            job->run();
+        } catch (...) {
+            job->exception_ = std::current_exception();
+        }
+        return;
+    }
+    job->fiber_ = std::static_pointer_cast<detail::fiber_base>(cf->shared_from_this());
+    impl_->submit(job);
+    // The fiber is resumed in its strand when the job is done, it cannot happen before the pause
+    cf->pause();
+}
+
+cpu_pool& cpu_pool::get_default()
+{
+    static cpu_pool the_pool;
+    return the_pool;
+}
+
+} // End of namespace fibers
+} // End of namespace fibio
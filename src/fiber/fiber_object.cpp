@@ -24,7 +24,9 @@
 #include <fibio/fibers/mutex.hpp>
 #include <fibio/fibers/condition_variable.hpp>
 
+#include "cancellation_state.hpp"
 #include "fiber_object.hpp"
+#include "rcu.hpp"
 #include "scheduler_object.hpp"
 
 static const auto NOT_A_FIBER = fibio::fiber_exception(boost::system::errc::no_such_process);
@@ -43,6 +45,31 @@ namespace detail {
 using namespace std::placeholders;
 typedef BOOST_COROUTINE_STACK_ALLOCATOR fibio_stack_allocator;
 
+/**
+ * Stack allocator places fiber stacks on the NUMA node running the fiber
+ */
+class node_local_stack_allocator
+{
+public:
+    node_local_stack_allocator(size_t size, int node) : alloc_(size), node_(node) {}
+
+    boost::context::stack_context allocate()
+    {
+        boost::context::stack_context sc = alloc_.allocate();
+        if (node_ >= 0) {
+            // Stack grows downward, sp points to the top of the stack
+            bind_memory_to_node(static_cast<char*>(sc.sp) - sc.size, sc.size, node_);
+        }
+        return sc;
+    }
+
+    void deallocate(boost::context::stack_context& sc) noexcept { alloc_.deallocate(sc); }
+
+private:
+    fibio_stack_allocator alloc_;
+    int node_;
+};
+
 inline size_t adjusted_stack_size(size_t stack_size)
 {
     if (stack_size == 0) {
@@ -54,6 +81,13 @@ inline size_t adjusted_stack_size(size_t stack_size)
     return stack_size;
 }
 
+// Fibers started by a fiber inherit its cancellation token
+inline cancellation_state_ptr inherited_cancellation()
+{
+    fiber_object* cf = fiber_object::get_current_fiber_object();
+    return cf ? cf->cancellation_ : cancellation_state_ptr();
+}
+
 fiber_object::fiber_object(scheduler_ptr_t sched, fiber_data_base* entry, size_t stack_size)
 : sched_(sched)
 , fiber_strand_(std::make_shared<boost::asio::strand>(sched_->io_service_))
@@ -61,6 +95,7 @@ fiber_object::fiber_object(scheduler_ptr_t sched, fiber_data_base* entry, size_t
 , entry_(entry)
 , runner_(fibio_stack_allocator(adjusted_stack_size(stack_size)), std::bind(&fiber_object::runner_wrapper, this, _1))
 , caller_(0)
+, cancellation_(inherited_cancellation())
 {
 }
 
@@ -72,8 +107,11 @@ fiber_object::fiber_object(scheduler_ptr_t sched,
 , fiber_strand_(strand)
 , state_(READY)
 , entry_(entry)
-, runner_(fibio_stack_allocator(adjusted_stack_size(stack_size)), std::bind(&fiber_object::runner_wrapper, this, _1))
+, runner_(node_local_stack_allocator(adjusted_stack_size(stack_size),
+                                     sched_->get_numa_node(strand->get_io_service())),
+          std::bind(&fiber_object::runner_wrapper, this, _1))
 , caller_(0)
+, cancellation_(inherited_cancellation())
 {
 }
 
@@ -165,9 +203,18 @@ void fiber_object::one_step()
 {
     struct tls_guard
     {
-        tls_guard(fiber_object* pthis) { fiber_object::get_current_fiber_object() = pthis; }
+        tls_guard(fiber_object* pthis)
+        {
+            fiber_object::get_current_fiber_object() = pthis;
+            rcu_online();
+        }
 
-        ~tls_guard() { fiber_object::get_current_fiber_object() = 0; }
+        ~tls_guard()
+        {
+            // Switching out of a fiber is a quiescent point for snapshot readers
+            rcu_offline();
+            fiber_object::get_current_fiber_object() = 0;
+        }
     };
     if (state_ == READY) {
         state_ = RUNNING;
@@ -320,6 +367,22 @@ void fiber_object::join_and_rethrow(fiber_ptr_t f)
     propagate_exception(f);
 }
 
+static void join_from_thread(fiber_ptr_t f, bool propagate)
+{
+    // Blocks the calling thread instead of a fiber, the fiber wakes it up when it exits
+    thread_waiter tw;
+    {
+        std::lock_guard<spinlock> lock(f->mtx_);
+        if (f->state_ != fiber_object::STOPPED) {
+            f->join_queue_.push_back([&tw]() { tw.wake(); });
+        } else {
+            tw.woken_ = true;
+        }
+    }
+    tw.wait();
+    if (propagate) propagate_exception(f);
+}
+
 void fiber_object::sleep_rel(duration_t d)
 {
     // Shortcut
@@ -328,10 +391,18 @@ void fiber_object::sleep_rel(duration_t d)
     }
     CHECK_CALLER(this);
     timer_t sleep_timer(get_io_service());
+    // The timer is canceled if the bound token is cancelled
+    fibers::asio::cancellation_guard guard(sleep_timer);
+    if (guard.cancelled()) {
+        BOOST_THROW_EXCEPTION(operation_cancelled());
+    }
     sleep_timer.expires_from_now(d);
     sleep_timer.async_wait(std::bind(&fiber_object::activate, shared_from_this()));
 
     pause();
+    if (guard.cancelled()) {
+        BOOST_THROW_EXCEPTION(operation_cancelled());
+    }
 }
 
 void fiber_object::add_cleanup_function(std::function<void()>&& f)
@@ -475,8 +546,8 @@ std::string fiber::get_name()
 bool fiber::joinable() const noexcept
 {
     // Return true iff this is a fiber and not the current calling fiber
-    // and 2 fibers are in the same scheduler
-    return (impl_ && current_fiber() != impl_.get()) && (impl_->sched_ == current_fiber()->sched_);
+    // Fibers in other schedulers are joinable too, the joiner is woken up in its own strand
+    return impl_ && current_fiber() != impl_.get();
 }
 
 fiber::id fiber::get_id() const noexcept
@@ -501,6 +572,8 @@ void fiber::join(bool propagate_exception)
         } else {
             current_fiber()->join(impl_);
         }
+    } else {
+        detail::join_from_thread(impl_, propagate_exception);
     }
 }
 
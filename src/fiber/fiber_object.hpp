@@ -21,10 +21,12 @@
 #include <boost/asio/strand.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/coroutine2/coroutine.hpp>
+#include <fibio/fibers/cancellation.hpp>
 #include <fibio/fibers/exceptions.hpp>
 #include <fibio/fibers/detail/fiber_base.hpp>
 #include <fibio/fibers/detail/fiber_data.hpp>
 #include <fibio/fibers/detail/spinlock.hpp>
+#include <fibio/fibers/detail/wait_queue.hpp>
 
 #if defined(__APPLE_CC__) && (__apple_build_version__<8000000)
 // Clang on OS X doesn't support thread_local until Xcode 8.0
@@ -160,6 +162,9 @@ struct fiber_object : std::enable_shared_from_this<fiber_object>, fiber_base
 
     int interrupt_disable_level_ = 0;
     bool interrupt_requested_ = false;
+
+    // Cancellation token bound to the fiber, only accessed by the fiber itself after started
+    cancellation_state_ptr cancellation_;
 };
 
 template <typename Lockable>
@@ -172,6 +177,19 @@ struct relock_guard
     Lockable& mtx_;
 };
 
+/**
+ * Wakes up a waiter removed from a wait_queue, the node may be gone as soon as this returns
+ */
+inline void wake_waiter(wait_node* n)
+{
+    if (thread_waiter* tw = n->tw_) {
+        tw->wake();
+    } else {
+        fiber_ptr_t f(std::move(n->f_));
+        f->resume();
+    }
+}
+
 } // End of namespace detail
 
 inline detail::fiber_object* current_fiber() noexcept
@@ -0,0 +1,235 @@
+//
+//  foreign_thread_pool.cpp
+//  fibio
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fibio/fibers/future/async.hpp>
+#include <fibio/fibers/detail/parking_queue.hpp>
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+
+namespace {
+// Intrusive FIFO of jobs queued in a pool thread
+struct job_queue
+{
+    void push_back(detail::foreign_job* j)
+    {
+        j->next_ = nullptr;
+        std::lock_guard<detail::spinlock> lock(mtx_);
+        if (tail_)
+            tail_->next_ = j;
+        else
+            head_ = j;
+        tail_ = j;
+    }
+
+    detail::foreign_job* pop_front()
+    {
+        std::lock_guard<detail::spinlock> lock(mtx_);
+        detail::foreign_job* j = head_;
+        if (j) {
+            head_ = j->next_;
+            if (!head_) tail_ = nullptr;
+        }
+        return j;
+    }
+
+    detail::spinlock mtx_;
+    detail::foreign_job* head_ = nullptr;
+    detail::foreign_job* tail_ = nullptr;
+};
+
+// The pool running the current thread, and the queue of the thread
+THREAD_LOCAL foreign_thread_pool_impl* this_pool = nullptr;
+THREAD_LOCAL size_t this_queue = 0;
+} // End of anonymous namespace
+
+struct foreign_thread_pool_impl
+{
+    foreign_thread_pool_impl(size_t pool_size, size_t queue_capacity)
+    : capacity_(queue_capacity ? queue_capacity : 1), queues_(pool_size ? pool_size : 1)
+    {
+        for (size_t i = 0; i < queues_.size(); i++) {
+            threads_.emplace_back([this, i]() { run_in_this_thread(i); });
+        }
+    }
+
+    ~foreign_thread_pool_impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mtx_);
+            stopped_ = true;
+        }
+        sleep_cv_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    bool in_pool_thread() const { return this_pool == this; }
+
+    // Takes a slot for a job, returns false if the pool is full
+    bool try_reserve()
+    {
+        size_t n = reserved_.load(std::memory_order_seq_cst);
+        while (n < capacity_) {
+            if (reserved_.compare_exchange_weak(n, n + 1, std::memory_order_seq_cst)) return true;
+        }
+        return false;
+    }
+
+    // Takes a slot for a job, waits until there is room
+    void reserve()
+    {
+        if (in_pool_thread()) {
+            // Pool threads cannot wait for themselves
+            reserved_.fetch_add(1, std::memory_order_seq_cst);
+            return;
+        }
+        if (try_reserve()) return;
+        if (current_fiber()) {
+            while (!room_.park_unless([this]() { return try_reserve(); })) {
+            }
+            return;
+        }
+        // Same protocol as the parking queue, the thread announces itself before re-checking
+        std::unique_lock<std::mutex> lock(room_mtx_);
+        waiting_threads_.fetch_add(1, std::memory_order_seq_cst);
+        while (!try_reserve()) {
+            room_cv_.wait(lock);
+        }
+        waiting_threads_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Gives back the slot of a job picked up by a pool thread
+    void release()
+    {
+        reserved_.fetch_sub(1, std::memory_order_seq_cst);
+        room_.unpark();
+        if (waiting_threads_.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(room_mtx_);
+            room_cv_.notify_one();
+        }
+    }
+
+    void submit(detail::foreign_job* job)
+    {
+        reserve();
+        // Jobs submitted by a pool thread go to its own queue, others are spread round-robin
+        size_t i = in_pool_thread() ? this_queue
+                                    : next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        queues_[i].value_.push_back(job);
+        pending_.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(sleep_mtx_);
+            sleep_cv_.notify_one();
+        }
+    }
+
+    // Takes a job from the queue of the thread, or steals one from other threads
+    detail::foreign_job* take(size_t index)
+    {
+        for (size_t k = 0; k < queues_.size(); k++) {
+            if (detail::foreign_job* j = queues_[(index + k) % queues_.size()].value_.pop_front()) {
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                return j;
+            }
+        }
+        return nullptr;
+    }
+
+    void run_in_this_thread(size_t index)
+    {
+        this_pool = this;
+        this_queue = index;
+        for (;;) {
+            detail::foreign_job* job = take(index);
+            if (!job) {
+                std::unique_lock<std::mutex> lock(sleep_mtx_);
+                sleeping_.fetch_add(1, std::memory_order_seq_cst);
+                while (!stopped_ && pending_.load(std::memory_order_seq_cst) == 0) {
+                    sleep_cv_.wait(lock);
+                }
+                sleeping_.fetch_sub(1, std::memory_order_relaxed);
+                // Stopped and all jobs are done
+                if (pending_.load(std::memory_order_seq_cst) == 0) return;
+                continue;
+            }
+            release();
+            job->execute();
+        }
+    }
+
+    const size_t capacity_;
+    // Queues of different threads are kept apart
+    std::vector<detail::cache_line_padded<job_queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_{0};
+
+    // Jobs submitted and not yet picked up
+    std::atomic<size_t> reserved_{0};
+    detail::parking_queue room_;
+    std::mutex room_mtx_;
+    std::condition_variable room_cv_;
+    std::atomic<size_t> waiting_threads_{0};
+
+    // Jobs in the queues
+    std::atomic<size_t> pending_{0};
+    std::mutex sleep_mtx_;
+    std::condition_variable sleep_cv_;
+    std::atomic<size_t> sleeping_{0};
+    bool stopped_ = false;
+};
+
+foreign_thread_pool::foreign_thread_pool(size_t pool_size, size_t queue_capacity)
+: impl_(new foreign_thread_pool_impl(pool_size, queue_capacity))
+{
+}
+
+foreign_thread_pool::~foreign_thread_pool()
+{
+}
+
+size_t foreign_thread_pool::size() const
+{
+    return impl_->threads_.size();
+}
+
+void foreign_thread_pool::submit(detail::foreign_job* job)
+{
+    impl_->submit(job);
+}
+
+void foreign_thread_pool::call(detail::foreign_call_base* job)
+{
+    if (impl_->in_pool_thread()) {
+        // Already in the pool, waiting for another pool thread may deadlock
+        detail::thread_waiter tw;
+        job->tw_ = &tw;
+        job->execute();
+        return;
+    }
+    if (detail::fiber_object* cf = current_fiber()) {
+        // The job lives on the stack of the fiber, so the wait cannot be interrupted
+        this_fiber::disable_interruption di;
+        job->fiber_ = std::static_pointer_cast<detail::fiber_base>(cf->shared_from_this());
+        impl_->submit(job);
+        // The fiber is resumed in its strand when the job is done, it cannot happen before the pause
+        cf->pause();
+        return;
+    }
+    detail::thread_waiter tw;
+    job->tw_ = &tw;
+    impl_->submit(job);
+    tw.wait();
+}
+
+} // End of namespace fibers
+} // End of namespace fibio
@@ -7,6 +7,12 @@
 //
 
 #include <fibio/fibers/exceptions.hpp>
+#include <fibio/fibers/future/detail/shared_state.hpp>
+#include <fibio/fibers/future/launch.hpp>
+#include "cancellation_state.hpp"
+#include "fiber_object.hpp"
+#include "scheduler_object.hpp"
+#include "timer_service.hpp"
 
 namespace fibio {
 namespace fibers {
@@ -41,5 +47,235 @@ boost::system::error_category const& future_category() noexcept
     return cat;
 }
 
+namespace detail {
+
+namespace {
+// A fiber or foreign thread blocked in `wait()`, lives on its stack, it cannot leave before being
+// notified
+struct blocking_waiter : future_waiter
+{
+    virtual void notify() override
+    {
+        if (tw_) {
+            tw_->wake();
+        } else {
+            fiber_ptr_t f(std::move(f_));
+            f->resume();
+        }
+    }
+
+    fiber_ptr_t f_;
+    thread_waiter* tw_ = nullptr;
+};
+
+// A fiber or foreign thread blocked in `wait_for()`, or a fiber with a cancellation token, may
+// give up before being notified so it's shared by the waiter and the state
+struct timed_waiter : future_waiter
+{
+    enum
+    {
+        WAITING,
+        NOTIFIED,
+        TIMED_OUT,
+        CANCELLED,
+    };
+
+    timed_waiter()
+    : entry_(&timed_waiter::timeout_handler, this), cancel_(&timed_waiter::cancel_handler, this)
+    {
+    }
+
+    virtual void notify() override
+    {
+        if (settle(NOTIFIED)) wake();
+        release();
+    }
+
+    virtual void discard() override { release(); }
+
+    // Returns true if the wait ends with the result
+    bool settle(int result)
+    {
+        int expected = WAITING;
+        return state_.compare_exchange_strong(expected, result, std::memory_order_acq_rel);
+    }
+
+    void wake()
+    {
+        if (f_) {
+            fiber_ptr_t f(std::move(f_));
+            f->resume();
+        } else {
+            tw_.wake();
+        }
+    }
+
+    void release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+    static void timeout_handler(timer_entry* e)
+    {
+        timed_waiter* w = static_cast<timed_waiter*>(e->data_);
+        if (w->settle(TIMED_OUT)) w->wake();
+    }
+
+    static void cancel_handler(cancellation_callback* cb)
+    {
+        timed_waiter* w = static_cast<timed_waiter*>(cb->data_);
+        if (w->settle(CANCELLED)) w->wake();
+    }
+
+    // Referenced by the waiter and the state
+    std::atomic<int> refs_{2};
+    std::atomic<int> state_{WAITING};
+    fiber_ptr_t f_;
+    thread_waiter tw_;
+    timer_entry entry_;
+    cancellation_callback cancel_;
+};
+} // End of anonymous namespace
+
+shared_state_base::~shared_state_base()
+{
+    // Waiters left in a state that never became ready
+    uintptr_t s = state_.load(std::memory_order_acquire);
+    if (s & READY) return;
+    future_waiter* w = reinterpret_cast<future_waiter*>(s & ~uintptr_t(FLAGS));
+    while (w) {
+        future_waiter* next = w->next_;
+        w->discard();
+        w = next;
+    }
+}
+
+bool shared_state_base::link(future_waiter* w) const
+{
+    uintptr_t s = state_.load(std::memory_order_acquire);
+    do {
+        if (s & READY) return false;
+        w->next_ = reinterpret_cast<future_waiter*>(s & ~uintptr_t(FLAGS));
+    } while (!state_.compare_exchange_weak(s,
+                                           reinterpret_cast<uintptr_t>(w) | (s & FLAGS),
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire));
+    return true;
+}
+
+void shared_state_base::mark_ready()
+{
+    uintptr_t s = state_.exchange(READY | CLAIMED, std::memory_order_acq_rel);
+    // Waiters are linked in LIFO order, notify them in FIFO order
+    future_waiter* w = reinterpret_cast<future_waiter*>(s & ~uintptr_t(FLAGS));
+    future_waiter* fifo = nullptr;
+    while (w) {
+        future_waiter* next = w->next_;
+        w->next_ = fifo;
+        fifo = w;
+        w = next;
+    }
+    while (fifo) {
+        // The waiter may be gone as soon as it's notified
+        future_waiter* next = fifo->next_;
+        fifo->notify();
+        fifo = next;
+    }
+}
+
+void shared_state_base::wait() const
+{
+    if (is_ready()) return;
+    blocking_waiter w;
+    if (auto cf = current_fiber()) {
+        if (cf->cancellation_) {
+            // The wait may end before the state is ready
+            wait_in_fiber(cf, time_point_t::max());
+            return;
+        }
+        w.f_ = cf->shared_from_this();
+        if (link(&w)) cf->pause();
+    } else {
+        thread_waiter tw;
+        w.tw_ = &tw;
+        if (link(&w)) tw.wait();
+    }
+}
+
+future_status shared_state_base::wait_rel(duration_t d) const
+{
+    if (is_ready()) return future_status::ready;
+    if (d <= duration_t::zero()) return future_status::timeout;
+    if (auto cf = current_fiber()) return wait_in_fiber(cf, std::chrono::steady_clock::now() + d);
+    timed_waiter* w = new timed_waiter;
+    if (!link(w)) {
+        delete w;
+        return future_status::ready;
+    }
+    if (!w->tw_.wait_until(std::chrono::steady_clock::now() + d)) {
+        // Fails if notified right after timed out
+        w->settle(timed_waiter::TIMED_OUT);
+    }
+    bool ready = (w->state_.load(std::memory_order_acquire) == timed_waiter::NOTIFIED);
+    w->release();
+    return ready ? future_status::ready : future_status::timeout;
+}
+
+future_status shared_state_base::wait_in_fiber(fiber_object* cf, time_point_t deadline) const
+{
+    cancellation_state* cs = cf->cancellation_.get();
+    if (cs && cs->cancelled()) BOOST_THROW_EXCEPTION(operation_cancelled());
+    timed_waiter* w = new timed_waiter;
+    w->f_ = cf->shared_from_this();
+    if (!link(w)) {
+        delete w;
+        return future_status::ready;
+    }
+    timer_service& timers = cf->sched_->timers_;
+    if (deadline != time_point_t::max()) timers.schedule(&w->entry_, deadline);
+    if (cs && !cs->add(&w->cancel_)) {
+        // Cancelled in between
+        timed_waiter::cancel_handler(&w->cancel_);
+        cs = nullptr;
+    }
+    try {
+        // Either the state, the timer or the cancellation resumes this fiber, and the callbacks
+        // must be done before the waiter goes away
+        timer_entry_guard guard{timers, w->entry_};
+        cancellation_callback_guard cancel_guard{cs, w->cancel_};
+        cf->pause();
+    } catch (...) {
+        w->release();
+        throw;
+    }
+    int result = w->state_.load(std::memory_order_acquire);
+    w->release();
+    if (result == timed_waiter::CANCELLED) BOOST_THROW_EXCEPTION(operation_cancelled());
+    return result == timed_waiter::NOTIFIED ? future_status::ready : future_status::timeout;
+}
+
+continuation_launcher::continuation_launcher(launch policy)
+{
+    if (policy != launch::post) return;
+    if (auto cf = current_fiber()) {
+        sched_ = cf->sched_;
+        strand_ = cf->fiber_strand_;
+    } else {
+        sched_ = scheduler_object::get_instance();
+    }
+}
+
+continuation_launcher::continuation_launcher(scheduler& sched) : sched_(sched.impl_)
+{
+}
+
+void continuation_launcher::spawn(fiber_data_base* entry) const
+{
+    fiber_ptr_t f = strand_ ? sched_->make_fiber(strand_, entry) : sched_->make_fiber(entry);
+    f->get_fiber_strand().post(std::bind(&fiber_object::detach, f));
+}
+
+} // End of namespace detail
+
 } // End of namespace fibers
 } // End of namespace fibio
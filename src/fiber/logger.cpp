@@ -0,0 +1,335 @@
+//
+//  logger.cpp
+//  fibio
+//
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <boost/optional.hpp>
+#include <fibio/fibers/logger.hpp>
+#include <fibio/fibers/future/future.hpp>
+#include <fibio/fibers/future/promise.hpp>
+#include <fibio/stream/fstream.hpp>
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+
+namespace {
+struct log_entry
+{
+    // Order of the record across all rings of the logger
+    uint64_t seq_ = 0;
+    std::string text_;
+    // Set once the record is written, for synchronous records
+    boost::optional<promise<void>> done_;
+};
+
+/**
+ * Single-producer single-consumer ring of a thread, the thread pushes records without yielding so
+ * fibers running on the thread don't interleave
+ * A fiber moves between threads and so between rings, records are numbered from a counter of the
+ * logger and the flusher writes them in that order.
+ */
+class log_ring
+{
+public:
+    explicit log_ring(size_t capacity) : mask_(round_up(capacity) - 1), entries_(mask_ + 1) {}
+
+    /// Called by the owning thread, numbers the record and returns false if the ring is full
+    bool push(log_entry& e, std::atomic<uint64_t>& seq)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.value_.load(std::memory_order_acquire) > mask_) return false;
+        // The flusher waits for records numbered before its cut to land, see `settle`
+        busy_.store(true, std::memory_order_seq_cst);
+        e.seq_ = seq.fetch_add(1, std::memory_order_seq_cst);
+        entries_[tail & mask_] = std::move(e);
+        tail_.store(tail + 1, std::memory_order_release);
+        busy_.store(false, std::memory_order_release);
+        return true;
+    }
+
+    /// Called by the flusher after taking a cut of the counter, waits for a push in progress
+    void settle() const
+    {
+        while (busy_.load(std::memory_order_seq_cst)) {
+            std::this_thread::yield();
+        }
+    }
+
+    /// Returns true if the ring is at least half full
+    bool filling() const
+    {
+        return tail_.load(std::memory_order_relaxed) - head_.value_.load(std::memory_order_relaxed)
+               > mask_ / 2;
+    }
+
+    /// Called by the flusher, moves out records numbered before `cut`
+    void drain(uint64_t cut, std::vector<log_entry>& out)
+    {
+        size_t head = head_.value_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        for (; head != tail && entries_[head & mask_].seq_ < cut; head++) {
+            out.push_back(std::move(entries_[head & mask_]));
+        }
+        head_.value_.store(head, std::memory_order_release);
+    }
+
+private:
+    static size_t round_up(size_t n)
+    {
+        size_t r = 2;
+        while (r < n) r <<= 1;
+        return r;
+    }
+
+    const size_t mask_;
+    std::vector<log_entry> entries_;
+    // The consumer side is kept off the cache lines of the producer side
+    detail::cache_line_padded<std::atomic<size_t>> head_;
+    std::atomic<size_t> tail_{0};
+    std::atomic<bool> busy_{false};
+};
+
+const char* level_name(log_level level)
+{
+    switch (level) {
+    case log_level::trace:
+        return "TRACE";
+    case log_level::debug:
+        return "DEBUG";
+    case log_level::info:
+        return "INFO";
+    case log_level::warning:
+        return "WARN";
+    case log_level::error:
+        return "ERROR";
+    case log_level::fatal:
+        return "FATAL";
+    }
+    return "?";
+}
+
+// Loggers are told apart by serial numbers as addresses can be reused
+std::atomic<uint64_t> logger_serial{0};
+} // End of anonymous namespace
+
+struct logger_impl
+{
+    logger_impl(std::ostream& os, logger::attributes attrs)
+    : attrs_(attrs), level_(attrs.level), os_(os)
+    {
+        flusher_ = std::thread([this]() { run_flusher(); });
+    }
+
+    logger_impl(const std::string& path, logger::attributes attrs)
+    : attrs_(attrs)
+    , level_(attrs.level)
+    , file_(new stream::basic_ofstream<char>(path, std::ios_base::out | std::ios_base::app))
+    , os_(*file_)
+    {
+        flusher_ = std::thread([this]() { run_flusher(); });
+    }
+
+    ~logger_impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stopped_ = true;
+        }
+        cv_.notify_one();
+        flusher_.join();
+    }
+
+    log_ring* local_ring()
+    {
+        static thread_local std::unordered_map<uint64_t, log_ring*> rings;
+        log_ring*& r = rings[serial_];
+        if (!r) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            rings_.emplace_back(new log_ring(attrs_.ring_capacity));
+            r = rings_.back().get();
+        }
+        return r;
+    }
+
+    void wake_flusher()
+    {
+        if (wakeup_.exchange(true, std::memory_order_acq_rel)) return;
+        std::lock_guard<std::mutex> lock(mtx_);
+        cv_.notify_one();
+    }
+
+    void submit(std::string&& text, bool sync)
+    {
+        log_entry e;
+        e.text_ = std::move(text);
+        if (!sync) {
+            log_ring* r = local_ring();
+            if (!r->push(e, seq_)) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                wake_flusher();
+            } else if (r->filling()) {
+                wake_flusher();
+            }
+            return;
+        }
+        e.done_ = promise<void>();
+        future<void> f = e.done_->get_future();
+        // The ring is looked up again after yielding, a fiber may have moved to another thread
+        while (!local_ring()->push(e, seq_)) {
+            wake_flusher();
+            if (this_fiber::is_a_fiber())
+                this_fiber::yield();
+            else
+                std::this_thread::yield();
+        }
+        wake_flusher();
+        f.wait();
+    }
+
+    void run_flusher()
+    {
+        std::string batch;
+        std::vector<log_entry> entries;
+        std::vector<promise<void>> done;
+        for (;;) {
+            bool stopped;
+            uint64_t cut;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait_for(lock, attrs_.flush_interval, [this]() {
+                    return stopped_ || wakeup_.load(std::memory_order_acquire);
+                });
+                // Records numbered after the cut wake up the next round
+                wakeup_.store(false, std::memory_order_seq_cst);
+                stopped = stopped_;
+                cut = seq_.load(std::memory_order_seq_cst);
+                // A ring created after the cut only has records numbered after it
+                rings_snapshot_.clear();
+                for (auto& r : rings_) rings_snapshot_.push_back(r.get());
+            }
+            // Every record numbered before the cut is in its ring once pushes in progress are done
+            for (log_ring* r : rings_snapshot_) r->settle();
+            for (log_ring* r : rings_snapshot_) r->drain(cut, entries);
+            // Each ring is in order, merge them
+            std::sort(entries.begin(), entries.end(), [](const log_entry& a, const log_entry& b) {
+                return a.seq_ < b.seq_;
+            });
+            for (auto& e : entries) {
+                batch += e.text_;
+                if (e.done_) done.push_back(std::move(*e.done_));
+            }
+            entries.clear();
+            if (!batch.empty() || !done.empty()) {
+                os_.write(batch.data(), batch.size());
+                os_.flush();
+                batch.clear();
+                for (auto& p : done) p.set_value();
+                done.clear();
+            }
+            if (stopped) return;
+        }
+    }
+
+    std::string format(log_level level,
+                       const std::string& message,
+                       std::initializer_list<log_field> fields)
+    {
+        using namespace std::chrono;
+        auto now = system_clock::now();
+        std::time_t t = system_clock::to_time_t(now);
+        std::tm tm;
+        ::gmtime_r(&t, &tm);
+        char ts[40];
+        size_t n = std::strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+        long us = long(duration_cast<microseconds>(now.time_since_epoch()).count() % 1000000);
+        std::snprintf(ts + n, sizeof(ts) - n, ".%06ldZ", us);
+
+        std::ostringstream os;
+        os << ts << ' ' << level_name(level) << " [";
+        if (detail::fiber_object* cf = current_fiber()) {
+            os << "fiber:" << std::hex << this_fiber::get_id() << std::dec;
+            std::string name = cf->get_name();
+            if (!name.empty()) os << ' ' << name;
+        } else {
+            os << "thread:" << std::this_thread::get_id();
+        }
+        os << "] " << message;
+        for (auto& f : fields) {
+            os << ' ' << f.key << '=' << f.value;
+        }
+        os << '\n';
+        return os.str();
+    }
+
+    const logger::attributes attrs_;
+    std::atomic<log_level> level_;
+    const uint64_t serial_ = logger_serial.fetch_add(1, std::memory_order_relaxed);
+    std::atomic<uint64_t> dropped_{0};
+    // Numbers records across rings
+    std::atomic<uint64_t> seq_{0};
+    std::unique_ptr<std::ostream> file_;
+    std::ostream& os_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::atomic<bool> wakeup_{false};
+    bool stopped_ = false;
+    std::vector<std::unique_ptr<log_ring>> rings_;
+    std::vector<log_ring*> rings_snapshot_;
+    std::thread flusher_;
+};
+
+logger::logger(const std::string& path, attributes attrs) : impl_(new logger_impl(path, attrs))
+{
+}
+
+logger::logger(std::ostream& os, attributes attrs) : impl_(new logger_impl(os, attrs))
+{
+}
+
+logger::~logger()
+{
+}
+
+bool logger::enabled(log_level level) const
+{
+    return level >= impl_->level_.load(std::memory_order_relaxed);
+}
+
+void logger::set_level(log_level level)
+{
+    impl_->level_.store(level, std::memory_order_relaxed);
+}
+
+void logger::log(log_level level,
+                 const std::string& message,
+                 std::initializer_list<log_field> fields)
+{
+    if (!enabled(level)) return;
+    impl_->submit(impl_->format(level, message, fields), level >= impl_->attrs_.sync_level);
+}
+
+void logger::flush()
+{
+    // An empty synchronous record, completed after everything queued before it
+    impl_->submit(std::string(), true);
+}
+
+uint64_t logger::dropped() const
+{
+    return impl_->dropped_.load(std::memory_order_relaxed);
+}
+
+} // End of namespace fibers
+} // End of namespace fibio
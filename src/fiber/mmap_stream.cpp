@@ -0,0 +1,138 @@
+//
+//  mmap_stream.cpp
+//  fibio
+//
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fibio/stream/mmap_stream.hpp>
+
+namespace fibio {
+namespace stream {
+
+namespace {
+struct mapping
+{
+    bool ok;
+    char* data;
+    size_t size;
+};
+
+mapping map_file(const char* s)
+{
+    mapping m{false, nullptr, 0};
+    int fd = ::open(s, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return m;
+    struct stat st;
+    // Only regular files have a size to map
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        m.size = size_t(st.st_size);
+        if (m.size == 0) {
+            m.ok = true;
+        } else {
+            void* p = ::mmap(nullptr, m.size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                m.ok = true;
+                m.data = static_cast<char*>(p);
+            }
+        }
+    }
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    return m;
+}
+
+bool advise_willneed(char* addr, size_t length)
+{
+    return ::madvise(addr, length, MADV_WILLNEED) == 0;
+}
+} // End of anonymous namespace
+
+mmap_streambuf::mmap_streambuf()
+: data_(nullptr), size_(0), mapped_empty_(false), executor_(detail::get_default_executor())
+{
+}
+
+mmap_streambuf::~mmap_streambuf()
+{
+    close();
+}
+
+mmap_streambuf* mmap_streambuf::open(const char* s)
+{
+    if (is_open()) return nullptr;
+    mapping m = (*executor_)(map_file, s);
+    if (!m.ok) return nullptr;
+    data_ = m.data;
+    size_ = m.size;
+    mapped_empty_ = (m.size == 0);
+    setg(data_, data_, data_ + size_);
+    return this;
+}
+
+mmap_streambuf* mmap_streambuf::close()
+{
+    if (!is_open()) return nullptr;
+    if (data_) ::munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+    mapped_empty_ = false;
+    setg(nullptr, nullptr, nullptr);
+    return this;
+}
+
+fibers::future<bool> mmap_streambuf::prefetch(size_t offset, size_t length)
+{
+    if (!data_ || offset >= size_) return fibers::make_ready_future(false);
+    length = std::min(length, size_ - offset);
+    // madvise takes page aligned addresses
+    static const size_t page_size = size_t(::sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page_size * page_size;
+    return executor_->async_call(advise_willneed, data_ + begin, offset + length - begin);
+}
+
+std::streamsize mmap_streambuf::showmanyc()
+{
+    // All remaining data is in the get area
+    return egptr() - gptr() > 0 ? egptr() - gptr() : -1;
+}
+
+mmap_streambuf::pos_type mmap_streambuf::seekoff(off_type off,
+                                                 std::ios_base::seekdir way,
+                                                 std::ios_base::openmode which)
+{
+    if (!is_open() || !(which & std::ios_base::in)) return pos_type(off_type(-1));
+    off_type base;
+    switch (way) {
+    case std::ios_base::beg:
+        base = 0;
+        break;
+    case std::ios_base::cur:
+        base = gptr() - eback();
+        break;
+    case std::ios_base::end:
+        base = off_type(size_);
+        break;
+    default:
+        return pos_type(off_type(-1));
+    }
+    off_type pos = base + off;
+    if (pos < 0 || pos > off_type(size_)) return pos_type(off_type(-1));
+    setg(eback(), eback() + pos, egptr());
+    return pos_type(pos);
+}
+
+mmap_streambuf::pos_type mmap_streambuf::seekpos(pos_type sp, std::ios_base::openmode which)
+{
+    return seekoff(off_type(sp), std::ios_base::beg, which);
+}
+
+} // End of namespace stream
+} // End of namespace fibio
+
+#endif // !defined(_WIN32)
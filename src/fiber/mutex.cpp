@@ -7,6 +7,7 @@
 //
 
 #include <fibio/fibers/mutex.hpp>
+#include <fibio/fibers/profiler.hpp>
 #include "fiber_object.hpp"
 
 namespace fibio {
@@ -14,6 +15,7 @@ namespace fibers {
 
 static const auto NOPERM = lock_error(boost::system::errc::operation_not_permitted);
 static const auto DEADLOCK = lock_error(boost::system::errc::resource_deadlock_would_occur);
+static const auto NOT_A_FIBER = fibio::fiber_exception(boost::system::errc::no_such_process);
 
 namespace detail {
 inline detail::fiber_ptr_t cur_fiber()
@@ -24,76 +26,257 @@ inline detail::fiber_ptr_t cur_fiber()
     }
     return detail::fiber_ptr_t();
 }
+
+// Only mutex supports foreign threads, other mutexes must be used in fibers
+inline detail::fiber_ptr_t cur_fiber_or_throw()
+{
+    auto cf = current_fiber();
+    if (!cf) {
+        BOOST_THROW_EXCEPTION(NOT_A_FIBER);
+    }
+    return cf->shared_from_this();
+}
 } // End of namespace detail
 
 void mutex::lock()
 {
     auto tf = detail::cur_fiber();
-    if (!tf) return;
-    std::lock_guard<detail::spinlock> lock(mtx_);
+    if (!tf) {
+        lock_in_thread(FIBIO_RETURN_ADDRESS());
+        return;
+    }
+    std::unique_lock<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         BOOST_THROW_EXCEPTION(DEADLOCK);
-    } else if (!owner_) {
+    } else if (!is_locked()) {
         // This mutex is not locked
         // Acquire the mutex
-        owner_ = tf;
+        acquire(tf);
         return;
     }
     // This mutex is locked
-    // Add this fiber into waiting queue
-    suspended_.push_back(tf);
+    const void* call_site = FIBIO_RETURN_ADDRESS();
+    auto start = std::chrono::steady_clock::now();
+    if (spin_count_ == 0 || !spin_lock(tf, lock)) {
+        bool woken = false;
+        while (owner_ != tf) {
+            if (!is_locked()) {
+                // Released by unlock in barging mode
+                acquire(tf);
+                break;
+            }
+            // Add this fiber into waiting queue, a woken up waiter has been overtaken, put it
+            // back to the front so it's the next one to retry
+            detail::wait_node node;
+            node.f_ = tf;
+            if (woken)
+                suspended_.push_front(&node);
+            else
+                suspended_.push_back(&node);
+
+            try {
+                detail::relock_guard<detail::spinlock> relock(mtx_);
+                tf->pause();
+            } catch (...) {
+                // Interrupted after being woken up, the wakeup or the handover was meant for this
+                // fiber, pass it on to the next waiter
+                if (barging_) {
+                    waking_ = false;
+                    if (!is_locked() && !suspended_.empty()) {
+                        waking_ = true;
+                        detail::wake_waiter(suspended_.pop_front());
+                    }
+                } else if (owner_ == tf) {
+                    release();
+                }
+                throw;
+            }
+            // In fair mode the mutex has been handed over to this fiber by unlock
+            if (barging_) waking_ = false;
+            woken = true;
+        }
+    }
+    auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    stats_.contended_acquisitions++;
+    stats_.total_wait_time += wait;
+    lock.unlock();
+    if (profiled_ && detail::should_sample_contention()) {
+        detail::record_contention(this, lock_kind::mutex, call_site, wait);
+    }
+}
 
-    {
-        detail::relock_guard<detail::spinlock> relock(mtx_);
-        tf->pause();
+void mutex::lock_in_thread(const void* call_site)
+{
+    const std::thread::id tid = std::this_thread::get_id();
+    std::unique_lock<detail::spinlock> lock(mtx_);
+    if (thread_owner_ == tid) {
+        BOOST_THROW_EXCEPTION(DEADLOCK);
+    } else if (!is_locked()) {
+        thread_owner_ = tid;
+        locked_.store(true, std::memory_order_relaxed);
+        stats_.acquisitions++;
+        return;
+    }
+    // Block this thread, not the worker threads
+    auto start = std::chrono::steady_clock::now();
+    bool woken = false;
+    while (thread_owner_ != tid) {
+        if (!is_locked()) {
+            thread_owner_ = tid;
+            locked_.store(true, std::memory_order_relaxed);
+            stats_.acquisitions++;
+            break;
+        }
+        detail::thread_waiter tw;
+        detail::wait_node node;
+        node.tw_ = &tw;
+        if (woken)
+            suspended_.push_front(&node);
+        else
+            suspended_.push_back(&node);
+
+        {
+            detail::relock_guard<detail::spinlock> relock(mtx_);
+            tw.wait();
+        }
+        if (barging_) waking_ = false;
+        woken = true;
+    }
+    auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    stats_.contended_acquisitions++;
+    stats_.total_wait_time += wait;
+    lock.unlock();
+    if (profiled_ && detail::should_sample_contention()) {
+        detail::record_contention(this, lock_kind::mutex, call_site, wait);
     }
 }
 
-void mutex::unlock()
+void mutex::acquire(const detail::fiber_ptr_t& tf)
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return;
-    std::lock_guard<detail::spinlock> lock(mtx_);
-    if (owner_ != tf) {
-        // This fiber doesn't own the mutex
-        BOOST_THROW_EXCEPTION(NOPERM);
+    owner_ = tf;
+    locked_.store(true, std::memory_order_relaxed);
+    stats_.acquisitions++;
+}
+
+bool mutex::spin_lock(const detail::fiber_ptr_t& tf, std::unique_lock<detail::spinlock>& lock)
+{
+    if (owner_ && owner_->state_ != detail::fiber_object::RUNNING) {
+        // The owner is not running in another thread, it won't release the mutex soon
+        return false;
+    }
+    lock.unlock();
+    for (unsigned i = 0; i < spin_count_; i++) {
+        detail::cpu_relax();
+        if (locked_.load(std::memory_order_relaxed)) continue;
+        // Looks unlocked, try to acquire it
+        lock.lock();
+        if (!is_locked()) {
+            acquire(tf);
+            return true;
+        }
+        lock.unlock();
     }
+    lock.lock();
+    return false;
+}
+
+void mutex::release()
+{
+    owner_.reset();
+    thread_owner_ = std::thread::id();
     if (suspended_.empty()) {
         // Nobody is waiting
-        owner_.reset();
+        locked_.store(false, std::memory_order_relaxed);
+        return;
+    }
+    if (barging_) {
+        // Release the mutex and wake up the first waiter to retry, unless a woken up waiter
+        // hasn't retried yet, the unlocking fiber keeps running
+        locked_.store(false, std::memory_order_relaxed);
+        if (waking_) return;
+        waking_ = true;
+        detail::wake_waiter(suspended_.pop_front());
         return;
     }
     // Set new owner and remove it from suspended queue
-    std::swap(owner_, suspended_.front());
-    suspended_.pop_front();
-    owner_->resume();
+    detail::wait_node* node = suspended_.pop_front();
+    if (node->tw_)
+        thread_owner_ = node->tw_->id_;
+    else
+        owner_ = node->f_;
+    stats_.acquisitions++;
+    detail::wake_waiter(node);
+}
 
-    {
+void mutex::unlock()
+{
+    auto tf = detail::cur_fiber();
+    if (!tf) {
+        unlock_in_thread();
+        return;
+    }
+    std::lock_guard<detail::spinlock> lock(mtx_);
+    if (owner_ != tf) {
+        // This fiber doesn't own the mutex
+        BOOST_THROW_EXCEPTION(NOPERM);
+    }
+    release();
+    if (owner_) {
+        // The mutex has been handed over to another fiber
         detail::relock_guard<detail::spinlock> relock(mtx_);
         tf->yield(owner_);
     }
 }
 
+void mutex::unlock_in_thread()
+{
+    std::lock_guard<detail::spinlock> lock(mtx_);
+    if (thread_owner_ != std::this_thread::get_id()) {
+        // This thread doesn't own the mutex
+        BOOST_THROW_EXCEPTION(NOPERM);
+    }
+    release();
+}
+
 bool mutex::try_lock()
 {
     auto tf = detail::cur_fiber();
-    if (!tf) return false;
+    if (!tf) return try_lock_in_thread();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         // This fiber already owns the mutex
-    } else if (!owner_) {
+    } else if (!is_locked()) {
         // This mutex is not locked
         // Acquire the mutex
-        owner_ = tf;
+        acquire(tf);
     }
     // Return true if this fiber owns the mutex
     return owner_ == tf;
 }
 
+bool mutex::try_lock_in_thread()
+{
+    const std::thread::id tid = std::this_thread::get_id();
+    std::lock_guard<detail::spinlock> lock(mtx_);
+    if (!is_locked()) {
+        thread_owner_ = tid;
+        locked_.store(true, std::memory_order_relaxed);
+        stats_.acquisitions++;
+    }
+    return thread_owner_ == tid;
+}
+
+mutex::statistics mutex::get_statistics() const
+{
+    std::lock_guard<detail::spinlock> lock(mtx_);
+    return stats_;
+}
+
 void recursive_mutex::lock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         ++level_;
@@ -108,19 +291,22 @@ void recursive_mutex::lock()
         return;
     }
     // This mutex is locked
+    detail::contention_sample sample;
     // Add this fiber into waiting queue
-    suspended_.push_back(tf);
+    detail::wait_node node;
+    node.f_ = tf;
+    suspended_.push_back(&node);
 
     {
         detail::relock_guard<detail::spinlock> relock(mtx_);
         tf->pause();
     }
+    sample.record(this, lock_kind::recursive_mutex, FIBIO_RETURN_ADDRESS());
 }
 
 void recursive_mutex::unlock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ != tf) {
         // This fiber doesn't own the mutex
@@ -138,8 +324,7 @@ void recursive_mutex::unlock()
         return;
     }
     // Set new owner and remove it from suspended queue
-    std::swap(owner_, suspended_.front());
-    suspended_.pop_front();
+    owner_ = std::move(suspended_.pop_front()->f_);
     level_ = 1;
     owner_->resume();
 
@@ -151,8 +336,7 @@ void recursive_mutex::unlock()
 
 bool recursive_mutex::try_lock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return false;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         // This fiber already owns the mutex, increase recursive level
@@ -171,8 +355,7 @@ bool recursive_mutex::try_lock()
 
 void timed_mutex::lock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         BOOST_THROW_EXCEPTION(DEADLOCK);
@@ -183,19 +366,22 @@ void timed_mutex::lock()
         return;
     }
     // This mutex is locked
+    detail::contention_sample sample;
     // Add this fiber into waiting queue without attached timer
-    suspended_.push_back({tf, 0});
+    detail::wait_node node;
+    node.f_ = tf;
+    suspended_.push_back(&node);
 
     {
         detail::relock_guard<detail::spinlock> relock(mtx_);
         tf->pause();
     }
+    sample.record(this, lock_kind::timed_mutex, FIBIO_RETURN_ADDRESS());
 }
 
 bool timed_mutex::try_lock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return false;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         // This fiber already owns the mutex
@@ -212,8 +398,7 @@ bool timed_mutex::try_lock()
 
 void timed_mutex::unlock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ != tf) {
         // This fiber doesn't own the mutex
@@ -225,9 +410,9 @@ void timed_mutex::unlock()
         return;
     }
     // Set new owner and remove it from suspended queue
-    std::swap(owner_, suspended_.front().f_);
-    detail::timer_t* t = suspended_.front().t_;
-    suspended_.pop_front();
+    detail::wait_node* node = suspended_.pop_front();
+    owner_ = std::move(node->f_);
+    detail::timer_t* t = node->t_;
     if (t) {
         // Cancel attached timer, the timer handler will schedule new owner
         t->cancel();
@@ -242,16 +427,15 @@ void timed_mutex::unlock()
     }
 }
 
-void timed_mutex::timeout_handler(detail::fiber_ptr_t this_fiber, boost::system::error_code ec)
+void timed_mutex::timeout_handler(detail::fiber_ptr_t this_fiber,
+                                  detail::wait_node* node,
+                                  boost::system::error_code ec)
 {
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ != this_fiber) {
         // This fiber doesn't own the mutex
-        // Find and remove this fiber from waiting queue
-        auto i = std::find(suspended_.begin(), suspended_.end(), this_fiber);
-        if (i != suspended_.end()) {
-            suspended_.erase(i);
-        }
+        // Remove this fiber from waiting queue
+        suspended_.erase(node);
     } else {
         // This fiber should not be in the suspended queue, do nothing
     }
@@ -260,8 +444,7 @@ void timed_mutex::timeout_handler(detail::fiber_ptr_t this_fiber, boost::system:
 
 bool timed_mutex::try_lock_rel(detail::duration_t d)
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return false;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         BOOST_THROW_EXCEPTION(DEADLOCK);
@@ -272,26 +455,30 @@ bool timed_mutex::try_lock_rel(detail::duration_t d)
         return true;
     }
     // This mutex is locked
+    detail::contention_sample sample;
     // Add this fiber into waiting queue
     detail::timer_t t(tf->get_io_service());
+    detail::wait_node node;
+    node.f_ = tf;
+    node.t_ = &t;
     t.expires_from_now(d);
     t.async_wait(tf->get_fiber_strand().wrap(
-        std::bind(&timed_mutex::timeout_handler, this, tf, std::placeholders::_1)));
-    suspended_.push_back({tf, &t});
+        std::bind(&timed_mutex::timeout_handler, this, tf, &node, std::placeholders::_1)));
+    suspended_.push_back(&node);
 
     // This fiber will be resumed when timer triggered/canceled or other called unlock()
     {
         detail::relock_guard<detail::spinlock> relock(mtx_);
         tf->pause();
     }
+    sample.record(this, lock_kind::timed_mutex, FIBIO_RETURN_ADDRESS());
 
     return owner_ == tf;
 }
 
 void recursive_timed_mutex::lock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         ++level_;
@@ -304,19 +491,22 @@ void recursive_timed_mutex::lock()
         return;
     }
     // This mutex is locked
+    detail::contention_sample sample;
     // Add this fiber into waiting queue without attached timer
-    suspended_.push_back({tf, 0});
+    detail::wait_node node;
+    node.f_ = tf;
+    suspended_.push_back(&node);
 
     {
         detail::relock_guard<detail::spinlock> relock(mtx_);
         tf->pause();
     }
+    sample.record(this, lock_kind::recursive_timed_mutex, FIBIO_RETURN_ADDRESS());
 }
 
 void recursive_timed_mutex::unlock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ != tf) {
         // This fiber doesn't own the mutex
@@ -334,9 +524,9 @@ void recursive_timed_mutex::unlock()
         return;
     }
     // Set new owner and remove it from suspended queue
-    std::swap(owner_, suspended_.front().f_);
-    detail::timer_t* t = suspended_.front().t_;
-    suspended_.pop_front();
+    detail::wait_node* node = suspended_.pop_front();
+    owner_ = std::move(node->f_);
+    detail::timer_t* t = node->t_;
     level_ = 1;
     if (t) {
         // Cancel attached timer, the timer handler will schedule new owner
@@ -354,8 +544,7 @@ void recursive_timed_mutex::unlock()
 
 bool recursive_timed_mutex::try_lock()
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return false;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         // This fiber already owns the mutex, increase recursive level
@@ -371,16 +560,14 @@ bool recursive_timed_mutex::try_lock()
 }
 
 void recursive_timed_mutex::timeout_handler(detail::fiber_ptr_t this_fiber,
+                                            detail::wait_node* node,
                                             boost::system::error_code ec)
 {
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ != this_fiber) {
         // This fiber doesn't own the mutex
-        // Find and remove this fiber from waiting queue
-        auto i = std::find(suspended_.begin(), suspended_.end(), this_fiber);
-        if (i != suspended_.end()) {
-            suspended_.erase(i);
-        }
+        // Remove this fiber from waiting queue
+        suspended_.erase(node);
     } else {
         // This fiber should not be in the suspended queue, do nothing
     }
@@ -389,8 +576,7 @@ void recursive_timed_mutex::timeout_handler(detail::fiber_ptr_t this_fiber,
 
 bool recursive_timed_mutex::try_lock_rel(detail::duration_t d)
 {
-    auto tf = detail::cur_fiber();
-    if (!tf) return false;
+    auto tf = detail::cur_fiber_or_throw();
     std::lock_guard<detail::spinlock> lock(mtx_);
     if (owner_ == tf) {
         ++level_;
@@ -403,18 +589,23 @@ bool recursive_timed_mutex::try_lock_rel(detail::duration_t d)
         return true;
     }
     // This mutex is locked
+    detail::contention_sample sample;
     // Add this fiber into waiting queue
     detail::timer_t t(tf->get_io_service());
+    detail::wait_node node;
+    node.f_ = tf;
+    node.t_ = &t;
     t.expires_from_now(d);
     t.async_wait(tf->get_fiber_strand().wrap(
-        std::bind(&recursive_timed_mutex::timeout_handler, this, tf, std::placeholders::_1)));
-    suspended_.push_back({tf, &t});
+        std::bind(&recursive_timed_mutex::timeout_handler, this, tf, &node, std::placeholders::_1)));
+    suspended_.push_back(&node);
 
     // This fiber will be resumed when timer triggered/canceled or other called unlock()
     {
         detail::relock_guard<detail::spinlock> relock(mtx_);
         tf->pause();
     }
+    sample.record(this, lock_kind::recursive_timed_mutex, FIBIO_RETURN_ADDRESS());
     return owner_ == tf;
 }
 
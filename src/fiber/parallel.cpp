@@ -0,0 +1,102 @@
+//
+//  parallel.cpp
+//  fibio
+//
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <fibio/fibers/parallel.hpp>
+#include <fibio/fibers/detail/spinlock.hpp>
+#include "fiber_object.hpp"
+#include "scheduler_object.hpp"
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+namespace {
+// Shared by the calling fiber and the helpers, lives on the stack of the calling fiber
+struct chunk_job
+{
+    chunk_job(std::size_t chunks, chunk_body& body) : chunks_(chunks), body_(body) {}
+
+    // Takes chunks until there is none left
+    void work()
+    {
+        for (;;) {
+            std::size_t c = next_.fetch_add(1, std::memory_order_relaxed);
+            if (c >= chunks_) return;
+            try {
+                body_.run(c);
+            } catch (...) {
+                std::lock_guard<spinlock> lock(mtx_);
+                if (!exception_) exception_ = std::current_exception();
+                // Chunks not yet started are skipped
+                next_.store(chunks_, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns true if the last one leaves, the job must not be touched afterwards unless so
+    bool leave() { return pending_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+    const std::size_t chunks_;
+    chunk_body& body_;
+    std::atomic<std::size_t> next_{0};
+    // The caller and the helpers still working
+    std::atomic<std::size_t> pending_{1};
+    spinlock mtx_;
+    std::exception_ptr exception_;
+    fiber_ptr_t caller_;
+};
+
+void help(chunk_job* job)
+{
+    job->work();
+    if (job->leave()) {
+        // The caller is parked or about to park, the job goes away once it's resumed
+        fiber_ptr_t f(std::move(job->caller_));
+        f->resume();
+    }
+}
+} // End of anonymous namespace
+
+std::size_t parallel_concurrency()
+{
+    fiber_object* cf = current_fiber();
+    return cf ? std::max<std::size_t>(cf->sched_->worker_pool_size(), 1) : 1;
+}
+
+void run_chunks(std::size_t chunks, chunk_body& body)
+{
+    chunk_job job(chunks, body);
+    fiber_object* cf = current_fiber();
+    std::size_t helpers = std::min(chunks, parallel_concurrency()) - 1;
+    if (helpers > 0) {
+        job.caller_ = cf->shared_from_this();
+        for (std::size_t i = 0; i < helpers; i++) {
+            // Each helper gets a strand of its own so they spread across the worker threads
+            job.pending_.fetch_add(1, std::memory_order_relaxed);
+            try {
+                fiber_ptr_t f = cf->sched_->make_fiber(make_fiber_data(&help, &job));
+                f->get_fiber_strand().post(std::bind(&fiber_object::detach, f));
+            } catch (...) {
+                // Fewer helpers only make it slower
+                job.pending_.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+    }
+    job.work();
+    if (!job.leave()) {
+        // Helpers hold references to the job, so the wait cannot be interrupted
+        this_fiber::disable_interruption di;
+        cf->pause();
+    }
+    if (job.exception_) std::rethrow_exception(job.exception_);
+}
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
@@ -0,0 +1,203 @@
+//
+//  profiler.cpp
+//  fibio
+//
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <fibio/fibers/profiler.hpp>
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+
+namespace {
+// 0 means profiling is off
+std::atomic<unsigned> sample_rate(0);
+
+struct site_key
+{
+    const void* lock_;
+    const void* call_site_;
+
+    bool operator==(const site_key& other) const
+    {
+        return lock_ == other.lock_ && call_site_ == other.call_site_;
+    }
+};
+
+struct site_key_hash
+{
+    std::size_t operator()(const site_key& k) const
+    {
+        std::hash<const void*> h;
+        return h(k.lock_) * 31 + h(k.call_site_);
+    }
+};
+
+struct profile_data
+{
+    std::mutex mtx_;
+    std::unordered_map<site_key, contention_record, site_key_hash> records_;
+
+    static profile_data& instance()
+    {
+        // Never destroyed, waits may be recorded during static destruction
+        static profile_data* the_data = new profile_data;
+        return *the_data;
+    }
+};
+
+const char* kind_name(lock_kind kind)
+{
+    switch (kind) {
+        case lock_kind::mutex:
+            return "mutex";
+        case lock_kind::recursive_mutex:
+            return "recursive_mutex";
+        case lock_kind::timed_mutex:
+            return "timed_mutex";
+        case lock_kind::recursive_timed_mutex:
+            return "recursive_timed_mutex";
+        case lock_kind::shared_timed_mutex:
+            return "shared_timed_mutex";
+        case lock_kind::condition_variable:
+            return "condition_variable";
+    }
+    return "unknown";
+}
+
+void dump_table(std::ostream& os,
+                const char* title,
+                const std::vector<contention_record>& records,
+                std::size_t top,
+                bool by_lock)
+{
+    os << title << '\n';
+    os << std::setw(10) << "count" << std::setw(16) << "total(us)" << std::setw(14) << "max(us)"
+       << "  " << (by_lock ? "lock" : "call site") << '\n';
+    for (std::size_t i = 0; i < records.size() && i < top; i++) {
+        const contention_record& r = records[i];
+        os << std::setw(10) << r.count << std::setw(16) << r.total_wait.count() / 1000
+           << std::setw(14) << r.max_wait.count() / 1000 << "  " << kind_name(r.kind) << ' '
+           << (by_lock ? r.lock : r.call_site) << '\n';
+    }
+}
+
+// Merges records with the same key, results are sorted by total wait time
+template <typename Key>
+std::vector<contention_record> merge_by(const std::vector<contention_record>& records, Key key)
+{
+    std::map<const void*, contention_record> merged;
+    for (const contention_record& r : records) {
+        auto i = merged.find(key(r));
+        if (i == merged.end()) {
+            merged.insert(std::make_pair(key(r), r));
+        } else {
+            i->second.count += r.count;
+            i->second.total_wait += r.total_wait;
+            i->second.max_wait = std::max(i->second.max_wait, r.max_wait);
+        }
+    }
+    std::vector<contention_record> ret;
+    for (auto& e : merged) {
+        ret.push_back(e.second);
+    }
+    std::sort(ret.begin(), ret.end(), [](const contention_record& a, const contention_record& b) {
+        return a.total_wait > b.total_wait;
+    });
+    return ret;
+}
+} // End of anonymous namespace
+
+void contention_profiler::enable(unsigned rate)
+{
+    sample_rate.store(rate ? rate : 1, std::memory_order_relaxed);
+}
+
+void contention_profiler::disable()
+{
+    sample_rate.store(0, std::memory_order_relaxed);
+}
+
+bool contention_profiler::enabled()
+{
+    return sample_rate.load(std::memory_order_relaxed) != 0;
+}
+
+void contention_profiler::reset()
+{
+    profile_data& d = profile_data::instance();
+    std::lock_guard<std::mutex> lock(d.mtx_);
+    d.records_.clear();
+}
+
+std::vector<contention_record> contention_profiler::records()
+{
+    std::vector<contention_record> ret;
+    {
+        profile_data& d = profile_data::instance();
+        std::lock_guard<std::mutex> lock(d.mtx_);
+        for (auto& e : d.records_) {
+            ret.push_back(e.second);
+        }
+    }
+    std::sort(ret.begin(), ret.end(), [](const contention_record& a, const contention_record& b) {
+        return a.total_wait > b.total_wait;
+    });
+    return ret;
+}
+
+void contention_profiler::dump(std::ostream& os, std::size_t top)
+{
+    std::vector<contention_record> all = records();
+    dump_table(os,
+               "Hottest locks:",
+               merge_by(all, [](const contention_record& r) { return r.lock; }),
+               top,
+               true);
+    dump_table(os,
+               "Hottest call sites:",
+               merge_by(all, [](const contention_record& r) { return r.call_site; }),
+               top,
+               false);
+}
+
+namespace detail {
+
+bool should_sample_contention()
+{
+    unsigned rate = sample_rate.load(std::memory_order_relaxed);
+    if (rate <= 1) return rate == 1;
+    static THREAD_LOCAL unsigned counter = 0;
+    return (++counter % rate) == 0;
+}
+
+void record_contention(const void* lock,
+                       lock_kind kind,
+                       const void* call_site,
+                       std::chrono::nanoseconds wait)
+{
+    profile_data& d = profile_data::instance();
+    std::lock_guard<std::mutex> guard(d.mtx_);
+    auto i = d.records_.find(site_key{lock, call_site});
+    if (i == d.records_.end()) {
+        d.records_.insert(std::make_pair(site_key{lock, call_site},
+                                         contention_record{lock, kind, call_site, 1, wait, wait}));
+        return;
+    }
+    contention_record& r = i->second;
+    r.count++;
+    r.total_wait += wait;
+    r.max_wait = std::max(r.max_wait, wait);
+}
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
@@ -0,0 +1,121 @@
+//
+//  rcu.cpp
+//  fibio
+//
+
+#include <mutex>
+#include <fibio/fibers/fiber.hpp>
+#include "rcu.hpp"
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+std::atomic<uint64_t> rcu_global_epoch(1);
+
+namespace {
+// Registered worker threads and retired objects
+struct rcu_domain
+{
+    std::mutex mtx_;
+    rcu_thread_record* threads_ = nullptr;
+    rcu_node* retired_head_ = nullptr;
+    rcu_node* retired_tail_ = nullptr;
+    std::atomic<bool> has_retired_{false};
+
+    static rcu_domain& instance()
+    {
+        // Never destroyed, worker threads may exit after static destruction
+        static rcu_domain* the_domain = new rcu_domain;
+        return *the_domain;
+    }
+};
+} // End of anonymous namespace
+
+rcu_thread_guard::rcu_thread_guard()
+{
+    rcu_domain& d = rcu_domain::instance();
+    {
+        std::lock_guard<std::mutex> lock(d.mtx_);
+        record_.next_ = d.threads_;
+        if (d.threads_) d.threads_->prev_ = &record_;
+        d.threads_ = &record_;
+    }
+    rcu_current_record() = &record_;
+}
+
+rcu_thread_guard::~rcu_thread_guard()
+{
+    rcu_current_record() = 0;
+    rcu_domain& d = rcu_domain::instance();
+    {
+        std::lock_guard<std::mutex> lock(d.mtx_);
+        if (record_.prev_)
+            record_.prev_->next_ = record_.next_;
+        else
+            d.threads_ = record_.next_;
+        if (record_.next_) record_.next_->prev_ = record_.prev_;
+    }
+    // Objects waiting for this thread can be reclaimed now
+    rcu_reclaim();
+}
+
+void rcu_retire(rcu_node* n)
+{
+    rcu_domain& d = rcu_domain::instance();
+    {
+        std::lock_guard<std::mutex> lock(d.mtx_);
+        // Readers seeing this epoch or later have seen the new version
+        n->epoch_ = rcu_global_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        n->next_ = nullptr;
+        if (d.retired_tail_)
+            d.retired_tail_->next_ = n;
+        else
+            d.retired_head_ = n;
+        d.retired_tail_ = n;
+        d.has_retired_.store(true, std::memory_order_relaxed);
+    }
+    rcu_reclaim();
+}
+
+void rcu_reclaim()
+{
+    rcu_domain& d = rcu_domain::instance();
+    if (!d.has_retired_.load(std::memory_order_relaxed)) return;
+    rcu_node* head = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(d.mtx_);
+        // The oldest epoch any worker thread may still be reading with
+        uint64_t min_epoch = rcu_offline_epoch;
+        for (rcu_thread_record* r = d.threads_; r; r = r->next_) {
+            uint64_t e = r->epoch_.load(std::memory_order_seq_cst);
+            if (e < min_epoch) min_epoch = e;
+        }
+        // Retired objects are ordered by epoch
+        rcu_node* tail = nullptr;
+        while (d.retired_head_ && d.retired_head_->epoch_ <= min_epoch) {
+            rcu_node* n = d.retired_head_;
+            d.retired_head_ = n->next_;
+            n->next_ = nullptr;
+            if (tail)
+                tail->next_ = n;
+            else
+                head = n;
+            tail = n;
+        }
+        if (!d.retired_head_) {
+            d.retired_tail_ = nullptr;
+            d.has_retired_.store(false, std::memory_order_relaxed);
+        }
+    }
+    // Delete outside of the lock, destructors may be expensive
+    while (head) {
+        rcu_node* n = head;
+        head = n->next_;
+        delete n;
+    }
+}
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
@@ -0,0 +1,86 @@
+//
+//  rcu.hpp
+//  fibio
+//
+
+#ifndef fibio_rcu_hpp
+#define fibio_rcu_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <fibio/fibers/snapshot.hpp>
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/// Epoch of a worker thread not running any fiber
+constexpr uint64_t rcu_offline_epoch = std::numeric_limits<uint64_t>::max();
+
+/**
+ * Epoch seen by a worker thread when it switched into the running fiber
+ */
+struct alignas(cache_line_size) rcu_thread_record
+{
+    std::atomic<uint64_t> epoch_{rcu_offline_epoch};
+    rcu_thread_record* prev_ = nullptr;
+    rcu_thread_record* next_ = nullptr;
+};
+
+/**
+ * Registers the calling worker thread for its lifetime
+ */
+struct rcu_thread_guard
+{
+    rcu_thread_guard();
+
+    ~rcu_thread_guard();
+
+    rcu_thread_record record_;
+};
+
+/// Record of the calling worker thread, null if it's not a worker thread
+inline rcu_thread_record*& rcu_current_record()
+{
+    static THREAD_LOCAL rcu_thread_record* current_record_ = 0;
+    return current_record_;
+}
+
+/// Current global epoch
+extern std::atomic<uint64_t> rcu_global_epoch;
+
+/**
+ * Called when the worker thread switches into a fiber, snapshots may be read after this
+ */
+inline void rcu_online()
+{
+    if (rcu_thread_record* r = rcu_current_record()) {
+        r->epoch_.store(rcu_global_epoch.load(std::memory_order_acquire),
+                        std::memory_order_relaxed);
+        // The epoch must be visible before reading any snapshot
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+/**
+ * Called when the worker thread switches out of a fiber, a quiescent point
+ */
+inline void rcu_offline()
+{
+    if (rcu_thread_record* r = rcu_current_record()) {
+        r->epoch_.store(rcu_offline_epoch, std::memory_order_release);
+    }
+}
+
+/**
+ * Deletes retired objects that are not reachable by any reader
+ */
+void rcu_reclaim();
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
+
+#endif
@@ -0,0 +1,110 @@
+//
+//  read_mostly_mutex.cpp
+//  fibio
+//
+
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <fibio/fibers/read_mostly_mutex.hpp>
+#include "fiber_object.hpp"
+
+namespace fibio {
+namespace fibers {
+
+read_mostly_mutex::slot& read_mostly_mutex::current_slot()
+{
+    // A fiber may be resumed in different threads, the slot must depend on the fiber, not the
+    // thread, so lock_shared and unlock_shared always use the same one
+    std::size_t h;
+    if (auto cf = detail::fiber_object::get_current_fiber_object()) {
+        h = reinterpret_cast<std::uintptr_t>(cf) / sizeof(detail::fiber_object);
+    } else {
+        h = std::hash<std::thread::id>()(std::this_thread::get_id());
+    }
+    return slots_[h % slot_count].value_;
+}
+
+bool read_mostly_mutex::no_readers() const
+{
+    for (const auto& s : slots_) {
+        if (s.value_.readers_.load(std::memory_order_seq_cst) != 0) return false;
+    }
+    return true;
+}
+
+void read_mostly_mutex::lock_shared()
+{
+    slot& s = current_slot();
+    for (;;) {
+        // Register as a reader first, then check for writers, the writer does it in the opposite
+        // order, so at least one of them sees the other
+        s.readers_.fetch_add(1, std::memory_order_seq_cst);
+        if (!writer_.value_.load(std::memory_order_seq_cst)) return;
+        // Back off, the writer may be waiting for this slot to drain
+        s.readers_.fetch_sub(1, std::memory_order_seq_cst);
+        unique_lock<mutex> lk(state_mtx_);
+        writer_cond_.notify_one();
+        while (writer_.value_.load(std::memory_order_seq_cst)) {
+            readers_cond_.wait(lk);
+        }
+    }
+}
+
+bool read_mostly_mutex::try_lock_shared()
+{
+    slot& s = current_slot();
+    s.readers_.fetch_add(1, std::memory_order_seq_cst);
+    if (!writer_.value_.load(std::memory_order_seq_cst)) return true;
+    s.readers_.fetch_sub(1, std::memory_order_seq_cst);
+    unique_lock<mutex> lk(state_mtx_);
+    writer_cond_.notify_one();
+    return false;
+}
+
+void read_mostly_mutex::unlock_shared()
+{
+    current_slot().readers_.fetch_sub(1, std::memory_order_seq_cst);
+    if (writer_.value_.load(std::memory_order_seq_cst)) {
+        // A writer is waiting for readers to leave
+        unique_lock<mutex> lk(state_mtx_);
+        writer_cond_.notify_one();
+    }
+}
+
+void read_mostly_mutex::lock()
+{
+    writer_mtx_.lock();
+    unique_lock<mutex> lk(state_mtx_);
+    writer_.value_.store(true, std::memory_order_seq_cst);
+    // New readers back off from now on, wait for existing ones to leave
+    while (!no_readers()) {
+        writer_cond_.wait(lk);
+    }
+}
+
+bool read_mostly_mutex::try_lock()
+{
+    if (!writer_mtx_.try_lock()) return false;
+    unique_lock<mutex> lk(state_mtx_);
+    writer_.value_.store(true, std::memory_order_seq_cst);
+    if (no_readers()) return true;
+    writer_.value_.store(false, std::memory_order_seq_cst);
+    readers_cond_.notify_all();
+    lk.unlock();
+    writer_mtx_.unlock();
+    return false;
+}
+
+void read_mostly_mutex::unlock()
+{
+    {
+        unique_lock<mutex> lk(state_mtx_);
+        writer_.value_.store(false, std::memory_order_seq_cst);
+        readers_cond_.notify_all();
+    }
+    writer_mtx_.unlock();
+}
+
+} // End of namespace fibers
+} // End of namespace fibio
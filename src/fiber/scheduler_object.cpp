@@ -6,9 +6,20 @@
 //  Copyright (c) 2014 0d0a.com. All rights reserved.
 //
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
 #include <fibio/fibers/fiber.hpp>
+#include "rcu.hpp"
 #include "scheduler_object.hpp"
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
 namespace fibio {
 namespace fibers {
 namespace detail {
@@ -16,22 +27,151 @@ namespace detail {
 // std::once_flag scheduler_object::instance_inited_;
 // std::shared_ptr<scheduler_object> scheduler_object::the_instance_;
 
-scheduler_object::scheduler_object() : fiber_count_(0), started_(false)
+#if defined(__linux__)
+// Parses CPU list format used by sysfs, i.e. "0-3,8,10-11"
+static std::vector<unsigned> parse_cpu_list(const std::string& s)
 {
+    std::vector<unsigned> ret;
+    std::istringstream is(s);
+    std::string range;
+    while (std::getline(is, range, ',')) {
+        if (range.empty()) continue;
+        unsigned first = 0, last = 0;
+        char dash = 0;
+        std::istringstream rs(range);
+        if (!(rs >> first)) continue;
+        last = first;
+        if (rs >> dash && dash == '-') rs >> last;
+        for (unsigned i = first; i <= last; i++) ret.push_back(i);
+    }
+    return ret;
 }
 
-fiber_ptr_t scheduler_object::make_fiber(fiber_data_base* entry, size_t stack_size)
+static std::string read_sysfs(const std::string& path)
 {
-    std::lock_guard<std::mutex> guard(mtx_);
-    fiber_count_++;
-    fiber_ptr_t ret(std::make_shared<fiber_object>(shared_from_this(), entry, stack_size));
-    if (!started_) {
-        started_ = true;
+    std::ifstream f(path);
+    std::string s;
+    std::getline(f, s);
+    return s;
+}
+
+numa_topology_t get_numa_topology()
+{
+    numa_topology_t ret;
+    for (unsigned n : parse_cpu_list(read_sysfs("/sys/devices/system/node/online"))) {
+        std::vector<unsigned> cpus = parse_cpu_list(
+            read_sysfs("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"));
+        // Memory-only nodes cannot run worker threads
+        if (!cpus.empty()) ret.emplace_back(int(n), std::move(cpus));
     }
-    ret->resume();
     return ret;
 }
 
+void bind_this_thread_to_cpus(const std::vector<unsigned>& cpus)
+{
+    if (cpus.empty()) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned c : cpus) {
+        if (c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    // Failure is not fatal, the thread just runs unpinned
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void bind_memory_to_node(void* addr, size_t len, int node)
+{
+#if defined(SYS_mbind)
+    // MPOL_PREFERRED from <numaif.h>, call the syscall directly to avoid libnuma dependency
+    constexpr int mpol_preferred = 1;
+    constexpr size_t bits_per_word = sizeof(unsigned long) * 8;
+    if (node < 0 || size_t(node) >= 16 * bits_per_word) return;
+    unsigned long mask[16] = {0};
+    mask[node / bits_per_word] = 1UL << (node % bits_per_word);
+    // mbind requires page aligned range, shrink the range to whole pages
+    const uintptr_t page_size = uintptr_t(::sysconf(_SC_PAGESIZE));
+    uintptr_t begin = (uintptr_t(addr) + page_size - 1) & ~(page_size - 1);
+    uintptr_t end = (uintptr_t(addr) + len) & ~(page_size - 1);
+    if (end <= begin) return;
+    // Pages are placed on first touch, failure only loses locality
+    ::syscall(SYS_mbind, begin, end - begin, mpol_preferred, mask, 16 * bits_per_word, 0);
+#endif
+}
+#else
+numa_topology_t get_numa_topology()
+{
+    return numa_topology_t();
+}
+
+void bind_this_thread_to_cpus(const std::vector<unsigned>&)
+{
+}
+
+void bind_memory_to_node(void*, size_t, int)
+{
+}
+#endif
+
+scheduler_object::scheduler_object()
+: timers_(io_service_), fiber_count_(0), started_(false), next_node_(0), active_nodes_(0)
+{
+    nodes_.emplace_back(new numa_node(-1, std::vector<unsigned>(), io_service_));
+}
+
+scheduler_object::scheduler_object(scheduler::attributes attrs)
+: timers_(io_service_)
+, fiber_count_(0)
+, started_(false)
+, next_node_(0)
+, active_nodes_(0)
+, attrs_(attrs)
+{
+    numa_topology_t topology;
+    if (attrs.numa_aware) {
+        if (attrs.numa_nodes.empty()) {
+            topology = get_numa_topology();
+        } else {
+            for (size_t i = 0; i < attrs.numa_nodes.size(); i++) {
+                topology.emplace_back(int(i), attrs.numa_nodes[i]);
+            }
+        }
+    }
+    if (topology.size() > 1) {
+        // The first node uses the primary io_service, which also runs the check timer
+        nodes_.emplace_back(new numa_node(topology[0].first, topology[0].second, io_service_));
+        for (size_t i = 1; i < topology.size(); i++) {
+            nodes_.emplace_back(new numa_node(topology[i].first, topology[i].second));
+        }
+    } else {
+        nodes_.emplace_back(new numa_node(-1, std::vector<unsigned>(), io_service_));
+    }
+}
+
+boost::asio::io_service& scheduler_object::select_io_service()
+{
+    // Nobody runs the io_service of a node without worker threads, the first node gets the first
+    // worker thread
+    size_t active = std::min(active_nodes_.load(), nodes_.size());
+    if (active <= 1) {
+        return io_service_;
+    }
+    // Spread new fibers across nodes
+    return *(nodes_[next_node_++ % active]->io_service_);
+}
+
+int scheduler_object::get_numa_node(boost::asio::io_service& ios) const
+{
+    for (auto& n : nodes_) {
+        if (n->io_service_ == &ios) return n->id_;
+    }
+    return -1;
+}
+
+fiber_ptr_t scheduler_object::make_fiber(fiber_data_base* entry, size_t stack_size)
+{
+    return make_fiber(std::make_shared<boost::asio::strand>(select_io_service()), entry, stack_size);
+}
+
 fiber_ptr_t scheduler_object::make_fiber(std::shared_ptr<boost::asio::strand> s,
                                          fiber_data_base* entry,
                                          size_t stack_size)
@@ -46,9 +186,56 @@ fiber_ptr_t scheduler_object::make_fiber(std::shared_ptr<boost::asio::strand> s,
     return ret;
 }
 
-static inline void run_in_this_thread(scheduler_ptr_t pthis)
+// Runs a ready handler of other nodes, returns 0 if there is none
+static inline std::size_t steal_one(const scheduler_ptr_t& pthis, numa_node* node)
+{
+    const auto& nodes = pthis->nodes_;
+    if (nodes.size() == 1) return 0;
+    size_t self = 0;
+    while (nodes[self].get() != node) self++;
+    for (size_t i = 1; i < nodes.size(); i++) {
+        if (std::size_t n = nodes[(self + i) % nodes.size()]->io_service_->poll_one()) return n;
+    }
+    return 0;
+}
+
+static inline void run_in_this_thread(scheduler_ptr_t pthis, numa_node* node, size_t index)
 {
-    pthis->io_service_.run();
+    // Fibers in this thread may read snapshots
+    rcu_thread_guard rcu_guard;
+    const std::vector<unsigned>& cpus = pthis->attrs_.cpus;
+    if (cpus.empty()) {
+        bind_this_thread_to_cpus(node->cpus_);
+    } else {
+        // Dedicated CPU for each worker thread
+        bind_this_thread_to_cpus(std::vector<unsigned>(1, cpus[index % cpus.size()]));
+    }
+    boost::asio::io_service& ios = *(node->io_service_);
+    if (pthis->attrs_.busy_poll) {
+        // Never block, poll() runs the reactor without waiting
+        while (!ios.stopped()) {
+            if (!ios.poll() && !steal_one(pthis, node)) cpu_relax();
+        }
+        return;
+    }
+    const std::chrono::microseconds spin_budget = pthis->attrs_.spin_budget;
+    if (spin_budget.count() <= 0) {
+        ios.run();
+        return;
+    }
+    while (!ios.stopped()) {
+        if (ios.poll_one()) continue;
+        // Nothing is ready, keep polling for a while before parking this thread, other nodes are
+        // only visited when this node has nothing to run
+        std::size_t n = 0;
+        auto deadline = std::chrono::steady_clock::now() + spin_budget;
+        while (!ios.stopped() && std::chrono::steady_clock::now() < deadline) {
+            if ((n = ios.poll_one()) || (n = steal_one(pthis, node))) break;
+            cpu_relax();
+        }
+        // Park in the io_service until there is a handler to run, returns 0 if it's stopped
+        if (n == 0 && !ios.run_one()) break;
+    }
 }
 
 void scheduler_object::start(size_t nthr)
@@ -65,8 +252,11 @@ void scheduler_object::start(size_t nthr)
     check_timer->async_wait(
         std::bind(&scheduler_object::on_check_timer, pthis, std::placeholders::_1));
     for (size_t i = 0; i < nthr; i++) {
-        threads_.push_back(std::thread(run_in_this_thread, pthis));
+        // Distribute worker threads evenly across nodes
+        numa_node* node = nodes_[threads_.size() % nodes_.size()].get();
+        threads_.push_back(std::thread(run_in_this_thread, pthis, node, threads_.size()));
     }
+    active_nodes_ = std::min(threads_.size(), nodes_.size());
 }
 
 void scheduler_object::join()
@@ -84,8 +274,11 @@ void scheduler_object::join()
         t.join();
     }
     threads_.clear();
+    active_nodes_ = 0;
     started_ = false;
-    io_service_.reset();
+    for (auto& n : nodes_) {
+        n->io_service_->reset();
+    }
 }
 
 void scheduler_object::add_thread(size_t nthr)
@@ -93,8 +286,11 @@ void scheduler_object::add_thread(size_t nthr)
     std::lock_guard<std::mutex> guard(mtx_);
     scheduler_ptr_t pthis(shared_from_this());
     for (size_t i = 0; i < nthr; i++) {
-        threads_.push_back(std::thread(std::bind(run_in_this_thread, pthis)));
+        numa_node* node = nodes_[threads_.size() % nodes_.size()].get();
+        threads_.push_back(
+            std::thread(std::bind(run_in_this_thread, pthis, node, threads_.size())));
     }
+    active_nodes_ = std::min(threads_.size(), nodes_.size());
 }
 
 size_t scheduler_object::worker_pool_size() const
@@ -113,13 +309,18 @@ void scheduler_object::on_fiber_exit(fiber_ptr_t p)
 
 void scheduler_object::on_check_timer(boost::system::error_code ec)
 {
+    // Retired snapshots are normally reclaimed by writers, make sure they don't linger when there
+    // are no more writes
+    rcu_reclaim();
     std::lock_guard<std::mutex> guard(mtx_);
     if (fiber_count_ > 0 || !started_) {
         check_timer->expires_from_now(std::chrono::milliseconds(50));
         check_timer->async_wait(std::bind(
             &scheduler_object::on_check_timer, shared_from_this(), std::placeholders::_1));
     } else {
-        io_service_.stop();
+        for (auto& n : nodes_) {
+            n->io_service_->stop();
+        }
         cv_.notify_one();
     }
 }
@@ -140,6 +341,10 @@ scheduler::scheduler() : impl_(std::make_shared<detail::scheduler_object>())
 {
 }
 
+scheduler::scheduler(attributes attrs) : impl_(std::make_shared<detail::scheduler_object>(attrs))
+{
+}
+
 scheduler::scheduler(std::shared_ptr<detail::scheduler_object> impl) : impl_(impl)
 {
 }
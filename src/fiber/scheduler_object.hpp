@@ -15,16 +15,66 @@
 #include <mutex>
 #include <condition_variable>
 #include <boost/asio/io_service.hpp>
+#include <fibio/fibers/fiber.hpp>
 #include "fiber_object.hpp"
+#include "timer_service.hpp"
 
 namespace fibio {
 namespace fibers {
 namespace detail {
 
+/**
+ * A group of worker threads sharing an io_service, one per NUMA node
+ */
+struct numa_node
+{
+    numa_node(int id, std::vector<unsigned> cpus, boost::asio::io_service& ios)
+    : id_(id), cpus_(std::move(cpus)), io_service_(&ios)
+    {
+    }
+
+    numa_node(int id, std::vector<unsigned> cpus)
+    : id_(id)
+    , cpus_(std::move(cpus))
+    , owned_io_service_(new boost::asio::io_service)
+    , work_(new boost::asio::io_service::work(*owned_io_service_))
+    , io_service_(owned_io_service_.get())
+    {
+    }
+
+    // NUMA node id, -1 if the scheduler is not NUMA-aware
+    int id_;
+    // CPUs belong to the node, worker threads are pinned to them
+    std::vector<unsigned> cpus_;
+    std::unique_ptr<boost::asio::io_service> owned_io_service_;
+    // Keeps the io_service of non-primary nodes running
+    std::unique_ptr<boost::asio::io_service::work> work_;
+    boost::asio::io_service* io_service_;
+};
+
+typedef std::vector<std::pair<int, std::vector<unsigned>>> numa_topology_t;
+
+/**
+ * Returns NUMA nodes and their CPUs, empty if the topology is not available
+ */
+numa_topology_t get_numa_topology();
+
+/**
+ * Pins the calling thread to the CPUs
+ */
+void bind_this_thread_to_cpus(const std::vector<unsigned>& cpus);
+
+/**
+ * Sets the memory policy of an unused memory range to prefer the NUMA node
+ */
+void bind_memory_to_node(void* addr, size_t len, int node);
+
 struct scheduler_object : std::enable_shared_from_this<scheduler_object>
 {
     scheduler_object();
 
+    scheduler_object(scheduler::attributes attrs);
+
     fiber_ptr_t make_fiber(fiber_data_base* entry, size_t stack_size = 0);
 
     fiber_ptr_t make_fiber(std::shared_ptr<boost::asio::strand> s,
@@ -39,6 +89,10 @@ struct scheduler_object : std::enable_shared_from_this<scheduler_object>
 
     size_t worker_pool_size() const;
 
+    boost::asio::io_service& select_io_service();
+
+    int get_numa_node(boost::asio::io_service& ios) const;
+
     void on_fiber_exit(fiber_ptr_t p);
 
     void on_check_timer(boost::system::error_code ec);
@@ -49,9 +103,16 @@ struct scheduler_object : std::enable_shared_from_this<scheduler_object>
     std::condition_variable cv_;
     std::vector<std::thread> threads_;
     boost::asio::io_service io_service_;
+    // Deadlines of timed waits, shares a single asio timer
+    timer_service timers_;
     std::atomic<size_t> fiber_count_;
     std::atomic<bool> started_;
     std::unique_ptr<timer_t> check_timer;
+    std::vector<std::unique_ptr<numa_node>> nodes_;
+    std::atomic<size_t> next_node_;
+    // Number of nodes with worker threads, threads are assigned to nodes in order
+    std::atomic<size_t> active_nodes_;
+    scheduler::attributes attrs_;
 };
 
 } // End of namespace detail
@@ -0,0 +1,93 @@
+//
+//  timer_service.cpp
+//  fibio
+//
+
+#include <mutex>
+#include <thread>
+#include "timer_service.hpp"
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+timer_service::timer_service(boost::asio::io_service& ios)
+: timer_(ios), armed_(time_point_t::max())
+{
+}
+
+void timer_service::arm(time_point_t deadline)
+{
+    // Called with mtx_ held, asio timers are not thread-safe
+    armed_ = deadline;
+    timer_.expires_at(deadline);
+    timer_.async_wait(std::bind(&timer_service::on_timer, this, std::placeholders::_1));
+}
+
+void timer_service::schedule(timer_entry* e, time_point_t deadline)
+{
+    std::lock_guard<spinlock> lock(mtx_);
+    e->deadline_ = deadline;
+    e->state_.store(timer_entry::PENDING, std::memory_order_relaxed);
+    entries_.insert(*e);
+    if (deadline < armed_) {
+        // New earliest deadline, the outstanding wait is canceled
+        arm(deadline);
+    }
+}
+
+bool timer_service::cancel(timer_entry* e)
+{
+    {
+        std::lock_guard<spinlock> lock(mtx_);
+        timer_entry::state_t s = e->state_.load(std::memory_order_relaxed);
+        if (s == timer_entry::PENDING) {
+            // The asio timer is left armed, a spurious expiry is cheaper than re-arming
+            entries_.erase(entries_.iterator_to(*e));
+            e->state_.store(timer_entry::IDLE, std::memory_order_relaxed);
+            return true;
+        } else if (s == timer_entry::IDLE) {
+            return false;
+        }
+    }
+    // The callback is running in another thread, it's short
+    while (e->state_.load(std::memory_order_acquire) != timer_entry::IDLE) {
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+void timer_service::on_timer(boost::system::error_code ec)
+{
+    if (ec == boost::asio::error::operation_aborted) {
+        // Superseded by an earlier deadline
+        return;
+    }
+    timer_entry* expired = nullptr;
+    {
+        std::lock_guard<spinlock> lock(mtx_);
+        armed_ = time_point_t::max();
+        time_point_t now = std::chrono::steady_clock::now();
+        timer_entry** tail = &expired;
+        while (!entries_.empty() && entries_.begin()->deadline_ <= now) {
+            timer_entry& e = *entries_.begin();
+            entries_.erase(entries_.begin());
+            e.state_.store(timer_entry::FIRING, std::memory_order_relaxed);
+            e.next_expired_ = nullptr;
+            *tail = &e;
+            tail = &e.next_expired_;
+        }
+        if (!entries_.empty()) arm(entries_.begin()->deadline_);
+    }
+    while (expired) {
+        // The entry may be destroyed as soon as it's idle, take the next one first
+        timer_entry* e = expired;
+        expired = e->next_expired_;
+        e->fn_(e);
+        e->state_.store(timer_entry::IDLE, std::memory_order_release);
+    }
+}
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
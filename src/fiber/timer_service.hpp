@@ -0,0 +1,105 @@
+//
+//  timer_service.hpp
+//  fibio
+//
+
+#ifndef fibio_timer_service_hpp
+#define fibio_timer_service_hpp
+
+#include <atomic>
+#include <boost/intrusive/set.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/system/error_code.hpp>
+#include <fibio/fibers/detail/forward.hpp>
+#include <fibio/fibers/detail/spinlock.hpp>
+
+namespace fibio {
+namespace fibers {
+namespace detail {
+
+/**
+ * A deadline registered in the timer service, lives in the waiting object, so scheduling a
+ * deadline doesn't allocate
+ */
+struct timer_entry : boost::intrusive::set_base_hook<>
+{
+    enum state_t
+    {
+        IDLE,
+        PENDING,
+        FIRING,
+    };
+
+    typedef void (*callback_t)(timer_entry*);
+
+    timer_entry() = default;
+
+    timer_entry(callback_t fn, void* data) : fn_(fn), data_(data) {}
+
+    bool operator<(const timer_entry& other) const { return deadline_ < other.deadline_; }
+
+    time_point_t deadline_;
+    callback_t fn_ = nullptr;
+    void* data_ = nullptr;
+    std::atomic<state_t> state_{IDLE};
+    // Links expired entries while firing
+    timer_entry* next_expired_ = nullptr;
+};
+
+/**
+ * class timer_service
+ *
+ * Multiplexes deadlines of all waiting fibers in a scheduler onto a single asio timer.
+ * Deadlines are kept in an intrusive red-black tree, scheduling and canceling are O(log n) and
+ * never allocate, and the asio timer is only re-armed when the earliest deadline changes.
+ * Callbacks are called in worker threads, not in any fiber strand.
+ */
+class timer_service
+{
+public:
+    timer_service(boost::asio::io_service& ios);
+
+    /**
+     * Calls `e->fn_(e)` at the deadline unless the entry is canceled before
+     */
+    void schedule(timer_entry* e, time_point_t deadline);
+
+    /**
+     * Cancels the entry, returns true if it's canceled before firing
+     * If the callback is running, waits until it's done, so the entry can be destroyed after
+     * this returns
+     */
+    bool cancel(timer_entry* e);
+
+private:
+    timer_service(const timer_service&) = delete;
+
+    void operator=(const timer_service&) = delete;
+
+    void arm(time_point_t deadline);
+
+    void on_timer(boost::system::error_code ec);
+
+    spinlock mtx_;
+    boost::intrusive::multiset<timer_entry> entries_;
+    timer_t timer_;
+    // Expiry of the outstanding wait, max() if there is none
+    time_point_t armed_;
+};
+
+/**
+ * Makes sure the callback is not pending or running when the entry goes away
+ */
+struct timer_entry_guard
+{
+    timer_service& timers_;
+    timer_entry& entry_;
+
+    ~timer_entry_guard() { timers_.cancel(&entry_); }
+};
+
+} // End of namespace detail
+} // End of namespace fibers
+} // End of namespace fibio
+
+#endif
@@ -0,0 +1,298 @@
+//
+//  test_cancellation.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/system/system_error.hpp>
+#include <fibio/fiber.hpp>
+#include <fibio/future.hpp>
+#include <fibio/asio.hpp>
+#include <fibio/iostream.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+typedef std::chrono::steady_clock clock_type;
+
+// Runs `fn` in a fiber bound to a token, cancels it after 50ms, returns true if `fn` is ended
+// by operation_cancelled in time
+template <typename Fn>
+bool cancelled_in_time(Fn fn)
+{
+    cancellation_source src;
+    bool cancelled = false;
+    auto start = clock_type::now();
+    fiber f([&]() {
+        this_fiber::cancellation_scope scope(src.get_token());
+        try {
+            fn();
+        } catch (operation_cancelled&) {
+            cancelled = true;
+        }
+    });
+    this_fiber::sleep_for(std::chrono::milliseconds(50));
+    assert(src.cancel());
+    f.join();
+    return cancelled && clock_type::now() - start < std::chrono::seconds(5);
+}
+
+void test_source()
+{
+    cancellation_token none;
+    assert(!none.can_be_cancelled());
+    assert(!none.is_cancelled());
+    none.throw_if_cancelled();
+
+    cancellation_source src;
+    cancellation_token t = src.get_token();
+    assert(t.can_be_cancelled());
+    int called = 0;
+    {
+        // Deregistered before the cancellation
+        cancellation_registration r(t, [&]() { called += 10; });
+    }
+    cancellation_registration r(t, [&]() { called++; });
+    assert(called == 0);
+    assert(src.cancel());
+    assert(called == 1);
+    assert(t.is_cancelled());
+    // Only the first request counts
+    assert(!src.cancel());
+    assert(called == 1);
+    // Called right away once cancelled
+    cancellation_registration r2(t, [&]() { called++; });
+    assert(called == 2);
+    bool thrown = false;
+    try {
+        t.throw_if_cancelled();
+    } catch (operation_cancelled&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_cross_thread()
+{
+    // Cancelled from a foreign thread
+    cancellation_source src;
+    bool cancelled = false;
+    fiber f([&]() {
+        this_fiber::cancellation_scope scope(src.get_token());
+        try {
+            this_fiber::sleep_for(std::chrono::seconds(10));
+        } catch (operation_cancelled&) {
+            cancelled = true;
+        }
+    });
+    std::thread t([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        src.cancel();
+    });
+    f.join();
+    t.join();
+    assert(cancelled);
+}
+
+void test_scope()
+{
+    cancellation_source src;
+    src.cancel();
+    assert(!this_fiber::cancellation_requested());
+    {
+        this_fiber::cancellation_scope scope(src.get_token());
+        assert(this_fiber::cancellation_requested());
+        assert(this_fiber::get_cancellation_token().is_cancelled());
+        bool thrown = false;
+        try {
+            this_fiber::cancellation_point();
+        } catch (operation_cancelled&) {
+            thrown = true;
+        }
+        assert(thrown);
+        {
+            // Nested scopes restore the outer token
+            this_fiber::cancellation_scope inner{cancellation_token()};
+            assert(!this_fiber::cancellation_requested());
+            this_fiber::sleep_for(std::chrono::milliseconds(1));
+        }
+        thrown = false;
+        try {
+            this_fiber::sleep_for(std::chrono::milliseconds(1));
+        } catch (operation_cancelled&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    assert(!this_fiber::get_cancellation_token().can_be_cancelled());
+    this_fiber::sleep_for(std::chrono::milliseconds(1));
+}
+
+void test_sleep()
+{
+    assert(cancelled_in_time([]() { this_fiber::sleep_for(std::chrono::seconds(10)); }));
+}
+
+void test_future()
+{
+    promise<int> p;
+    shared_future<int> sf = p.get_future().share();
+    assert(cancelled_in_time([&]() { sf.wait(); }));
+    assert(cancelled_in_time([&]() { sf.wait_for(std::chrono::seconds(10)); }));
+    // Waiters gave up, the state still works
+    p.set_value(42);
+    assert(sf.get() == 42);
+
+    // A ready future is not affected
+    cancellation_source src;
+    {
+        this_fiber::cancellation_scope scope(src.get_token());
+        promise<int> p2;
+        future<int> f2 = p2.get_future();
+        fiber setter([&]() {
+            this_fiber::sleep_for(std::chrono::milliseconds(10));
+            p2.set_value(1);
+        });
+        assert(f2.get() == 1);
+        setter.join();
+    }
+}
+
+void test_async()
+{
+    // Fibers started by async inherit the token, so abandoned work stops too
+    cancellation_source src;
+    future<int> f;
+    {
+        this_fiber::cancellation_scope scope(src.get_token());
+        f = async([]() {
+            this_fiber::sleep_for(std::chrono::seconds(10));
+            return 1;
+        });
+    }
+    this_fiber::sleep_for(std::chrono::milliseconds(50));
+    auto start = clock_type::now();
+    src.cancel();
+    bool thrown = false;
+    try {
+        f.get();
+    } catch (operation_cancelled&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(clock_type::now() - start < std::chrono::seconds(5));
+}
+
+void test_cv()
+{
+    mutex m;
+    condition_variable cv;
+    bool locked_after = false;
+    assert(cancelled_in_time([&]() {
+        std::unique_lock<mutex> lock(m);
+        try {
+            cv.wait(lock);
+        } catch (...) {
+            locked_after = lock.owns_lock();
+            throw;
+        }
+    }));
+    assert(locked_after);
+    assert(cancelled_in_time([&]() {
+        std::unique_lock<mutex> lock(m);
+        cv.wait_for(lock, std::chrono::seconds(10));
+    }));
+    // Notification still works for other waiters
+    bool notified = false;
+    fiber waiter([&]() {
+        std::unique_lock<mutex> lock(m);
+        while (!notified) cv.wait(lock);
+    });
+    this_fiber::sleep_for(std::chrono::milliseconds(10));
+    {
+        std::unique_lock<mutex> lock(m);
+        notified = true;
+    }
+    cv.notify_all();
+    waiter.join();
+}
+
+void test_io()
+{
+    tcp_stream_acceptor acc("127.0.0.1:23461");
+    stream::tcp_stream client;
+    fiber connector([&]() {
+        boost::system::error_code ec = client.connect("127.0.0.1:23461");
+        assert(!ec);
+    });
+    stream::tcp_stream server;
+    boost::system::error_code ec;
+    acc(server, ec);
+    assert(!ec);
+    connector.join();
+
+    // Reading from a stream fails, the peer never writes
+    cancellation_source src;
+    bool failed = false;
+    auto start = clock_type::now();
+    fiber reader([&]() {
+        this_fiber::cancellation_scope scope(src.get_token());
+        std::string line;
+        failed = !std::getline(server, line);
+    });
+    this_fiber::sleep_for(std::chrono::milliseconds(50));
+    src.cancel();
+    reader.join();
+    assert(failed);
+    assert(clock_type::now() - start < std::chrono::seconds(5));
+
+    // Raw asio operations guarded by cancellation_guard complete with operation_aborted
+    cancellation_source src2;
+    boost::system::error_code read_ec;
+    fiber raw_reader([&]() {
+        this_fiber::cancellation_scope scope(src2.get_token());
+        char buf[16];
+        auto& sock = *client.rdbuf();
+        asio::cancellation_guard guard(sock);
+        try {
+            sock.async_read_some(boost::asio::buffer(buf), asio::yield);
+        } catch (boost::system::system_error& e) {
+            read_ec = e.code();
+        }
+    });
+    this_fiber::sleep_for(std::chrono::milliseconds(50));
+    src2.cancel();
+    raw_reader.join();
+    assert(read_ec == boost::asio::error::operation_aborted);
+
+    // Uncancelled streams still work
+    client << "hello" << std::endl;
+    std::string line;
+    server.clear();
+    std::getline(server, line);
+    assert(line == "hello");
+    client.close();
+    server.close();
+    acc.close();
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    this_fiber::get_scheduler().add_worker_thread(3);
+
+    test_source();
+    test_cross_thread();
+    test_scope();
+    test_sleep();
+    test_future();
+    test_async();
+    test_cv();
+    test_io();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
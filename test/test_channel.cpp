@@ -0,0 +1,140 @@
+//
+//  test_channel.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/future.hpp>
+#include <fibio/fiberize.hpp>
+#include <fibio/concurrent/channel.hpp>
+
+using namespace fibio;
+
+constexpr int producers = 100;
+constexpr int max_num = 100;
+constexpr long sum = max_num * (max_num + 1) / 2 * producers;
+
+void test_cross_scheduler(scheduler& sched)
+{
+    // Bounded channel, producers will be blocked when it's full
+    concurrent::channel<int> ch(10);
+    barrier bar(producers);
+
+    // Consumer runs in another scheduler
+    long s = 0;
+    fiber consumer(sched, [&]() {
+        for (int popped : ch) {
+            s += popped;
+        }
+    });
+
+    // Producers run in the current scheduler
+    fiber_group fibers;
+    for (int n = 0; n < producers; n++) {
+        fibers.create_fiber([&]() {
+            for (int i = 1; i <= max_num; i++) {
+                assert(ch.push(i) == concurrent::queue_op_status::success);
+            }
+            if (bar.wait()) ch.close();
+        });
+    }
+    fibers.join_all();
+
+    // Join a fiber in another scheduler
+    assert(consumer.joinable());
+    consumer.join();
+    assert(s == sum);
+    assert(!ch.is_open());
+    assert(ch.push(1) == concurrent::queue_op_status::closed);
+}
+
+void test_try_ops()
+{
+    concurrent::channel<int> ch(1);
+    int n = 0;
+    assert(ch.try_pop(n) == concurrent::queue_op_status::empty);
+    assert(ch.try_push(42) == concurrent::queue_op_status::success);
+    assert(ch.try_push(43) == concurrent::queue_op_status::full);
+    assert(ch.size() == 1);
+    assert(ch.try_pop(n) == concurrent::queue_op_status::success);
+    assert(n == 42);
+    ch.close();
+    assert(ch.try_pop(n) == concurrent::queue_op_status::closed);
+}
+
+void test_foreign_thread()
+{
+    concurrent::channel<int> ch;
+    std::thread t([&]() {
+        for (int i = 1; i <= max_num; i++) {
+            ch.try_push(i);
+        }
+        ch.close();
+    });
+    long s = 0;
+    for (int popped : ch) {
+        s += popped;
+    }
+    t.join();
+    assert(s == max_num * (max_num + 1) / 2);
+}
+
+void test_interrupted_waiter()
+{
+    concurrent::channel<int> ch;
+    fiber first([&]() {
+        int n;
+        try {
+            ch.pop(n);
+            assert(false);
+        } catch (fiber_interrupted) {
+        }
+    });
+    this_fiber::sleep_for(std::chrono::milliseconds(10));
+    int popped = 0;
+    fiber second([&]() { assert(ch.pop(popped) == concurrent::queue_op_status::success); });
+    this_fiber::sleep_for(std::chrono::milliseconds(10));
+    // The push wakes the first waiter, which throws and hands the wakeup to the second one
+    first.interrupt();
+    assert(ch.push(42) == concurrent::queue_op_status::success);
+    first.join();
+    second.join();
+    assert(popped == 42);
+}
+
+void test_async(scheduler& sched)
+{
+    boost::asio::io_service* ios = &this_fiber::get_scheduler().get_io_service();
+    // The function runs in another scheduler
+    future<bool> f = async(sched, [ios]() {
+        return &this_fiber::get_scheduler().get_io_service() != ios;
+    });
+    assert(f.get());
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    this_fiber::get_scheduler().add_worker_thread(3);
+    scheduler sched;
+    sched.start(2);
+    // Keep the other scheduler running until all tests are done
+    concurrent::channel<int> done;
+    fiber keeper(sched, [&]() {
+        int n;
+        done.pop(n);
+    });
+
+    test_cross_scheduler(sched);
+    test_try_ops();
+    test_foreign_thread();
+    test_interrupted_waiter();
+    test_async(sched);
+
+    done.close();
+    keeper.join();
+    sched.join();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
@@ -0,0 +1,72 @@
+//
+//  test_combiner.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+combiner<std::map<int, long>> counters;
+combiner<long> total(0);
+
+void update(int n)
+{
+    for (int i = 0; i < 1000; i++) {
+        counters.apply([&](std::map<int, long>& m) { m[i % 10]++; });
+        long t = total.apply([](long& v) { return ++v; });
+        assert(t > 0);
+        if (i % 100 == 0 && this_fiber::is_a_fiber()) this_fiber::yield();
+    }
+}
+
+void test_exception()
+{
+    combiner<int> c(1);
+    try {
+        c.apply([](int& v) -> int { throw std::runtime_error("error"); });
+        assert(false);
+    } catch (std::runtime_error& e) {
+        // Thrown by the operation
+    }
+    assert(c.apply([](int& v) { return v; }) == 1);
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    test_exception();
+
+    scheduler sched;
+    sched.start(4);
+    std::vector<fiber> fibers;
+    for (int i = 0; i < 20; i++) {
+        fibers.emplace_back(sched, update, i);
+    }
+    // Foreign threads
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 2; i++) {
+        threads.emplace_back(update, i);
+    }
+    for (fiber& f : fibers) {
+        f.join();
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    sched.join();
+    assert(total.apply([](long& v) { return v; }) == 22 * 1000);
+    counters.apply([](std::map<int, long>& m) {
+        assert(m.size() == 10);
+        for (auto& e : m) {
+            assert(e.second == 22 * 100);
+        }
+    });
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
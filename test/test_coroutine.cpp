@@ -0,0 +1,107 @@
+//
+//  test_coroutine.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/future.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+task<int> add(int a, int b)
+{
+    co_await this_coroutine::yield();
+    co_return a + b;
+}
+
+task<int> sum(int n)
+{
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = co_await add(s, i);
+    }
+    co_return s;
+}
+
+task<std::string> wait_future()
+{
+    // Computed by a fiber
+    int v = co_await async([]() {
+        this_fiber::sleep_for(std::chrono::milliseconds(10));
+        return 42;
+    });
+    promise<std::string> p;
+    shared_future<std::string> sf = p.get_future().share();
+    p.set_value(std::to_string(v));
+    co_return co_await sf;
+}
+
+task<void> sleeper(std::chrono::milliseconds d)
+{
+    auto start = std::chrono::steady_clock::now();
+    co_await this_coroutine::sleep_for(d);
+    assert(std::chrono::steady_clock::now() - start >= d);
+}
+
+task<int> thrower()
+{
+    co_await this_coroutine::yield();
+    throw std::runtime_error("error");
+}
+
+task<int> catcher()
+{
+    try {
+        co_await thrower();
+    } catch (std::runtime_error&) {
+        co_return 1;
+    }
+    co_return 0;
+}
+
+void test_task()
+{
+    assert(co_spawn(sum(100)).get() == 4950);
+    assert(co_spawn(wait_future()).get() == "42");
+    co_spawn(sleeper(std::chrono::milliseconds(20))).get();
+    assert(co_spawn(catcher()).get() == 1);
+    try {
+        co_spawn(thrower()).get();
+        assert(false);
+    } catch (std::runtime_error&) {
+    }
+}
+
+void test_many()
+{
+    // Lots of suspended tasks, each one only takes its frame
+    std::vector<future<void>> fs;
+    for (int i = 0; i < 10000; i++) {
+        fs.push_back(co_spawn(sleeper(std::chrono::milliseconds(50))));
+    }
+    wait_for_all(fs.begin(), fs.end());
+    for (auto& f : fs) {
+        f.get();
+    }
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    this_fiber::get_scheduler().add_worker_thread(3);
+    fiber_group fg;
+    fg.create_fiber(test_task);
+    fg.create_fiber(test_many);
+    fg.join_all();
+    // Spawned in another scheduler
+    scheduler sched;
+    sched.start(2);
+    fiber(sched, [&sched]() { assert(co_spawn(sched, sum(10)).get() == 45); }).join();
+    sched.join();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+//
+//  test_cpu_pool.cpp
+//  fibio
+//
+
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <fibio/fiber.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+constexpr int children = 100;
+
+long fib(int n)
+{
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+void test_run()
+{
+    fiber::id id = this_fiber::get_id();
+    std::thread::id tid = std::this_thread::get_id();
+    std::thread::id pool_tid = run_on_cpu_pool([]() { return std::this_thread::get_id(); });
+    // Job runs in a pool thread, and the fiber is resumed after it completes
+    assert(pool_tid != tid);
+    assert(this_fiber::get_id() == id);
+    assert(run_on_cpu_pool(fib, 20) == 6765);
+
+    // void and reference results
+    int n = 0;
+    run_on_cpu_pool([&n]() { n = 42; });
+    assert(n == 42);
+    int& r = run_on_cpu_pool([&n]() -> int& { return n; });
+    assert(&r == &n);
+
+    // Exceptions are propagated
+    bool caught = false;
+    try {
+        run_on_cpu_pool([]() { throw std::runtime_error("error"); });
+    } catch (std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+}
+
+void test_back_pressure()
+{
+    // Queue can hold only 1 job, other submitters are parked until there is room
+    cpu_pool::attributes attrs;
+    attrs.threads = 2;
+    attrs.queue_capacity = 1;
+    cpu_pool pool(attrs);
+    assert(pool.size() == 2);
+
+    std::atomic<long> sum(0);
+    std::atomic<size_t> max_queued(0);
+    fiber_group fibers;
+    for (int i = 0; i < children; i++) {
+        fibers.create_fiber([&pool, &sum, &max_queued, i]() {
+            sum += pool.run(
+                [&pool, &max_queued](int n) {
+                    size_t q = pool.queued();
+                    size_t m = max_queued;
+                    while (q > m && !max_queued.compare_exchange_weak(m, q)) {
+                    }
+                    return fib(15) + n;
+                },
+                i);
+        });
+    }
+    fibers.join_all();
+    assert(sum == fib(15) * children + children * (children - 1) / 2);
+    // Submitters beyond the capacity were parked instead of queued
+    assert(max_queued <= 1);
+    assert(pool.queued() == 0);
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    this_fiber::get_scheduler().add_worker_thread(3);
+
+    test_run();
+    test_back_pressure();
+    // Runs in the calling thread if it is not a fiber
+    std::thread([]() { assert(run_on_cpu_pool(fib, 10) == 55); }).join();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
@@ -7,6 +7,7 @@
 //
 
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <fibio/fiber.hpp>
 #include <fibio/fiberize.hpp>
@@ -42,12 +43,41 @@ void parent()
     assert(s == sum);
 }
 
+void foreign_thread()
+{
+    // Bounded queues in both directions, both sides may block
+    concurrent::concurrent_queue<int> to_fiber(4);
+    concurrent::concurrent_queue<int> to_thread(4);
+    std::thread t([&]() {
+        for (int i = 1; i <= 1000; i++) {
+            to_fiber.push(i);
+        }
+        to_fiber.close();
+        long s = 0;
+        for (int popped : to_thread) {
+            s += popped;
+        }
+        assert(s == 1000 * 1001 / 2);
+    });
+    long s = 0;
+    for (int popped : to_fiber) {
+        s += popped;
+    }
+    assert(s == 1000 * 1001 / 2);
+    for (int i = 1; i <= 1000; i++) {
+        to_thread.push(i);
+    }
+    to_thread.close();
+    t.join();
+}
+
 int fibio::main(int argc, char* argv[])
 {
     this_fiber::get_scheduler().add_worker_thread(3);
 
     fiber_group fibers;
     fibers.create_fiber(parent);
+    fibers.create_fiber(foreign_thread);
     fibers.join_all();
     std::cout << "main_fiber exiting" << std::endl;
     return 0;
@@ -47,6 +47,44 @@ void parent(mutex& m, condition_variable& cv)
     f.join();
 }
 
+std::atomic<int> timeouts(0);
+std::atomic<int> notified(0);
+
+void waiter(mutex& m, condition_variable& cv, int n)
+{
+    unique_lock<mutex> lock(m);
+    // Odd waiters time out, even waiters wait long enough to be notified
+    auto d = (n % 2) ? std::chrono::milliseconds(10 + n % 7) : std::chrono::seconds(10);
+    if (cv.wait_for(lock, d) == cv_status::timeout) {
+        timeouts++;
+    } else {
+        notified++;
+    }
+    assert(lock.owns_lock());
+}
+
+void timeout_storm()
+{
+    // Lots of timed waiters on one condition variable, timing out at about the same time
+    mutex m;
+    condition_variable cv;
+    fiber_group fibers;
+    for (int i = 0; i < 1000; i++) {
+        fibers.create_fiber(waiter, std::ref(m), std::ref(cv), i);
+    }
+    this_fiber::sleep_for(std::chrono::milliseconds(100));
+    while (timeouts + notified < 1000) {
+        cv.notify_all();
+        this_fiber::sleep_for(std::chrono::milliseconds(1));
+    }
+    fibers.join_all();
+    // Odd waiters starting late under load may be notified before they time out, even waiters
+    // never time out
+    assert(timeouts + notified == 1000);
+    assert(timeouts >= 1);
+    assert(timeouts <= 500);
+}
+
 int fibio::main(int argc, char* argv[])
 {
     this_fiber::get_scheduler().add_worker_thread(3);
@@ -57,6 +95,7 @@ int fibio::main(int argc, char* argv[])
     fiber_group fibers;
     fibers.create_fiber(parent, std::ref(m), std::ref(cv));
     fibers.join_all();
+    timeout_storm();
     std::cout << "main_fiber exiting" << std::endl;
     return 0;
 }
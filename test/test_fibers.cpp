@@ -6,11 +6,18 @@
 //  Copyright (c) 2014 0d0a.com. All rights reserved.
 //
 
+#include <atomic>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 #include <chrono>
 #include <thread>
 #include <fibio/fiber.hpp>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#endif
 
 // By defining this, fibio will not replace stream buffers for std streams,
 // blocking of std streams will block a thread of scheduler.
@@ -187,6 +194,71 @@ int main_fiber(int n)
     return 0;
 }
 
+// Runs the function in a fiber of a scheduler with a single worker thread
+template <typename Fn>
+void run_in_one_worker(fibio::scheduler::attributes attrs, Fn fn)
+{
+    fibio::scheduler sched(attrs);
+    sched.start(1);
+    fibio::fiber f(sched, fn);
+    f.join();
+    sched.join();
+}
+
+#if defined(__linux__)
+// Number of times the calling thread has blocked
+long voluntary_switches()
+{
+    rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_nvcsw;
+}
+
+void test_spin_before_park()
+{
+    // Timers firing within the spin budget are served by the spinning worker without blocking
+    fibio::scheduler::attributes attrs;
+    attrs.spin_budget = std::chrono::seconds(1);
+    run_in_one_worker(attrs, []() {
+        long before = voluntary_switches();
+        for (int i = 0; i < 10; i++) {
+            fibio::this_fiber::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(voluntary_switches() == before);
+    });
+    // Without spinning the worker parks itself while the fiber sleeps
+    run_in_one_worker(fibio::scheduler::attributes(), []() {
+        long before = voluntary_switches();
+        for (int i = 0; i < 10; i++) {
+            fibio::this_fiber::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(voluntary_switches() > before);
+    });
+}
+
+void test_busy_poll()
+{
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    unsigned cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) cpu++;
+    fibio::scheduler::attributes attrs;
+    attrs.busy_poll = true;
+    attrs.cpus.push_back(cpu);
+    run_in_one_worker(attrs, [cpu]() {
+        // The worker is pinned to the CPU
+        cpu_set_t set;
+        pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+        assert(CPU_COUNT(&set) == 1);
+        assert(CPU_ISSET(cpu, &set));
+        // And keeps polling instead of blocking while there is nothing to run
+        long before = voluntary_switches();
+        fibio::this_fiber::sleep_for(std::chrono::milliseconds(50));
+        assert(voluntary_switches() == before);
+    });
+}
+#endif
+
 int main()
 {
     // Create 10 schedulers from a fiber belongs to the default scheduler
@@ -200,6 +272,48 @@ int main()
     }
     for (auto& t : threads) t.join();
 
+#if defined(__linux__)
+    test_spin_before_park();
+    test_busy_poll();
+#endif
+
+    {
+        // Two NUMA nodes and a single worker thread, the second node must not get any fiber
+        fibio::scheduler::attributes attrs;
+        attrs.numa_aware = true;
+        attrs.numa_nodes.resize(2);
+        fibio::fiberize_with_sched(fibio::scheduler(attrs), main_fiber, 10);
+        // One worker thread per node, idle workers run fibers of the other node
+        attrs.spin_budget = std::chrono::microseconds(50);
+        fibio::scheduler sched(attrs);
+        sched.start(2);
+        fibio::fiber f(sched, main_fiber, 11);
+        sched.join();
+    }
+
+    {
+        // Joining from a plain thread blocks the thread until the fiber exits
+        fibio::scheduler sched;
+        sched.start(1);
+        std::atomic<bool> done(false);
+        fibio::fiber f1(sched, [&done]() {
+            fibio::this_fiber::sleep_for(std::chrono::milliseconds(100));
+            done = true;
+        });
+        fibio::fiber f2(sched, []() { throw std::runtime_error("ex"); });
+        assert(f1.joinable());
+        f1.join();
+        assert(done);
+        bool caught = false;
+        try {
+            f2.join(true);
+        } catch (std::runtime_error&) {
+            caught = true;
+        }
+        assert(caught);
+        sched.join();
+    }
+
     std::cout << "main thread exiting" << std::endl;
     return 0;
 }
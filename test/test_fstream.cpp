@@ -7,6 +7,7 @@
 //
 
 #include <iostream>
+#include <string>
 #include <fibio/iostream.hpp>
 #include <fibio/fiberize.hpp>
 
@@ -28,10 +29,96 @@ void test_fstream()
     }
 }
 
+void test_large_file()
+{
+    // Spans many buffers, so reads and writes go through the executor many times
+    std::string line(1000, 'x');
+    {
+        ofstream f("/tmp/test_large_file");
+        for (int i = 0; i < 1000; i++) {
+            f << i << line << '\n';
+        }
+    }
+
+    {
+        ifstream f("/tmp/test_large_file");
+        std::string l;
+        for (int i = 0; i < 1000; i++) {
+            assert(std::getline(f, l));
+            assert(l == std::to_string(i) + line);
+        }
+        assert(!std::getline(f, l));
+    }
+
+    {
+        // Appending and seeking keep the file position in sync with the stdio buffer
+        ofstream f("/tmp/test_large_file", std::ios_base::app);
+        f << "end\n";
+    }
+    {
+        ifstream f("/tmp/test_large_file");
+        f.seekg(-4, std::ios_base::end);
+        std::string l;
+        std::getline(f, l);
+        assert(l == "end");
+        f.seekg(0);
+        std::getline(f, l);
+        assert(l == "0" + line);
+    }
+}
+
+#if !defined(_WIN32)
+void test_mmap()
+{
+    {
+        ofstream f("/tmp/test_mmap_file");
+        f << "Hello, World!\nline 2\n";
+    }
+
+    mmap_istream f("/tmp/test_mmap_file");
+    assert(f.is_open());
+    assert(f.size() == 21);
+    // Content is accessible without reading
+    assert(std::string(f.data(), 5) == "Hello");
+    assert(f.prefetch().get());
+    std::string l;
+    std::getline(f, l);
+    assert(l == "Hello, World!");
+    std::getline(f, l);
+    assert(l == "line 2");
+    assert(!std::getline(f, l));
+
+    // Seeking within the mapping
+    f.clear();
+    f.seekg(7);
+    std::getline(f, l);
+    assert(l == "World!");
+    f.seekg(-7, std::ios_base::end);
+    std::getline(f, l);
+    assert(l == "line 2");
+    f.seekg(100);
+    assert(f.fail());
+    f.close();
+    assert(!f.is_open());
+
+    // Empty and missing files
+    { ofstream e("/tmp/test_mmap_empty"); }
+    mmap_istream e("/tmp/test_mmap_empty");
+    assert(e.is_open() && e.size() == 0);
+    assert(!std::getline(e, l));
+    mmap_istream m("/tmp/no_such_file");
+    assert(!m.is_open() && m.fail());
+}
+#endif
+
 int fibio::main(int argc, char* argv[])
 {
     fiber_group fg;
     fg.create_fiber(test_fstream);
+    fg.create_fiber(test_large_file);
+#if !defined(_WIN32)
+    fg.create_fiber(test_mmap);
+#endif
     fg.join_all();
     std::cout << "main_fiber exiting" << std::endl;
     return 0;
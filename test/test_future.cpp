@@ -6,7 +6,11 @@
 //  Copyright (c) 2014 0d0a.com. All rights reserved.
 //
 
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 #include <boost/lexical_cast.hpp>
 #include <fibio/fiber.hpp>
 #include <fibio/future.hpp>
@@ -170,6 +174,28 @@ void test_wait_for_all3()
     assert(dur >= std::chrono::seconds(1));
 }
 
+void test_wait_for_all_race()
+{
+    // The waiter leaves as soon as the last future becomes ready, setters must not touch it after
+    for (size_t i = 0; i < 1000; i++) {
+        promise<int> p0, p1;
+        future<int> f0 = p0.get_future();
+        future<int> f1 = p1.get_future();
+        std::vector<future<int>> fv;
+        std::vector<promise<int>> pv(4);
+        for (auto& p : pv) fv.push_back(p.get_future());
+        std::thread t([&]() {
+            p0.set_value(1);
+            p1.set_value(2);
+            for (auto& p : pv) p.set_value(3);
+        });
+        wait_for_all(f0, f1);
+        wait_for_all(fv.begin(), fv.end());
+        assert(f0.get() + f1.get() == 3);
+        t.join();
+    }
+}
+
 void test_async_wait_for_any1()
 {
     std::vector<future<void>> fv;
@@ -287,6 +313,263 @@ void test_packaged_task()
     }
 }
 
+void test_then_policy()
+{
+    {
+        // Runs in a new fiber on the strand of this fiber
+        promise<int> p;
+        fiber::id self = this_fiber::get_id();
+        auto f = p.get_future().then(launch::post, [self](future<int>& f) {
+            assert(this_fiber::is_a_fiber());
+            assert(this_fiber::get_id() != self);
+            return f.get() + 1;
+        });
+        std::thread t([&p]() { p.set_value(1); });
+        assert(f.get() == 2);
+        t.join();
+    }
+    {
+        // Runs in the context making the source ready
+        promise<int> p;
+        std::thread::id tid;
+        auto f = p.get_future().then(launch::sync, [&tid](future<int>& f) {
+            tid = std::this_thread::get_id();
+            return f.get();
+        });
+        std::thread t([&p]() { p.set_value(1); });
+        std::thread::id setter = t.get_id();
+        t.join();
+        assert(f.get() == 1);
+        assert(tid == setter);
+    }
+    {
+        // Runs in another scheduler
+        scheduler sched;
+        sched.start(1);
+        auto f = async([]() { return 10; }).then(sched, [](future<int>& f) {
+            assert(this_fiber::is_a_fiber());
+            return f.get() * 2;
+        });
+        assert(f.get() == 20);
+        sched.join();
+    }
+}
+
+void test_when_all_any()
+{
+    {
+        promise<int> p1;
+        promise<std::string> p2;
+        auto f = when_all(p1.get_future(), p2.get_future().share());
+        p1.set_value(1);
+        assert(f.wait_for(std::chrono::milliseconds(10)) == future_status::timeout);
+        p2.set_value("2");
+        auto t = f.get();
+        assert(std::get<0>(t).get() == 1);
+        assert(std::get<1>(t).get() == "2");
+    }
+    {
+        std::vector<future<int>> fs;
+        for (int i = 0; i < 10; i++) {
+            fs.push_back(async([i]() {
+                this_fiber::sleep_for(std::chrono::milliseconds(10 - i));
+                return i;
+            }));
+        }
+        auto v = when_all(fs.begin(), fs.end()).get();
+        assert(v.size() == 10);
+        for (int i = 0; i < 10; i++) {
+            assert(v[i].get() == i);
+        }
+        assert(when_all(fs.begin(), fs.begin()).get().empty());
+    }
+    {
+        promise<int> p1;
+        promise<int> p2;
+        auto f = when_any(p1.get_future(), p2.get_future());
+        p2.set_value(2);
+        auto r = f.get();
+        assert(r.index == 1);
+        assert(std::get<1>(r.futures).get() == 2);
+        p1.set_value(1);
+        assert(std::get<0>(r.futures).get() == 1);
+    }
+    {
+        std::vector<promise<int>> ps(5);
+        std::vector<future<int>> fs;
+        for (auto& p : ps) {
+            fs.push_back(p.get_future());
+        }
+        auto f = when_any(fs.begin(), fs.end());
+        ps[3].set_value(3);
+        auto r = f.get();
+        assert(r.index == 3);
+        assert(r.futures.size() == 5);
+        assert(r.futures[3].get() == 3);
+        assert(when_any().get().index == std::size_t(-1));
+    }
+}
+
+void test_then_exception()
+{
+    promise<int> p;
+    auto f = p.get_future()
+                 .then([](future<int>& f) -> int { throw std::runtime_error("error"); })
+                 .then([](future<int>& f) { return f.get() + 1; });
+    p.set_value(1);
+    try {
+        f.get();
+        assert(false);
+    } catch (std::runtime_error& e) {
+        // Thrown by the first continuation
+    }
+    // The continuation is discarded with the broken promise
+    future<int> f1;
+    {
+        promise<int> p1;
+        f1 = p1.get_future().then([](future<int>& f) { return f.get(); });
+    }
+    try {
+        f1.get();
+        assert(false);
+    } catch (broken_promise& e) {
+    }
+}
+
+void test_allocator()
+{
+    arena a(256);
+    {
+        promise<int> p(boost::allocator_arg, arena_allocator<int>(a));
+        auto f = p.get_future();
+        p.set_value(42);
+        assert(f.get() == 42);
+    }
+    {
+        packaged_task<int(int)> pt(std::allocator_arg,
+                                   arena_allocator<int>(a),
+                                   [](int x) { return x * 10; });
+        auto f = pt.get_future().then([](future<int>& f) { return f.get() + 1; });
+        pt(42);
+        assert(f.get() == 421);
+    }
+    {
+        // Many states, more than a chunk
+        std::vector<promise<std::string>> ps;
+        std::vector<future<std::string>> fs;
+        for (int i = 0; i < 100; i++) {
+            ps.emplace_back(boost::allocator_arg, arena_allocator<std::string>(a));
+            fs.push_back(ps.back().get_future());
+        }
+        for (int i = 0; i < 100; i++) {
+            ps[i].set_value(boost::lexical_cast<std::string>(i));
+        }
+        for (int i = 0; i < 100; i++) {
+            assert(fs[i].get() == boost::lexical_cast<std::string>(i));
+        }
+    }
+    {
+        pooled_allocator<int> pa;
+        std::vector<int, pooled_allocator<int>> v(pa);
+        for (int i = 0; i < 1000; i++) {
+            v.push_back(i);
+        }
+        assert(v[999] == 999);
+    }
+    {
+        // Over-aligned types are not served from the pool
+        struct alignas(64) aligned_value
+        {
+            int n;
+        };
+        pooled_allocator<aligned_value> pa;
+        aligned_value* p = pa.allocate(3);
+        assert(reinterpret_cast<uintptr_t>(p) % 64 == 0);
+        pa.deallocate(p, 3);
+        promise<aligned_value> pr;
+        auto f = pr.get_future();
+        pr.set_value(aligned_value{42});
+        assert(f.get().n == 42);
+    }
+}
+
+void test_foreign_thread_promise()
+{
+    // Fulfilled in a foreign thread, waited in a fiber
+    {
+        promise<int> p;
+        future<int> f = p.get_future();
+        std::thread t([&p]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            p.set_value(42);
+        });
+        assert(f.get() == 42);
+        t.join();
+    }
+    // Fulfilled in a fiber, waited in a foreign thread
+    {
+        promise<int> p;
+        future<int> f = p.get_future();
+        int result = 0;
+        std::thread t([&f, &result]() { result = f.get(); });
+        this_fiber::sleep_for(std::chrono::milliseconds(10));
+        p.set_value(7);
+        t.join();
+        assert(result == 7);
+    }
+}
+
+void test_shared_waiters()
+{
+    // Many fibers and a foreign thread waiting on the same state
+    promise<int> p;
+    shared_future<int> f = p.get_future().share();
+    std::atomic<int> sum(0);
+    fiber_group fg;
+    for (int i = 0; i < 20; i++) {
+        fg.create_fiber([f, &sum]() { sum += f.get(); });
+    }
+    std::thread t([f, &sum]() { sum += f.get(); });
+    this_fiber::sleep_for(std::chrono::milliseconds(10));
+    p.set_value(2);
+    fg.join_all();
+    t.join();
+    assert(sum == 21 * 2);
+    // Already satisfied
+    try {
+        p.set_value(3);
+        assert(false);
+    } catch (promise_already_satisfied& e) {
+        // The value has been set
+    }
+}
+
+void test_timed_wait_race()
+{
+    // Timeouts racing with fulfillment, in fibers and in foreign threads
+    for (int i = 0; i < 100; i++) {
+        promise<void> p;
+        shared_future<void> f = p.get_future().share();
+        future_status fs1 = future_status::deferred;
+        future_status fs2 = future_status::deferred;
+        fiber w([&]() { fs1 = f.wait_for(std::chrono::microseconds(i * 5)); });
+        std::thread t([&]() { fs2 = f.wait_for(std::chrono::microseconds(i * 5)); });
+        this_fiber::sleep_for(std::chrono::microseconds(250));
+        p.set_value();
+        w.join();
+        t.join();
+        assert(fs1 == future_status::ready || fs1 == future_status::timeout);
+        assert(fs2 == future_status::ready || fs2 == future_status::timeout);
+        assert(f.wait_for(std::chrono::seconds(0)) == future_status::ready);
+    }
+    // Never satisfied, the state goes away with timed out waiters
+    {
+        promise<int> p;
+        future<int> f = p.get_future();
+        assert(f.wait_for(std::chrono::milliseconds(1)) == future_status::timeout);
+    }
+}
+
 int thr_func(int x)
 {
     std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -327,6 +610,47 @@ void test_foreign_thread_pool()
     f.join();
 }
 
+void test_foreign_thread_pool_bounded()
+{
+    // Only 2 jobs can be queued, other submitters are parked until there is room
+    foreign_thread_pool pool(3, 2);
+    assert(pool.size() == 3);
+    std::atomic<int> sum(0);
+    fiber_group fibers;
+    for (int i = 0; i < 50; i++) {
+        fibers.create_fiber([&pool, &sum, i]() {
+            if (i % 2) {
+                sum += pool([](int n) { return n; }, i);
+            } else {
+                sum += pool.async_call([](int n) { return n; }, i).get();
+            }
+        });
+    }
+    fibers.join_all();
+    assert(sum == 50 * 49 / 2);
+
+    // void and reference results, and exceptions
+    int n = 0;
+    pool([&n]() { n = 42; });
+    assert(n == 42);
+    int& r = pool([&n]() -> int& { return n; });
+    assert(&r == &n);
+    pool.async_call([&n]() { n = 43; }).get();
+    assert(n == 43);
+    bool caught = false;
+    try {
+        pool.async_call([]() -> int { throw std::runtime_error("error"); }).get();
+    } catch (std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+
+    // Jobs submitting jobs, and submission from a foreign thread
+    assert(pool([&pool]() { return pool(thr_func, 1) + pool.async_call(thr_func, 2).get(); })
+           == 30);
+    std::thread([&pool]() { assert(pool.async_call(thr_func, 3).get() == 30); }).join();
+}
+
 int fibio::main(int argc, char* argv[])
 {
     fiber_group fg;
@@ -340,6 +664,7 @@ int fibio::main(int argc, char* argv[])
     fg.create_fiber(test_wait_for_all1);
     fg.create_fiber(test_wait_for_all2);
     fg.create_fiber(test_wait_for_all3);
+    fg.create_fiber(test_wait_for_all_race);
     fg.create_fiber(test_async_wait_for_any1);
     fg.create_fiber(test_async_wait_for_any2);
     fg.create_fiber(test_async_wait_for_all1);
@@ -347,8 +672,16 @@ int fibio::main(int argc, char* argv[])
     fg.create_fiber(test_then2);
     fg.create_fiber(test_then3);
     fg.create_fiber(test_then4);
+    fg.create_fiber(test_then_exception);
+    fg.create_fiber(test_then_policy);
+    fg.create_fiber(test_when_all_any);
     fg.create_fiber(test_packaged_task);
+    fg.create_fiber(test_allocator);
+    fg.create_fiber(test_foreign_thread_promise);
+    fg.create_fiber(test_shared_waiters);
+    fg.create_fiber(test_timed_wait_race);
     fg.create_fiber(test_foreign_thread_pool);
+    fg.create_fiber(test_foreign_thread_pool_bounded);
     fg.join_all();
     std::cout << "main_fiber exiting" << std::endl;
     return 0;
@@ -0,0 +1,182 @@
+//
+//  test_logger.cpp
+//  fibio
+//
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/iostream.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+std::vector<std::string> lines_of(const std::string& s)
+{
+    std::vector<std::string> ret;
+    std::istringstream is(s);
+    std::string l;
+    while (std::getline(is, l)) ret.push_back(l);
+    return ret;
+}
+
+bool contains(const std::string& s, const std::string& sub)
+{
+    return s.find(sub) != std::string::npos;
+}
+
+void test_format()
+{
+    std::ostringstream os;
+    {
+        logger log(os);
+        this_fiber::set_name("worker");
+        log.info("request done", {{"path", "/index"}, {"status", 200}});
+        // Below the level
+        log.debug("hidden");
+        log.set_level(log_level::debug);
+        assert(log.enabled(log_level::debug));
+        log.debug("shown");
+        log.flush();
+        auto lines = lines_of(os.str());
+        assert(lines.size() == 2);
+        assert(contains(lines[0], " INFO [fiber:"));
+        assert(contains(lines[0], " worker] request done path=/index status=200"));
+        assert(contains(lines[1], "DEBUG"));
+        assert(contains(lines[1], "shown"));
+        // Timestamp
+        assert(lines[0][4] == '-' && lines[0][10] == 'T');
+        this_fiber::set_name("");
+    }
+}
+
+void test_sync()
+{
+    std::ostringstream os;
+    logger::attributes attrs;
+    attrs.flush_interval = std::chrono::seconds(60);
+    logger log(os, attrs);
+    // Synchronous records are written before returning, along with records queued before them
+    log.info("first");
+    log.error("second");
+    auto lines = lines_of(os.str());
+    assert(lines.size() == 2);
+    assert(contains(lines[0], "first"));
+    assert(contains(lines[1], "ERROR"));
+}
+
+void test_concurrent()
+{
+    std::ostringstream os;
+    constexpr int fibers_count = 20;
+    constexpr int records = 200;
+    {
+        logger::attributes attrs;
+        attrs.ring_capacity = 100000;
+        logger log(os, attrs);
+        fiber_group fibers;
+        for (int i = 0; i < fibers_count; i++) {
+            fibers.create_fiber([&log, i]() {
+                for (int j = 0; j < records; j++) {
+                    log.info("record", {{"fiber", i}, {"seq", j}});
+                    if (j % 50 == 0) this_fiber::yield();
+                }
+            });
+        }
+        // Foreign threads have rings of their own
+        std::thread t([&log]() {
+            for (int j = 0; j < records; j++) log.warning("from thread", {{"seq", j}});
+        });
+        fibers.join_all();
+        t.join();
+        assert(log.dropped() == 0);
+    }
+    // Everything is written when the logger is destroyed
+    auto lines = lines_of(os.str());
+    assert(lines.size() == (fibers_count + 1) * records);
+    assert(contains(os.str(), "[thread:"));
+}
+
+void test_order()
+{
+    // Fibers sleep between records, timers resume them on any thread so they move between rings
+    std::ostringstream os;
+    constexpr int fibers_count = 8;
+    constexpr int records = 100;
+    logger::attributes attrs;
+    attrs.ring_capacity = 100000;
+    attrs.flush_interval = std::chrono::seconds(60);
+    logger log(os, attrs);
+    fiber_group fibers;
+    for (int i = 0; i < fibers_count; i++) {
+        fibers.create_fiber([&log, i]() {
+            for (int j = 0; j < records; j++) {
+                log.info("record", {{"fiber", i}, {"seq", j}});
+                this_fiber::sleep_for(std::chrono::microseconds(100));
+            }
+            // Written along with everything logged before it
+            log.error("done", {{"fiber", i}});
+        });
+    }
+    fibers.join_all();
+    log.flush();
+    auto lines = lines_of(os.str());
+    assert(lines.size() == fibers_count * (records + 1));
+    std::vector<int> next(fibers_count, 0);
+    for (auto& l : lines) {
+        int i = std::stoi(l.substr(l.find("fiber=") + 6));
+        if (contains(l, "] done")) {
+            assert(next[i] == records);
+            continue;
+        }
+        assert(std::stoi(l.substr(l.find("seq=") + 4)) == next[i]);
+        next[i]++;
+    }
+}
+
+void test_drop()
+{
+    std::ostringstream os;
+    logger::attributes attrs;
+    attrs.ring_capacity = 4;
+    attrs.flush_interval = std::chrono::seconds(60);
+    uint64_t dropped;
+    {
+        logger log(os, attrs);
+        // The flusher may not keep up with a tiny ring
+        for (int i = 0; i < 1000; i++) log.info("x");
+        dropped = log.dropped();
+    }
+    assert(lines_of(os.str()).size() + dropped == 1000);
+}
+
+void test_file()
+{
+    std::remove("/tmp/test_logger.log");
+    {
+        logger log("/tmp/test_logger.log");
+        log.info("to file", {{"k", "v"}});
+    }
+    ifstream f("/tmp/test_logger.log");
+    std::string l;
+    std::getline(f, l);
+    assert(contains(l, "to file k=v"));
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    this_fiber::get_scheduler().add_worker_thread(3);
+
+    test_format();
+    test_sync();
+    test_concurrent();
+    test_order();
+    test_drop();
+    test_file();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <thread>
 #include <boost/random.hpp>
 #include <fibio/fiber.hpp>
 #include <fibio/fiberize.hpp>
@@ -95,8 +96,143 @@ void rparent()
     // printf("parent():2\n");
 }
 
+mutex::attributes adaptive_attrs()
+{
+    mutex::attributes attrs;
+    attrs.spin_count = 100;
+    return attrs;
+}
+
+mutex am(adaptive_attrs());
+long counter = 0;
+
+void adaptive(int n)
+{
+    // Short critical sections, the mutex is usually released while others are spinning
+    for (int i = 0; i < 100; i++) {
+        lock_guard<mutex> lock(am);
+        counter++;
+    }
+    for (int i = 0; i < 100; i++) {
+        unique_lock<mutex> lock(am, try_to_lock);
+        if (!lock.owns_lock()) lock.lock();
+        counter++;
+    }
+}
+
+void test_adaptive()
+{
+    // Spinning only happens when the owner is running in another thread
+    scheduler sched;
+    sched.start(2);
+    std::vector<fiber> fibers;
+    for (int i = 0; i < 4; i++) {
+        fibers.emplace_back(sched, adaptive, i);
+    }
+    for (fiber& f : fibers) {
+        f.join();
+    }
+    sched.join();
+    assert(counter == 4 * 200);
+}
+
+mutex::attributes barging_attrs()
+{
+    mutex::attributes attrs;
+    attrs.lock_policy = mutex::policy::barging;
+    return attrs;
+}
+
+mutex bm(barging_attrs());
+long barging_counter = 0;
+
+void barging(int n)
+{
+    for (int i = 0; i < 100; i++) {
+        lock_guard<mutex> lock(bm);
+        barging_counter++;
+        // Give other fibers a chance to queue up behind the mutex
+        if (i % 10 == 0) this_fiber::yield();
+    }
+}
+
+void test_barging()
+{
+    fiber_group fibers;
+    for (int i = 0; i < 10; i++) {
+        fibers.create_fiber(barging, i);
+    }
+    fibers.join_all();
+    assert(barging_counter == 10 * 100);
+    mutex::statistics stats = bm.get_statistics();
+    assert(stats.acquisitions == 10 * 100);
+    assert(stats.contended_acquisitions <= stats.acquisitions);
+}
+
+void test_interrupted_waiter(mutex::attributes attrs)
+{
+    mutex mtx(attrs);
+    mtx.lock();
+    fiber first([&]() {
+        try {
+            mtx.lock();
+            assert(false);
+        } catch (fiber_interrupted) {
+        }
+    });
+    this_fiber::sleep_for(std::chrono::milliseconds(10));
+    bool locked = false;
+    fiber second([&]() {
+        lock_guard<mutex> lock(mtx);
+        locked = true;
+    });
+    this_fiber::sleep_for(std::chrono::milliseconds(10));
+    // The unlock wakes the first waiter, which throws and passes the wakeup to the second one
+    first.interrupt();
+    mtx.unlock();
+    first.join();
+    second.join();
+    assert(locked);
+    assert(mtx.try_lock());
+    mtx.unlock();
+}
+
+template <typename Mutex>
+bool throws_outside_fiber()
+{
+    Mutex mtx;
+    bool caught = false;
+    std::thread([&]() {
+        try {
+            mtx.lock();
+        } catch (fiber_exception&) {
+            caught = true;
+        }
+    }).join();
+    return caught;
+}
+
+void test_foreign_thread()
+{
+    // Only mutex can be locked by foreign threads
+    mutex mtx;
+    std::thread([&mtx]() {
+        mtx.lock();
+        mtx.unlock();
+    }).join();
+    assert(throws_outside_fiber<timed_mutex>());
+    assert(throws_outside_fiber<recursive_mutex>());
+    assert(throws_outside_fiber<recursive_timed_mutex>());
+}
+
 int fibio::main(int argc, char* argv[])
 {
+    test_adaptive();
+    test_barging();
+    test_interrupted_waiter(mutex::attributes());
+    test_interrupted_waiter(barging_attrs());
+    test_foreign_thread();
+
     fiber_group fibers;
     fibers.create_fiber(parent);
     fibers.create_fiber(rparent);
@@ -107,6 +243,11 @@ int fibio::main(int argc, char* argv[])
         fibers.create_fiber(f1, i);
     }
     fibers.join_all();
+    // Fibers sleep while holding `m`, so most acquisitions had to wait
+    mutex::statistics stats = m.get_statistics();
+    assert(stats.acquisitions == 10 * 100);
+    assert(stats.contended_acquisitions > 0);
+    assert(stats.total_wait_time.count() > 0);
     std::cout << "main_fiber exiting" << std::endl;
     return 0;
 }
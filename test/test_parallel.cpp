@@ -0,0 +1,160 @@
+//
+//  test_parallel.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+constexpr std::size_t elements = 100000;
+
+void test_for()
+{
+    std::vector<int> v(elements, 0);
+    std::mutex m;
+    std::set<std::thread::id> threads;
+    parallel_for(std::size_t(0), elements, [&](std::size_t i) {
+        v[i] = int(i);
+        if (i % 1000 == 0) {
+            std::lock_guard<std::mutex> lock(m);
+            threads.insert(std::this_thread::get_id());
+        }
+    });
+    for (std::size_t i = 0; i < elements; i++) {
+        assert(v[i] == int(i));
+    }
+    std::cout << "parallel_for used " << threads.size() << " threads" << std::endl;
+
+    // Every element is visited exactly once with any grain size
+    for (std::size_t grain : {1, 7, 1000, 1000000}) {
+        std::vector<std::atomic<int>> visits(1000);
+        for (auto& n : visits) n = 0;
+        parallel_for_each(visits.begin(), visits.end(), [](std::atomic<int>& n) { n++; }, grain);
+        for (auto& n : visits) assert(n == 1);
+    }
+
+    // Empty ranges
+    parallel_for(10, 10, [](int) { assert(false); });
+    parallel_for(10, 5, [](int) { assert(false); });
+}
+
+void test_transform_reduce()
+{
+    std::vector<long> v(elements);
+    for (std::size_t i = 0; i < elements; i++) v[i] = long(i);
+    std::vector<long> sq(elements);
+    auto end = parallel_transform(v.begin(), v.end(), sq.begin(), [](long x) { return x * 2; });
+    assert(end == sq.end());
+    for (std::size_t i = 0; i < elements; i++) assert(sq[i] == long(i) * 2);
+
+    long n = long(elements);
+    assert(parallel_reduce(v.begin(), v.end(), 0L) == n * (n - 1) / 2);
+    assert(parallel_reduce(v.begin(), v.end(), 10L, std::plus<long>(), 3) == n * (n - 1) / 2 + 10);
+    assert(parallel_reduce(v.begin(), v.begin(), 42L) == 42);
+
+    // Partial results are combined in order
+    std::vector<std::string> words;
+    std::string expected;
+    for (int i = 0; i < 500; i++) {
+        words.push_back(std::to_string(i));
+        expected += words.back();
+    }
+    assert(parallel_reduce(words.begin(), words.end(), std::string(), std::plus<std::string>(), 7)
+           == expected);
+}
+
+void test_scan()
+{
+    for (std::size_t grain : {0, 1, 3, 1000, 1000000}) {
+        std::vector<long> v(10007, 1);
+        std::vector<long> out(v.size());
+        auto end = parallel_inclusive_scan(v.begin(), v.end(), out.begin(), std::plus<long>(), grain);
+        assert(end == out.end());
+        for (std::size_t i = 0; i < out.size(); i++) assert(out[i] == long(i + 1));
+    }
+
+    // In place, with a non-commutative operation
+    std::vector<std::string> s(100, "a");
+    parallel_inclusive_scan(s.begin(), s.end(), s.begin(), std::plus<std::string>(), 9);
+    for (std::size_t i = 0; i < s.size(); i++) assert(s[i] == std::string(i + 1, 'a'));
+}
+
+void test_sort()
+{
+    std::mt19937 gen(42);
+    for (std::size_t grain : {0, 1, 100, 1000000}) {
+        std::vector<int> v(elements);
+        for (auto& x : v) x = int(gen() % 1000);
+        std::vector<int> expected(v);
+        std::sort(expected.begin(), expected.end());
+        parallel_sort(v.begin(), v.end(), std::less<int>(), grain);
+        assert(v == expected);
+    }
+
+    std::vector<int> v{5, 3, 9, 1};
+    parallel_sort(v.begin(), v.end(), std::greater<int>());
+    assert((v == std::vector<int>{9, 5, 3, 1}));
+}
+
+void test_exception()
+{
+    std::atomic<int> runs(0);
+    bool caught = false;
+    try {
+        parallel_for(0, 1000, [&](int i) {
+            runs++;
+            if (i == 10) throw std::runtime_error("error");
+        }, 1);
+    } catch (std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+    // Chunks after the failing one may be skipped
+    assert(runs <= 1000);
+}
+
+void test_concurrent()
+{
+    // Many fibers running algorithms at the same time, none of them blocks a worker thread
+    std::atomic<long> total(0);
+    fiber_group fibers;
+    for (int i = 0; i < 20; i++) {
+        fibers.create_fiber([&total]() {
+            std::vector<long> v(1000, 1);
+            total += parallel_reduce(v.begin(), v.end(), 0L, std::plus<long>(), 10);
+        });
+    }
+    fibers.join_all();
+    assert(total == 20 * 1000);
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    this_fiber::get_scheduler().add_worker_thread(3);
+
+    test_for();
+    test_transform_reduce();
+    test_scan();
+    test_sort();
+    test_exception();
+    test_concurrent();
+    // Runs in the calling thread if it is not a fiber
+    std::thread([]() {
+        std::vector<int> v{3, 1, 2};
+        parallel_sort(v.begin(), v.end());
+        assert((v == std::vector<int>{1, 2, 3}));
+        assert(parallel_reduce(v.begin(), v.end(), 0) == 6);
+    }).join();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
@@ -0,0 +1,177 @@
+//
+//  test_profiler.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+mutex m;
+shared_timed_mutex sm;
+condition_variable cv;
+bool ready = false;
+
+void hold_mutex(int n)
+{
+    for (int i = 0; i < 100; i++) {
+        lock_guard<mutex> lock(m);
+        this_fiber::sleep_for(std::chrono::microseconds(10));
+    }
+}
+
+void hold_shared_mutex(int n)
+{
+    for (int i = 0; i < 20; i++) {
+        if (n % 2) {
+            unique_lock<shared_timed_mutex> lock(sm);
+            this_fiber::sleep_for(std::chrono::microseconds(10));
+        } else {
+            shared_lock<shared_timed_mutex> lock(sm);
+            this_fiber::sleep_for(std::chrono::microseconds(10));
+        }
+    }
+}
+
+void wait_ready(int n)
+{
+    unique_lock<mutex> lock(m);
+    cv.wait(lock, [] { return ready; });
+}
+
+const contention_record* find(const std::vector<contention_record>& records, const void* lock)
+{
+    for (auto& r : records) {
+        if (r.lock == lock) return &r;
+    }
+    return nullptr;
+}
+
+template <typename Fn>
+void run(Fn fn)
+{
+    scheduler sched;
+    sched.start(4);
+    std::vector<fiber> fibers;
+    for (int i = 0; i < 10; i++) {
+        fibers.emplace_back(sched, fn, i);
+    }
+    for (fiber& f : fibers) {
+        f.join();
+    }
+    sched.join();
+}
+
+void test_disabled()
+{
+    assert(!contention_profiler::enabled());
+    run(hold_mutex);
+    assert(contention_profiler::records().empty());
+}
+
+void test_mutex()
+{
+    contention_profiler::enable();
+    run(hold_mutex);
+    contention_profiler::disable();
+    auto records = contention_profiler::records();
+    const contention_record* r = find(records, &m);
+    assert(r);
+    assert(r->kind == lock_kind::mutex);
+    assert(r->call_site);
+    assert(r->count > 0);
+    assert(r->total_wait >= r->max_wait);
+    // Sorted by total wait time
+    for (size_t i = 1; i < records.size(); i++) {
+        assert(records[i - 1].total_wait >= records[i].total_wait);
+    }
+    contention_profiler::reset();
+    assert(contention_profiler::records().empty());
+}
+
+void test_sampling()
+{
+    contention_profiler::enable();
+    run(hold_mutex);
+    uint64_t all = find(contention_profiler::records(), &m)->count;
+    contention_profiler::reset();
+    contention_profiler::enable(1000000);
+    run(hold_mutex);
+    contention_profiler::disable();
+    auto records = contention_profiler::records();
+    const contention_record* r = find(records, &m);
+    assert(!r || r->count < all);
+    contention_profiler::reset();
+}
+
+void test_shared_mutex()
+{
+    contention_profiler::enable();
+    run(hold_shared_mutex);
+    contention_profiler::disable();
+    auto records = contention_profiler::records();
+    const contention_record* r = find(records, &sm);
+    assert(r);
+    assert(r->kind == lock_kind::shared_timed_mutex);
+    // Each blocked acquisition is recorded once, waits on the internal lock and condition
+    // variables are not recorded on their own
+    uint64_t count = 0;
+    for (auto& rec : records) {
+        assert(rec.lock == &sm);
+        count += rec.count;
+    }
+    assert(count <= 10 * 20);
+    contention_profiler::reset();
+}
+
+void test_cv()
+{
+    contention_profiler::enable();
+    scheduler sched;
+    sched.start(2);
+    std::vector<fiber> fibers;
+    for (int i = 0; i < 10; i++) {
+        fibers.emplace_back(sched, wait_ready, i);
+    }
+    // A foreign thread notifies the waiting fibers
+    std::thread t([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        {
+            unique_lock<mutex> lock(m);
+            ready = true;
+        }
+        cv.notify_all();
+    });
+    for (fiber& f : fibers) {
+        f.join();
+    }
+    t.join();
+    sched.join();
+    contention_profiler::disable();
+    auto records = contention_profiler::records();
+    const contention_record* r = find(records, &cv);
+    assert(r);
+    assert(r->kind == lock_kind::condition_variable);
+    assert(r->count > 0 && r->count <= 10);
+    std::ostringstream ss;
+    contention_profiler::dump(ss);
+    assert(ss.str().find("condition_variable") != std::string::npos);
+    assert(ss.str().find("Hottest call sites:") != std::string::npos);
+    contention_profiler::reset();
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    test_disabled();
+    test_mutex();
+    test_sampling();
+    test_shared_mutex();
+    test_cv();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
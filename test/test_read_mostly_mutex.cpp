@@ -0,0 +1,79 @@
+//
+//  test_read_mostly_mutex.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+read_mostly_mutex m;
+// Always updated together by writers
+long a = 0;
+long b = 0;
+std::atomic<long> reads(0);
+
+void reader(int n)
+{
+    for (int i = 0; i < 1000; i++) {
+        shared_lock<read_mostly_mutex> lock(m);
+        assert(a == b);
+        reads++;
+        if (i % 100 == 0) this_fiber::yield();
+    }
+}
+
+void writer(int n)
+{
+    for (int i = 0; i < 10; i++) {
+        {
+            std::unique_lock<read_mostly_mutex> lock(m);
+            a++;
+            this_fiber::yield();
+            b++;
+        }
+        this_fiber::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void test_try_lock()
+{
+    assert(m.try_lock_shared());
+    // Cannot lock exclusively while there are readers
+    assert(!m.try_lock());
+    m.unlock_shared();
+    assert(m.try_lock());
+    // Readers back off while a writer holds the mutex
+    assert(!m.try_lock_shared());
+    m.unlock();
+    assert(m.try_lock_shared());
+    m.unlock_shared();
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    test_try_lock();
+
+    // Readers and writers running in multiple threads
+    scheduler sched;
+    sched.start(2);
+    std::vector<fiber> fibers;
+    for (int i = 0; i < 8; i++) {
+        fibers.emplace_back(sched, reader, i);
+    }
+    for (int i = 0; i < 2; i++) {
+        fibers.emplace_back(sched, writer, i);
+    }
+    for (fiber& f : fibers) {
+        f.join();
+    }
+    sched.join();
+    assert(reads == 8 * 1000);
+    assert(a == 2 * 10);
+    assert(b == 2 * 10);
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
@@ -0,0 +1,82 @@
+//
+//  test_snapshot.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+std::atomic<long> live(0);
+
+struct routes
+{
+    routes() { live++; }
+
+    routes(const routes& other) : version(other.version), table(other.table) { live++; }
+
+    ~routes() { live--; }
+
+    long version = 0;
+    std::map<std::string, long> table;
+};
+
+snapshot<routes> current;
+
+void reader(int n)
+{
+    for (int i = 0; i < 1000; i++) {
+        const routes& r = *current;
+        // Every version is consistent
+        for (auto& e : r.table) {
+            assert(e.second == r.version);
+        }
+        if (i % 10 == 0) this_fiber::yield();
+    }
+}
+
+void writer()
+{
+    for (long v = 1; v <= 100; v++) {
+        current.modify([v](routes& r) {
+            r.version = v;
+            for (auto& e : r.table) {
+                e.second = v;
+            }
+            r.table["route" + std::to_string(v % 10)] = v;
+        });
+        this_fiber::yield();
+    }
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    assert(current->version == 0);
+    {
+        scheduler sched;
+        sched.start(2);
+        std::vector<fiber> fibers;
+        for (int i = 0; i < 8; i++) {
+            fibers.emplace_back(sched, reader, i);
+        }
+        fibers.emplace_back(sched, writer);
+        for (fiber& f : fibers) {
+            f.join();
+        }
+        sched.join();
+    }
+    assert(current->version == 100);
+    assert(current->table.size() == 10);
+
+    // Old versions are reclaimed once all worker threads have passed a quiescent point
+    current.update(routes());
+    this_fiber::sleep_for(std::chrono::milliseconds(200));
+    assert(live == 1);
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}
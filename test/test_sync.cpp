@@ -0,0 +1,131 @@
+//
+//  test_sync.cpp
+//  fibio
+//
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <fibio/fiber.hpp>
+#include <fibio/fiberize.hpp>
+
+using namespace fibio;
+
+void test_semaphore()
+{
+    // At most 3 fibers in the section at the same time
+    semaphore sem(3);
+    std::atomic<int> inside(0);
+    std::atomic<int> done(0);
+    scheduler sched;
+    sched.start(2);
+    std::vector<fiber> fibers;
+    for (int i = 0; i < 20; i++) {
+        fibers.emplace_back(sched, [&]() {
+            for (int j = 0; j < 50; j++) {
+                sem.acquire();
+                assert(++inside <= 3);
+                if (j % 5 == 0) this_fiber::yield();
+                inside--;
+                sem.release();
+            }
+            done++;
+        });
+    }
+    for (fiber& f : fibers) {
+        f.join();
+    }
+    sched.join();
+    assert(done == 20);
+    assert(sem.available() == 3);
+    assert(sem.try_acquire());
+    assert(sem.available() == 2);
+
+    // Released from a foreign thread
+    semaphore empty;
+    assert(!empty.try_acquire());
+    std::thread t([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        empty.release(2);
+    });
+    empty.acquire();
+    empty.acquire();
+    t.join();
+    assert(empty.available() == 0);
+}
+
+void test_latch()
+{
+    latch l(10);
+    std::atomic<int> passed(0);
+    fiber_group fibers;
+    for (int i = 0; i < 5; i++) {
+        fibers.create_fiber([&]() {
+            l.wait();
+            passed++;
+        });
+    }
+    this_fiber::yield();
+    assert(!l.try_wait());
+    // Counted down from fibers and a foreign thread
+    for (int i = 0; i < 5; i++) {
+        fibers.create_fiber([&]() { l.count_down(); });
+    }
+    std::thread t([&]() { l.count_down(4); });
+    t.join();
+    l.arrive_and_wait();
+    fibers.join_all();
+    assert(l.try_wait());
+    assert(passed == 5);
+}
+
+void test_event()
+{
+    // Manual-reset event releases all waiters
+    event manual;
+    std::atomic<int> passed(0);
+    fiber_group fibers;
+    for (int i = 0; i < 5; i++) {
+        fibers.create_fiber([&]() {
+            manual.wait();
+            passed++;
+        });
+    }
+    this_fiber::yield();
+    assert(passed == 0);
+    std::thread t([&]() { manual.set(); });
+    t.join();
+    fibers.join_all();
+    assert(passed == 5);
+    assert(manual.is_set());
+    assert(manual.try_wait());
+    manual.reset();
+    assert(!manual.try_wait());
+
+    // Auto-reset event releases one waiter per set
+    event automatic(event::reset_mode::automatic);
+    passed = 0;
+    for (int i = 0; i < 5; i++) {
+        fibers.create_fiber([&]() {
+            automatic.wait();
+            passed++;
+        });
+    }
+    for (int i = 0; i < 5; i++) {
+        this_fiber::sleep_for(std::chrono::milliseconds(1));
+        automatic.set();
+        while (passed <= i) this_fiber::yield();
+        assert(passed == i + 1);
+    }
+    fibers.join_all();
+    assert(!automatic.is_set());
+}
+
+int fibio::main(int argc, char* argv[])
+{
+    test_semaphore();
+    test_latch();
+    test_event();
+    std::cout << "main_fiber exiting" << std::endl;
+    return 0;
+}